@@ -26,6 +26,59 @@ struct ApiConfig {
     String key;
 };
 
+// === Transporte de subida (uplink) ===
+enum class UplinkTipo {
+    HTTP_GET,        // una petición GET por muestra (compatibilidad api.php)
+    HTTP_POST_LOTE,  // POST en lote con line protocol
+    MQTT             // publicación QoS1 sobre conexión persistente
+};
+
+struct MqttConfig {
+    String host;
+    uint16_t port;
+    String usuario;    // vacío = sin autenticación
+    String clave;
+    String topicBase;  // se publica en <topicBase>/<mac>/lp
+};
+
+struct UplinkConfig {
+    UplinkTipo tipo;
+    MqttConfig mqtt;
+};
+
+// === Respaldo en SD ===
+enum class BackupFormato {
+    CSV,      // filas de texto (legible directamente)
+    BINARIO   // registros de 20 B con CRC16 (backup_record.h), ~2.7x menos bytes
+};
+
+struct BackupConfig {
+    BackupFormato formato;
+};
+
+// === Eventlog en SD (sdlog.cpp) ===
+enum class LogFormato {
+    CSV,      // ts_iso,ts_us,level,mod,code,fsm,kv (legible directamente)
+    BINARIO   // ids internados + delta varint (log_bin.h), convertir con tools/eventlog_bin2csv
+};
+
+struct LogConfig {
+    LogFormato formato;
+};
+
+// === Retención en SD (retencion.cpp) ===
+struct RetencionCategoria {
+    uint32_t maxKB;    // presupuesto de bytes (0 = sin límite)
+    uint16_t maxDias;  // antigüedad máxima en días (0 = sin límite)
+};
+
+struct RetencionConfig {
+    RetencionCategoria raw;        // /sent/raw + /sent/arch (backups ya enviados)
+    RetencionCategoria auditoria;  // /sent/backup_*.csv (auditoría CSV anterior al diario)
+    RetencionCategoria eventlog;   // /eventlog_*.csv y .bin
+    uint16_t compactarDias;        // /sent/raw con más días → /sent/arch/raw_YYYYMM.oxz (0 = no compactar)
+};
+
 // === Configuración de NTP (hora por red) ===
 struct NtpConfig {
     String servidor;
@@ -41,6 +94,7 @@ struct PinConfig {
     int SCK;    // SPI Clock
     int MISO;   // SPI Master In
     int MOSI;   // SPI Master Out
+    int RTC_SQW; // Salida SQW del DS3231 (1 Hz, open-drain; -1 = sin cablear)
 };
 
 // === Ventanas temporales para la FSM (segundo del minuto) ===
@@ -57,6 +111,10 @@ struct Config {
     SensorConfig voltaje;
     NetworkConfig network;
     ApiConfig api;
+    UplinkConfig uplink;
+    BackupConfig backup;
+    LogConfig log;
+    RetencionConfig retencion;
     NtpConfig ntp;
     PinConfig pins;
     TimingConfig timing;
@@ -0,0 +1,132 @@
+#ifndef AC_CALC_H
+#define AC_CALC_H
+
+// Análisis de una ventana de tensión alterna (ZMPT101B, muestras crudas del
+// ADC a frecuencia fija): valor eficaz verdadero sin componente continua,
+// frecuencia por cruces por cero interpolados, factor de cresta y armónicos
+// de orden bajo (Goertzel) respecto al fundamental.
+//
+// Los bucles son planos y de longitud conocida para que el compilador los
+// desenrolle: las pasadas de media/RMS/pico no tienen dependencias entre
+// iteraciones y Goertzel avanza los AC_ARMONICOS filtros juntos por muestra.
+// Sin dependencias de Arduino.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#ifndef AC_ARMONICOS
+#define AC_ARMONICOS 7          // armónicos 1..AC_ARMONICOS
+#endif
+#ifndef AC_HISTERESIS
+#define AC_HISTERESIS 0.1f      // fracción del RMS para rearmar el detector de cruces
+#endif
+#ifndef AC_RMS_MIN
+#define AC_RMS_MIN 15.0f        // cuentas ADC; por debajo es el ruido de la entrada en reposo
+#endif
+#ifndef AC_FREC_MIN
+#define AC_FREC_MIN 40.0f       // Hz; fuera de [MIN, MAX] no es la red
+#endif
+#ifndef AC_FREC_MAX
+#define AC_FREC_MAX 70.0f
+#endif
+
+struct AcResultado {
+  bool valido;                       // alterna de red: rms ≥ AC_RMS_MIN, dos cruces y frecuencia plausible
+  float media;                       // componente continua (cuentas ADC)
+  float rms;                         // eficaz sin continua (cuentas ADC; ciclos completos si valido)
+  float pico;                        // |x − media| máximo (cuentas ADC)
+  float cresta;                      // pico / rms (√2 ≈ 1.414 en una senoidal)
+  float frecuenciaHz;
+  float armonicos[AC_ARMONICOS + 1]; // amplitud de h respecto a h=1 ([1] = 1)
+  float thd;                         // √(Σ h≥2 A²) / A1
+  uint16_t ciclos;                   // ciclos completos usados para frecuencia/armónicos
+};
+
+// Analiza n muestras tomadas a fs Hz. 'y' es espacio de trabajo de n floats.
+inline AcResultado acAnalizar(const uint16_t* x, size_t n, float fs, float* y) {
+  AcResultado r = {};
+  if (n < 4) return r;
+
+  // Continua
+  uint32_t suma = 0;
+  for (size_t i = 0; i < n; i++) suma += x[i];
+  r.media = (float)suma / (float)n;
+
+  // Centrado, eficaz y pico
+  float sumaCuad = 0.0f, maxV = 0.0f, minV = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    const float v = (float)x[i] - r.media;
+    y[i] = v;
+    sumaCuad += v * v;
+    maxV = v > maxV ? v : maxV;
+    minV = v < minV ? v : minV;
+  }
+  r.rms = sqrtf(sumaCuad / (float)n);
+  r.pico = maxV > -minV ? maxV : -minV;
+  r.cresta = r.rms > 0.0f ? r.pico / r.rms : 0.0f;
+  // Con la entrada en reposo la histéresis, relativa al RMS, no separa el
+  // ruido: cruzaría cero a ~1 kHz
+  if (r.rms < AC_RMS_MIN) return r;
+
+  // Cruces por cero ascendentes, interpolados linealmente. Tras un cruce hay
+  // que bajar de −histéresis antes de aceptar otro (ruido cerca de cero).
+  const float hist = AC_HISTERESIS * r.rms;
+  bool armado = false;
+  float primero = -1.0f, ultimo = -1.0f;
+  size_t iPrimero = 0, iUltimo = 0;
+  uint16_t cruces = 0;
+  for (size_t i = 1; i < n; i++) {
+    if (y[i] < -hist) armado = true;
+    if (armado && y[i - 1] < 0.0f && y[i] >= 0.0f) {
+      const float t = (float)(i - 1) + y[i - 1] / (y[i - 1] - y[i]);
+      if (cruces == 0) { primero = t; iPrimero = i; }
+      ultimo = t;
+      iUltimo = i;
+      cruces++;
+      armado = false;
+    }
+  }
+  if (cruces < 2) return r;
+  r.ciclos = cruces - 1;
+  r.frecuenciaHz = (float)r.ciclos * fs / (ultimo - primero);
+  if (r.frecuenciaHz < AC_FREC_MIN || r.frecuenciaHz > AC_FREC_MAX) return r;
+  r.valido = true;
+
+  // Eficaz sobre ciclos completos: sin el sesgo del ciclo a medias del borde
+  const size_t m = iUltimo - iPrimero;
+  float sumaCiclos = 0.0f;
+  for (size_t i = iPrimero; i < iUltimo; i++) sumaCiclos += y[i] * y[i];
+  r.rms = sqrtf(sumaCiclos / (float)m);
+  r.cresta = r.pico / r.rms;
+
+  // Goertzel sobre los mismos ciclos [iPrimero, iUltimo): casi sin fuga
+  // espectral sin necesidad de ventana
+  float coef[AC_ARMONICOS], s1[AC_ARMONICOS] = {}, s2[AC_ARMONICOS] = {};
+  for (int h = 0; h < AC_ARMONICOS; h++) {
+    coef[h] = 2.0f * cosf(2.0f * (float)M_PI * (float)(h + 1) * r.frecuenciaHz / fs);
+  }
+  for (size_t i = iPrimero; i < iUltimo; i++) {
+    const float v = y[i];
+    for (int h = 0; h < AC_ARMONICOS; h++) {
+      const float s = v + coef[h] * s1[h] - s2[h];
+      s2[h] = s1[h];
+      s1[h] = s;
+    }
+  }
+  float amp[AC_ARMONICOS];
+  for (int h = 0; h < AC_ARMONICOS; h++) {
+    const float p = s1[h] * s1[h] + s2[h] * s2[h] - coef[h] * s1[h] * s2[h];
+    amp[h] = 2.0f * sqrtf(p > 0.0f ? p : 0.0f) / (float)m;
+  }
+  float sumaArm = 0.0f;
+  r.armonicos[0] = 0.0f;
+  for (int h = 0; h < AC_ARMONICOS; h++) {
+    r.armonicos[h + 1] = amp[0] > 0.0f ? amp[h] / amp[0] : 0.0f;
+    if (h) sumaArm += amp[h] * amp[h];
+  }
+  r.thd = amp[0] > 0.0f ? sqrtf(sumaArm) / amp[0] : 0.0f;
+  return r;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef ACK_JOURNAL_H
+#define ACK_JOURNAL_H
+
+// Diario de confirmaciones del reenvío (/sent/ack.jrn), sustituye a la
+// auditoría fila a fila. Una entrada por bloque confirmado:
+//
+//   Cabecera (16 B): "OXAK" | version u8 | recSize u8 | reservado (10 B)
+//   Entrada  (28 B): fecha u32 (YYYYMMDD, 0 = unsync) | fmt u8 (0 csv, 1 bin) |
+//                    reservado u8 | n u16 | inicio u32 | fin u32 |
+//                    ts_envio u64 (µs) | crc16 | reservado u16
+//
+// [inicio, fin) es el rango de bytes del backup cuyos registros válidos se
+// confirmaron en ese envío (los saltados del rango no se enviaron).
+// tools/ack_expand reconstruye con esto y /sent/raw/ el CSV de auditoría
+// con status=ENVIADO. Little-endian, sin dependencias de Arduino.
+
+#include "backup_record.h"   // bkpCrc16, bkpPut*/bkpGet*
+
+#define ACK_JOURNAL_PATH "/sent/ack.jrn"
+#define ACK_MAGIC        "OXAK"
+#define ACK_VERSION      1
+#define ACK_HDR_LEN      16
+#define ACK_REC_LEN      28
+#define ACK_REC_CRC_OFF  24
+
+struct AckEntrada {
+  uint32_t fecha;
+  bool binario;
+  uint16_t n;                   // registros confirmados
+  uint32_t inicio;
+  uint32_t fin;
+  unsigned long long tsEnvio;   // µs UNIX
+};
+
+inline void ackCodificarCabecera(uint8_t out[ACK_HDR_LEN]) {
+  memset(out, 0, ACK_HDR_LEN);
+  memcpy(out, ACK_MAGIC, 4);
+  out[4] = ACK_VERSION;
+  out[5] = ACK_REC_LEN;
+}
+
+inline bool ackCabeceraValida(const uint8_t in[ACK_HDR_LEN]) {
+  return memcmp(in, ACK_MAGIC, 4) == 0 && in[4] == ACK_VERSION && in[5] == ACK_REC_LEN;
+}
+
+inline void ackCodificar(const AckEntrada& a, uint8_t out[ACK_REC_LEN]) {
+  memset(out, 0, ACK_REC_LEN);
+  bkpPutU32(out, a.fecha);
+  out[4] = a.binario ? 1 : 0;
+  bkpPutU16(out + 6, a.n);
+  bkpPutU32(out + 8, a.inicio);
+  bkpPutU32(out + 12, a.fin);
+  bkpPutU64(out + 16, a.tsEnvio);
+  bkpPutU16(out + ACK_REC_CRC_OFF, bkpCrc16(out, ACK_REC_CRC_OFF));
+}
+
+// false si el CRC no coincide
+inline bool ackDecodificar(const uint8_t in[ACK_REC_LEN], AckEntrada& a) {
+  if (bkpGetU16(in + ACK_REC_CRC_OFF) != bkpCrc16(in, ACK_REC_CRC_OFF)) return false;
+  a.fecha   = bkpGetU32(in);
+  a.binario = in[4] != 0;
+  a.n       = bkpGetU16(in + 6);
+  a.inicio  = bkpGetU32(in + 8);
+  a.fin     = bkpGetU32(in + 12);
+  a.tsEnvio = bkpGetU64(in + 16);
+  return true;
+}
+
+#endif
@@ -0,0 +1,152 @@
+// adc_continuo.cpp - ADC1 continuo por I2S/DMA en ventanas con doble buffer
+// La tarea escribe siempre en el buffer que no está publicado. El lector copia
+// el publicado y comprueba la secuencia (seqlock): si mientras copiaba se
+// publicó otra ventana, la tarea pudo pisarlo y se repite la copia.
+
+#include "adc_continuo.h"
+#include "sdlog.h"
+#include <driver/i2s.h>
+#include <driver/adc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define ADC_I2S I2S_NUM_0
+
+static_assert(ADC_DMA_LEN % 2 == 0, "ADC_DMA_LEN debe ser par (pares de muestras por palabra)");
+
+static uint16_t g_buf[2][ADC_VENTANA];
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t g_seq = 0;       // ventanas publicadas
+static volatile uint8_t g_publicado = 0;  // buffer de la última ventana completa
+static volatile int64_t g_finUs = 0;
+static volatile uint32_t g_errores = 0;
+static volatile float g_fsMedidaHz = 0;   // 0 = aún sin medir
+static TaskHandle_t g_tarea = nullptr;
+
+static adc1_channel_t canalDeGpio(int pin) {
+  switch (pin) {
+    case 36: return ADC1_CHANNEL_0;
+    case 37: return ADC1_CHANNEL_1;
+    case 38: return ADC1_CHANNEL_2;
+    case 39: return ADC1_CHANNEL_3;
+    case 32: return ADC1_CHANNEL_4;
+    case 33: return ADC1_CHANNEL_5;
+    case 34: return ADC1_CHANNEL_6;
+    case 35: return ADC1_CHANNEL_7;
+    default: return ADC1_CHANNEL_MAX;
+  }
+}
+
+static void tareaAdc(void*) {
+  uint16_t dma[ADC_DMA_LEN];
+  uint8_t escritura = 1;
+  size_t pos = 0;
+  int64_t medidaDesdeUs = 0;
+  uint32_t medidaMuestras = 0;
+  for (;;) {
+    size_t leidos = 0;
+    if (i2s_read(ADC_I2S, dma, sizeof(dma), &leidos, portMAX_DELAY) != ESP_OK) {
+      g_errores++;
+      continue;
+    }
+    // El I2S empaqueta dos muestras de 16 bits por palabra de 32 con la más
+    // reciente en la mitad baja: en memoria llegan por pares intercambiados
+    // (s1 s0 s3 s2 ...). dma[i ^ 1] devuelve el orden temporal.
+    const size_t n = (leidos / sizeof(uint16_t)) & ~(size_t)1;
+
+    // Ritmo real: muestras entregadas entre dos lecturas separadas al menos
+    // ADC_FS_MEDIDA_MS. La latencia de la DMA es fija y se cancela.
+    const int64_t ahoraUs = esp_timer_get_time();
+    if (medidaDesdeUs == 0) {
+      medidaDesdeUs = ahoraUs;
+    } else {
+      medidaMuestras += n;
+      if (ahoraUs - medidaDesdeUs >= (int64_t)ADC_FS_MEDIDA_MS * 1000) {
+        g_fsMedidaHz = (float)((double)medidaMuestras * 1e6 / (double)(ahoraUs - medidaDesdeUs));
+        medidaDesdeUs = ahoraUs;
+        medidaMuestras = 0;
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      g_buf[escritura][pos++] = dma[i ^ 1] & 0x0FFF;   // 4 bits altos: canal
+      if (pos < ADC_VENTANA) continue;
+      const int64_t fin = esp_timer_get_time();
+      portENTER_CRITICAL(&g_mux);
+      g_publicado = escritura;
+      g_finUs = fin;
+      g_seq++;
+      portEXIT_CRITICAL(&g_mux);
+      escritura ^= 1;
+      pos = 0;
+    }
+  }
+}
+
+bool adcContinuoIniciar(int pin) {
+  if (g_tarea) return true;
+  const adc1_channel_t canal = canalDeGpio(pin);
+  if (canal == ADC1_CHANNEL_MAX) {
+    LOGE("ZMPT101B", "MOD_FAIL", "err=pin_no_adc1;pin=%d", pin);
+    return false;
+  }
+
+  i2s_config_t cfg = {};
+  cfg.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  cfg.sample_rate = ADC_FS_HZ;
+  cfg.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  cfg.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  cfg.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  cfg.intr_alloc_flags = 0;
+  cfg.dma_buf_count = ADC_DMA_BUFS;
+  cfg.dma_buf_len = ADC_DMA_LEN;
+  cfg.use_apll = false;
+  if (i2s_driver_install(ADC_I2S, &cfg, 0, nullptr) != ESP_OK) {
+    LOGE("ZMPT101B", "MOD_FAIL", "err=i2s_install");
+    return false;
+  }
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  adc1_config_channel_atten(canal, ADC_ATTEN_DB_11);
+  i2s_set_adc_mode(ADC_UNIT_1, canal);
+  i2s_adc_enable(ADC_I2S);
+
+  BaseType_t ok = xTaskCreatePinnedToCore(tareaAdc, "adc", ADC_STACK, nullptr, ADC_PRIORIDAD, &g_tarea, ADC_CORE);
+  if (ok != pdPASS) {
+    g_tarea = nullptr;
+    LOGE("ZMPT101B", "MOD_FAIL", "err=task_create");
+    return false;
+  }
+  LOGI("ZMPT101B", "MOD_UP", "adc=i2s_dma;fs_hz=%d;ventana=%d;canal=%d", ADC_FS_HZ, ADC_VENTANA, (int)canal);
+  return true;
+}
+
+bool adcContinuoVentana(uint16_t* out, int64_t* fin) {
+  for (int intento = 0; intento < 3; intento++) {
+    portENTER_CRITICAL(&g_mux);
+    const uint32_t seq = g_seq;
+    const uint8_t b = g_publicado;
+    const int64_t f = g_finUs;
+    portEXIT_CRITICAL(&g_mux);
+    if (seq == 0) return false;
+
+    memcpy(out, g_buf[b], sizeof(g_buf[b]));
+
+    // La tarea vuelve a escribir en 'b' en cuanto publica la ventana siguiente
+    portENTER_CRITICAL(&g_mux);
+    const uint32_t ahora = g_seq;
+    portEXIT_CRITICAL(&g_mux);
+    if (ahora == seq) {
+      if (fin) *fin = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+AdcStats adcContinuoStats() {
+  portENTER_CRITICAL(&g_mux);
+  AdcStats s = { g_seq, g_errores, g_fsMedidaHz };
+  portEXIT_CRITICAL(&g_mux);
+  return s;
+}
@@ -0,0 +1,58 @@
+#ifndef ADC_CONTINUO_H
+#define ADC_CONTINUO_H
+
+// Adquisición continua del ADC1 por I2S + DMA (modo ADC integrado del ESP32).
+//
+// El periférico se configura a ADC_FS_HZ; una tarea en ADC_CORE duerme en
+// i2s_read() y va llenando ventanas de ADC_VENTANA muestras en doble buffer.
+// El divisor del reloj I2S no da cualquier frecuencia exacta: la tarea mide
+// el ritmo real (AdcStats::fsMedidaHz) y el análisis usa ese.
+// El loop copia la última ventana completa con adcContinuoVentana() sin
+// esperar: la medición de voltaje ya no ocupa CPU del loop.
+// Un solo canal (el I2S integrado solo lee ADC1).
+
+#include <Arduino.h>
+
+#ifndef ADC_FS_HZ
+#define ADC_FS_HZ 5000          // 100 muestras por ciclo de 50 Hz
+#endif
+#ifndef ADC_VENTANA
+#define ADC_VENTANA 500         // 100 ms = 5 ciclos de 50 Hz
+#endif
+#ifndef ADC_DMA_BUFS
+#define ADC_DMA_BUFS 4
+#endif
+#ifndef ADC_DMA_LEN
+#define ADC_DMA_LEN 250         // muestras por buffer DMA (50 ms)
+#endif
+#ifndef ADC_FS_MEDIDA_MS
+#define ADC_FS_MEDIDA_MS 10000  // periodo de medida del ritmo real
+#endif
+#ifndef ADC_FS_TOL_PCT
+#define ADC_FS_TOL_PCT 1.0f     // desvío frente a ADC_FS_HZ que se avisa (WARN)
+#endif
+#ifndef ADC_CORE
+#define ADC_CORE 0
+#endif
+#ifndef ADC_STACK
+#define ADC_STACK 3072
+#endif
+#ifndef ADC_PRIORIDAD
+#define ADC_PRIORIDAD 2         // por encima de uplink: vaciar la DMA a tiempo
+#endif
+
+// Configura I2S0 en modo ADC sobre el GPIO 'pin' (ADC1: 32-39) y arranca la tarea.
+bool adcContinuoIniciar(int pin);
+
+// Copia en 'out' (ADC_VENTANA muestras de 12 bits) la última ventana completa.
+// En 'fin' el esp_timer de su última muestra. false si aún no hay ninguna.
+bool adcContinuoVentana(uint16_t* out, int64_t* fin = nullptr);
+
+struct AdcStats {
+  uint32_t ventanas;      // ventanas completadas
+  uint32_t errores;       // lecturas I2S fallidas
+  float fsMedidaHz;       // muestras/s medidas en el último ADC_FS_MEDIDA_MS; 0 = aún no
+};
+AdcStats adcContinuoStats();
+
+#endif
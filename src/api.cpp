@@ -2,76 +2,486 @@
 #include "sdlog.h"
 #include "sdbackup.h"
 #include "config.h"
+#include "bufwriter.h"
+#include "formato_muestra.h"
 #include <WiFi.h>
-#include <HTTPClient.h>
+#include <esp_system.h>
+
+#ifndef API_TIMEOUT_MS
+#define API_TIMEOUT_MS 7000
+#endif
+// El servidor suele cerrar conexiones keep-alive ociosas a los 5 s (Apache);
+// por encima de este margen se descarta el socket antes de reutilizarlo.
+#ifndef API_KEEPALIVE_IDLE_MS
+#define API_KEEPALIVE_IDLE_MS 4000
+#endif
+
+// Circuit breaker: fallos consecutivos (sin respuesta o 5xx) para abrir,
+// y backoff exponencial (con jitter ±25%) entre sondas mientras está abierto.
+#ifndef API_BREAKER_UMBRAL
+#define API_BREAKER_UMBRAL 3
+#endif
+#ifndef API_BREAKER_BACKOFF_MIN_MS
+#define API_BREAKER_BACKOFF_MIN_MS 5000
+#endif
+#ifndef API_BREAKER_BACKOFF_MAX_MS
+#define API_BREAKER_BACKOFF_MAX_MS 300000
+#endif
 
 static unsigned long ultimoLogWifi = 0;
+static unsigned long ultimoLogBreaker = 0;
 static unsigned long ultimoLogFallo = 0;
+static unsigned long ultimoLogConn = 0;
 static const unsigned long API_ERR_LOG_EVERY_MS = 30000;
 static bool g_apiUpLogged = false;
 
-static String urlEncode(const String& s) {
-  String out; out.reserve(s.length() * 3);
-  const char *hex = "0123456789ABCDEF";
-  for (size_t i = 0; i < s.length(); i++) {
-    unsigned char c = (unsigned char)s[i];
-    if (('a'<=c && c<='z') || ('A'<=c && c<='Z') || ('0'<=c && c<='9') ||
-        c=='-' || c=='_' || c=='.' || c=='~') {
-      out += (char)c;
+// Cuerpo de una petición, generado mientras se envía: un lote de
+// API_LOTE_MAX muestras no tiene que estar entero en RAM.
+class CuerpoPeticion {
+public:
+  virtual ~CuerpoPeticion() {}
+  virtual size_t longitud() const = 0;               // Content-Length
+  virtual bool escribir(WiFiClient& c) const = 0;    // false si el socket no acepta todo
+};
+
+// ====== Sesión HTTP/1.1 persistente (keep-alive) ======
+// Mantiene un único WiFiClient abierto contra config.api.endpoint. Antes de
+// cada petición descarta el socket si está cerrado o lleva demasiado tiempo
+// ocioso; si una petición sobre un socket reutilizado falla sin recibir ni un
+// byte de respuesta (el servidor lo cerró entre medias), reconecta y reintenta
+// una sola vez.
+class ApiSesion {
+public:
+  // Devuelve el código HTTP, o <0 si no hubo respuesta válida.
+  // El cuerpo se regenera si hay que reintentar sobre un socket nuevo.
+  int peticion(const char* metodo, const char* query,
+               const char* contentType, const CuerpoPeticion* body,
+               char* resp, size_t respLen) {
+    if (!parsearEndpoint()) return -1;
+    st_.peticiones++;
+
+    bool reusado = false;
+    if (!conectar(reusado)) return -2;
+
+    bool algoRecibido = false;
+    int code = intentar(metodo, query, contentType, body, resp, respLen, algoRecibido);
+    if (code < 0 && reusado && !algoRecibido) {
+      // Socket rancio: reconectar de forma transparente y reintentar una vez
+      client_.stop();
+      st_.reconexiones++;
+      if (!conectar(reusado)) return -2;
+      code = intentar(metodo, query, contentType, body, resp, respLen, algoRecibido);
+    }
+    if (code < 0) { client_.stop(); st_.fallos++; }
+    ultimoUsoMs_ = millis();
+    return code;
+  }
+
+  void cerrar() { client_.stop(); }
+  const ApiSesionStats& stats() const { return st_; }
+  const char* host() const { return host_; }
+
+private:
+  WiFiClient client_;
+  ApiSesionStats st_ = {};
+  char host_[64] = {0};
+  char path_[96] = {0};
+  uint16_t port_ = 80;
+  bool parseado_ = false;
+  unsigned long ultimoUsoMs_ = 0;
+
+  // "http://host[:puerto]/ruta" → host_, port_, path_ (una sola vez)
+  bool parsearEndpoint() {
+    if (parseado_) return true;
+    const char* url = config.api.endpoint.c_str();
+    if (strncmp(url, "http://", 7) != 0) {
+      LOGE("API", "MOD_FAIL", "err=endpoint_scheme;need=http");
+      return false;
+    }
+    const char* h = url + 7;
+    const char* slash = strchr(h, '/');
+    size_t hostLen = slash ? (size_t)(slash - h) : strlen(h);
+    if (hostLen == 0 || hostLen >= sizeof(host_)) return false;
+    memcpy(host_, h, hostLen); host_[hostLen] = '\0';
+    char* colon = strchr(host_, ':');
+    if (colon) { *colon = '\0'; port_ = (uint16_t)atoi(colon + 1); }
+    snprintf(path_, sizeof(path_), "%s", slash ? slash : "/");
+    parseado_ = true;
+    return true;
+  }
+
+  bool conectar(bool& reusado) {
+    bool vivo = client_.connected();
+    if (vivo && (millis() - ultimoUsoMs_) < API_KEEPALIVE_IDLE_MS) {
+      st_.reusos++;
+      reusado = true;
+      return true;
+    }
+    if (vivo) client_.stop();   // ocioso demasiado tiempo: no arriesgar
+    reusado = false;
+    st_.handshakes++;
+    if (!client_.connect(host_, port_, API_TIMEOUT_MS)) {
+      unsigned long ahora = millis();
+      if (ahora - ultimoLogConn > API_ERR_LOG_EVERY_MS) {
+        LOGE("API", "API_CONN_ERR", "host=%s;port=%u", host_, (unsigned)port_);
+        ultimoLogConn = ahora;
+      }
+      st_.fallos++;
+      return false;
+    }
+    client_.setNoDelay(true);
+    return true;
+  }
+
+  // Lee una línea terminada en "\r\n" (sin incluirlo). false si vence el plazo.
+  bool leerLinea(char* out, size_t n, unsigned long deadline, bool& algoRecibido) {
+    size_t len = 0;
+    while ((long)(deadline - millis()) > 0) {
+      if (!client_.available()) {
+        if (!client_.connected()) break;
+        delay(1);
+        continue;
+      }
+      int c = client_.read();
+      if (c < 0) continue;
+      algoRecibido = true;
+      if (c == '\n') { if (len && out[len - 1] == '\r') len--; out[len] = '\0'; return true; }
+      if (len + 1 < n) out[len++] = (char)c;
+    }
+    out[len] = '\0';
+    return false;
+  }
+
+  // Lee exactamente 'cuantos' bytes; guarda los que quepan en resp.
+  bool leerCuerpo(size_t cuantos, char* resp, size_t respLen, size_t& respUsado, unsigned long deadline) {
+    while (cuantos > 0 && (long)(deadline - millis()) > 0) {
+      if (!client_.available()) {
+        if (!client_.connected()) return false;
+        delay(1);
+        continue;
+      }
+      int c = client_.read();
+      if (c < 0) continue;
+      if (respUsado + 1 < respLen) resp[respUsado++] = (char)c;
+      cuantos--;
+    }
+    resp[respUsado] = '\0';
+    return cuantos == 0;
+  }
+
+  int intentar(const char* metodo, const char* query,
+               const char* contentType, const CuerpoPeticion* body,
+               char* resp, size_t respLen, bool& algoRecibido) {
+    algoRecibido = false;
+    resp[0] = '\0';
+
+    char hdr[384];
+    int hl;
+    if (body) {
+      hl = snprintf(hdr, sizeof(hdr),
+                    "%s %s%s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n"
+                    "Content-Type: %s\r\nContent-Length: %u\r\n\r\n",
+                    metodo, path_, query, host_, contentType, (unsigned)body->longitud());
     } else {
-      out += '%';
-      out += hex[(c >> 4) & 0xF];
-      out += hex[c & 0xF];
+      hl = snprintf(hdr, sizeof(hdr),
+                    "%s %s%s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                    metodo, path_, query, host_);
     }
+    if (hl <= 0 || hl >= (int)sizeof(hdr)) return -3;
+    if (client_.write((const uint8_t*)hdr, (size_t)hl) != (size_t)hl) return -4;
+    if (body && !body->escribir(client_)) return -4;
+
+    const unsigned long deadline = millis() + API_TIMEOUT_MS;
+    char linea[128];
+
+    // Línea de estado: "HTTP/1.1 200 OK"
+    if (!leerLinea(linea, sizeof(linea), deadline, algoRecibido)) return -5;
+    const char* sp = strchr(linea, ' ');
+    if (strncmp(linea, "HTTP/1.", 7) != 0 || !sp) return -6;
+    int code = atoi(sp + 1);
+
+    // Cabeceras
+    long contentLength = -1;
+    bool chunked = false;
+    bool cerrar = false;
+    while (true) {
+      if (!leerLinea(linea, sizeof(linea), deadline, algoRecibido)) return -5;
+      if (linea[0] == '\0') break;
+      if (strncasecmp(linea, "Content-Length:", 15) == 0) contentLength = atol(linea + 15);
+      else if (strncasecmp(linea, "Transfer-Encoding:", 18) == 0 && strstr(linea, "chunked")) chunked = true;
+      else if (strncasecmp(linea, "Connection:", 11) == 0 && strstr(linea, "close")) cerrar = true;
+    }
+
+    // Cuerpo
+    size_t usado = 0;
+    bool ok = true;
+    if (chunked) {
+      while (true) {
+        if (!leerLinea(linea, sizeof(linea), deadline, algoRecibido)) { ok = false; break; }
+        size_t tam = (size_t)strtoul(linea, nullptr, 16);
+        if (tam == 0) { leerLinea(linea, sizeof(linea), deadline, algoRecibido); break; }
+        if (!leerCuerpo(tam, resp, respLen, usado, deadline)) { ok = false; break; }
+        if (!leerLinea(linea, sizeof(linea), deadline, algoRecibido)) { ok = false; break; }
+      }
+    } else if (contentLength >= 0) {
+      ok = leerCuerpo((size_t)contentLength, resp, respLen, usado, deadline);
+    } else {
+      // Sin longitud: el cuerpo termina al cerrar la conexión
+      leerCuerpo(SIZE_MAX, resp, respLen, usado, deadline);
+      cerrar = true;
+    }
+    if (!ok || cerrar) client_.stop();
+    return code;
   }
-  return out;
+};
+
+static ApiSesion g_sesion;
+
+// La sesión se comparte entre la tarea uplink (envío en vivo) y el loop (reenvío)
+static SemaphoreHandle_t sesionMutex() {
+  static SemaphoreHandle_t m = xSemaphoreCreateMutex();
+  return m;
 }
+struct SesionLock {
+  SesionLock()  { xSemaphoreTake(sesionMutex(), portMAX_DELAY); }
+  ~SesionLock() { xSemaphoreGive(sesionMutex()); }
+};
+
+ApiSesionStats apiSesionStats() { SesionLock l; return g_sesion.stats(); }
+void apiSesionCerrar() { SesionLock l; g_sesion.cerrar(); }
+
+// ====== Circuit breaker del endpoint ======
+// CERRADO     → peticiones normales; API_BREAKER_UMBRAL fallos seguidos lo abren.
+// ABIERTO     → se falla al instante (sin esperar el timeout de 7 s) hasta que
+//               vence el backoff; entonces pasa a SEMIABIERTO.
+// SEMIABIERTO → una única petición de sonda; éxito cierra, fallo reabre con
+//               el backoff duplicado (hasta API_BREAKER_BACKOFF_MAX_MS).
+// El estado se protege con un spinlock (no con SesionLock) para que
+// apiDisponible() nunca espere a una petición en curso.
+class ApiBreaker {
+public:
+  enum Transicion : uint8_t { SIN_CAMBIO, ABRE, CIERRA };
 
-bool enviarDatoAPI(const String& measurement, const String& sensor, float valor, unsigned long long timestamp, const String& source) {
-  if (WiFi.status() != WL_CONNECTED) {
-    unsigned long ahora = millis();
-    if (ahora - ultimoLogWifi > 10000) {
-      logEventoM("API", "API_SKIP", "wifi=0");
-      ultimoLogWifi = ahora;
+  bool disponible() {
+    portENTER_CRITICAL(&mux_);
+    bool r;
+    switch (estado_) {
+      case ApiBreakerEstado::CERRADO:     r = true; break;
+      case ApiBreakerEstado::ABIERTO:     r = (long)(millis() - reintentoMs_) >= 0; break;
+      default:                            r = !sondaEnCurso_; break;
     }
-    return false;
+    portEXIT_CRITICAL(&mux_);
+    return r;
+  }
+
+  // Reserva permiso para una petición. false = fallar rápido.
+  bool permitir() {
+    portENTER_CRITICAL(&mux_);
+    bool r = false;
+    if (estado_ == ApiBreakerEstado::CERRADO) {
+      r = true;
+    } else if (estado_ == ApiBreakerEstado::ABIERTO) {
+      if ((long)(millis() - reintentoMs_) >= 0) {
+        estado_ = ApiBreakerEstado::SEMIABIERTO;
+        sondaEnCurso_ = true;
+        r = true;
+      }
+    } else if (!sondaEnCurso_) {
+      sondaEnCurso_ = true;
+      r = true;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return r;
+  }
+
+  Transicion registrar(bool fallaEndpoint) {
+    const uint32_t jit = esp_random();
+    portENTER_CRITICAL(&mux_);
+    Transicion t = SIN_CAMBIO;
+    if (!fallaEndpoint) {
+      if (estado_ != ApiBreakerEstado::CERRADO) t = CIERRA;
+      estado_ = ApiBreakerEstado::CERRADO;
+      fallos_ = 0;
+      backoffMs_ = API_BREAKER_BACKOFF_MIN_MS;
+    } else {
+      fallos_++;
+      bool abrir = (estado_ == ApiBreakerEstado::SEMIABIERTO) ||
+                   (estado_ == ApiBreakerEstado::CERRADO && fallos_ >= API_BREAKER_UMBRAL);
+      if (abrir) {
+        if (estado_ == ApiBreakerEstado::SEMIABIERTO) {
+          backoffMs_ = (backoffMs_ >= API_BREAKER_BACKOFF_MAX_MS / 2) ? API_BREAKER_BACKOFF_MAX_MS : backoffMs_ * 2;
+        }
+        const uint32_t j = backoffMs_ / 4;
+        esperaMs_ = backoffMs_ - j + (jit % (2 * j + 1));
+        reintentoMs_ = millis() + esperaMs_;
+        estado_ = ApiBreakerEstado::ABIERTO;
+        t = ABRE;
+      }
+    }
+    sondaEnCurso_ = false;
+    portEXIT_CRITICAL(&mux_);
+    return t;
   }
 
-  WiFiClient client;
-  HTTPClient http;
-  String mac = WiFi.macAddress(); mac.replace(":", "");
+  ApiBreakerEstado estado() const { return estado_; }
+  uint32_t esperaMs() const { return esperaMs_; }
+  uint16_t fallos() const { return fallos_; }
 
-  String url = config.api.endpoint +
-               "?api_key="    + urlEncode(config.api.key) +
-               "&measurement="+ urlEncode(measurement) +
-               "&sensor="     + urlEncode(sensor) +
-               "&valor="      + urlEncode(String(valor, 2)) +
-               "&ts="         + urlEncode(String(timestamp)) +
-               "&mac="        + urlEncode(mac) +
-               "&source="     + urlEncode(source);
+private:
+  portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+  volatile ApiBreakerEstado estado_ = ApiBreakerEstado::CERRADO;
+  bool sondaEnCurso_ = false;
+  uint16_t fallos_ = 0;
+  uint32_t backoffMs_ = API_BREAKER_BACKOFF_MIN_MS;
+  uint32_t esperaMs_ = 0;
+  unsigned long reintentoMs_ = 0;
+};
 
-  http.setReuse(false);
-  http.setTimeout(7000);
-  http.begin(client, url);
-  http.addHeader("Connection", "close");
+static ApiBreaker g_breaker;
 
-  int httpCode = http.GET();
-  String payload = http.getString();
-  http.end();
+ApiBreakerEstado apiBreakerEstado() { return g_breaker.estado(); }
+bool apiDisponible() { return g_breaker.disponible(); }
+
+static bool breakerPermite(const char* kvSkip) {
+  if (g_breaker.permitir()) return true;
+  unsigned long ahora = millis();
+  if (ahora - ultimoLogBreaker > API_ERR_LOG_EVERY_MS) {
+    LOGI("API", "API_SKIP", "%s", kvSkip);
+    ultimoLogBreaker = ahora;
+  }
+  return false;
+}
+
+static void breakerRegistrar(int httpCode) {
+  const bool falla = (httpCode < 0 || httpCode >= 500);
+  ApiBreaker::Transicion t = g_breaker.registrar(falla);
+  if (t == ApiBreaker::ABRE) {
+    LOGW("API", "API_BREAKER_WARN", "estado=abierto;fallos=%u;espera_ms=%lu",
+         (unsigned)g_breaker.fallos(), (unsigned long)g_breaker.esperaMs());
+  } else if (t == ApiBreaker::CIERRA) {
+    LOGI("API", "API_BREAKER", "estado=cerrado");
+  }
+}
 
-  if (httpCode == 200 && payload.indexOf("OK") >= 0) {
+static bool respuestaOK(int httpCode, const char* payload) {
+  if (httpCode == 200 && strstr(payload, "OK")) {
     if (!g_apiUpLogged) {
-      logEventoM("API", "MOD_UP", ("endpoint=" + config.api.endpoint).c_str());
+      LOGI("API", "MOD_UP", "endpoint=%s", config.api.endpoint.c_str());
       g_apiUpLogged = true;
     }
     return true;
   }
+  return false;
+}
+
+// MAC sin ':' calculada una sola vez (sin String)
+const char* apiMacHex() {
+  static char mac[13] = {0};
+  if (!mac[0]) {
+    uint8_t m[6];
+    WiFi.macAddress(m);
+    snprintf(mac, sizeof(mac), "%02X%02X%02X%02X%02X%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+  }
+  return mac;
+}
 
+static bool wifiConectadoParaAPI(const char* kvSkip) {
+  if (WiFi.status() == WL_CONNECTED) return true;
+  unsigned long ahora = millis();
+  if (ahora - ultimoLogWifi > 10000) {
+    LOGI("API", "API_SKIP", "%s", kvSkip);
+    ultimoLogWifi = ahora;
+  }
+  apiSesionCerrar();
+  return false;
+}
+
+static void logFalloAPI(int httpCode, size_t n, const char* payload) {
   unsigned long ahora = millis();
   if (ahora - ultimoLogFallo > API_ERR_LOG_EVERY_MS) {
-    String kv = String("http=") + String(httpCode) + ";resp=" + payload;
-    logEventoM("API", "API_5XX", kv);
+    if (n) LOGI("API", "API_5XX", "http=%d;lote=%u;resp=%.100s", httpCode, (unsigned)n, payload);
+    else   LOGI("API", "API_5XX", "http=%d;resp=%.100s", httpCode, payload);
     ultimoLogFallo = ahora;
   }
+}
+
+bool enviarDatoAPI(const char* measurement, const char* sensor, float valor, unsigned long long timestamp, const char* source, uint32_t seq) {
+  if (!wifiConectadoParaAPI("wifi=0")) return false;
+
+  FixedBuf<256> query;
+  if (!formatoQueryGet(query, config.api.key.c_str(), measurement, sensor, valor, timestamp, apiMacHex(), source, seq)) {
+    return false;
+  }
+  if (!breakerPermite("breaker=abierto")) return false;
+
+  char payload[128];
+  int httpCode;
+  {
+    SesionLock l;
+    httpCode = g_sesion.peticion("GET", query.c_str(), nullptr, nullptr, payload, sizeof(payload));
+  }
+  breakerRegistrar(httpCode);
+  if (respuestaOK(httpCode, payload)) return true;
+  logFalloAPI(httpCode, 0, payload);
   return false;
-}
\ No newline at end of file
+}
+
+// ====== Lote: POST con InfluxDB line protocol ======
+// Una línea por muestra (formatoLineaLP, formato_muestra.h)
+bool construirLoteLP(BufWriter& body, const Sample* muestras, size_t n) {
+  const char* mac = apiMacHex();
+  for (size_t i = 0; i < n; i++) formatoLineaLP(body, muestras[i], mac);
+  return !body.overflow();
+}
+
+// Tramo del cuerpo en curso: estático (un solo envío a la vez, protegido por SesionLock)
+static char g_tramoBuf[API_TRAMO_LEN];
+
+// Lote en line protocol: se mide con una pasada (Content-Length) y se vuelve
+// a formatear al enviarlo, tramo a tramo, en lugar de guardar el cuerpo entero.
+class CuerpoLoteLP : public CuerpoPeticion {
+public:
+  CuerpoLoteLP(const Sample* m, size_t n) : m_(m), n_(n) {}
+
+  // false si alguna línea no cabe en API_LINEA_MAX
+  bool medir() { return formatoLoteLPLongitud(m_, n_, apiMacHex(), len_); }
+
+  size_t longitud() const override { return len_; }
+
+  bool escribir(WiFiClient& c) const override {
+    const size_t total = formatoLoteLPPorTramos(m_, n_, apiMacHex(), g_tramoBuf, sizeof(g_tramoBuf),
+        [&c](const char* p, size_t len) { return c.write((const uint8_t*)p, len) == len; });
+    return total == len_;
+  }
+
+private:
+  const Sample* m_;
+  size_t n_;
+  size_t len_ = 0;
+};
+
+size_t enviarLoteAPI(const Sample* muestras, size_t n) {
+  if (!muestras || n == 0) return 0;
+  if (n > API_LOTE_MAX) n = API_LOTE_MAX;   // el resto, en la siguiente llamada
+  if (!wifiConectadoParaAPI("wifi=0;lote=1")) return 0;
+
+  FixedBuf<128> query;
+  query.append("?api_key=").appendUrlEncoded(config.api.key.c_str()).append("&format=lp&precision=us");
+  if (query.overflow()) return 0;
+
+  char payload[128];
+  int httpCode;
+  {
+    SesionLock l;
+    CuerpoLoteLP body(muestras, n);
+    if (!body.medir()) return 0;
+    if (body.longitud() == 0) return n;  // nada enviable (series desconocidas): se dan por atendidas
+    if (!breakerPermite("breaker=abierto;lote=1")) return 0;
+    httpCode = g_sesion.peticion("POST", query.c_str(), "text/plain; charset=utf-8",
+                                 &body, payload, sizeof(payload));
+  }
+  breakerRegistrar(httpCode);
+  if (respuestaOK(httpCode, payload)) return n;
+  logFalloAPI(httpCode, n, payload);
+  return 0;
+}
@@ -2,7 +2,45 @@
 #define API_H
 
 #include <Arduino.h>
+#include "sample.h"
+#include "formato_muestra.h"   // API_LOTE_MAX, API_TRAMO_LEN
 
-bool enviarDatoAPI(const String& measurement, const String& sensor, float valor, unsigned long long timestamp, const String& source);
+// Contadores de la sesión HTTP persistente (keep-alive) hacia config.api.endpoint
+struct ApiSesionStats {
+  uint32_t peticiones;    // peticiones HTTP intentadas
+  uint32_t reusos;        // peticiones servidas sobre una conexión ya abierta
+  uint32_t handshakes;    // conexiones TCP nuevas (DNS + handshake)
+  uint32_t reconexiones;  // sockets rancios detectados y reabiertos en caliente
+  uint32_t fallos;        // peticiones sin respuesta válida
+};
+
+ApiSesionStats apiSesionStats();
+void apiSesionCerrar();   // cierra el socket (p.ej. antes de operar la SD en frío)
+
+// Estado del circuit breaker del endpoint
+enum class ApiBreakerEstado : uint8_t { CERRADO, ABIERTO, SEMIABIERTO };
+
+ApiBreakerEstado apiBreakerEstado();
+
+// true si merece la pena intentar enviar ahora (breaker cerrado o sonda
+// pendiente). Nunca bloquea: con false, respaldar directamente en SD.
+bool apiDisponible();
+
+bool enviarDatoAPI(const char* measurement, const char* sensor, float valor, unsigned long long timestamp, const char* source, uint32_t seq = 0);
+
+class BufWriter;
+
+// Escribe n muestras como InfluxDB line protocol (una línea por muestra).
+// false si no caben en 'body'. Compartido por los transportes HTTP y MQTT.
+bool construirLoteLP(BufWriter& body, const Sample* muestras, size_t n);
+
+// MAC del equipo en hexadecimal sin ':' (tag "mac")
+const char* apiMacHex();
+
+// Envía las primeras min(n, API_LOTE_MAX) muestras en un único POST con cuerpo
+// InfluxDB line protocol (precisión µs). Devuelve cuántas confirmó el servidor:
+// todas las enviadas o 0 (el lote se confirma entero o nada). Si devuelve
+// menos de n, el llamador reintenta o respalda el resto.
+size_t enviarLoteAPI(const Sample* muestras, size_t n);
 
 #endif
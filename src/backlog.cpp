@@ -0,0 +1,370 @@
+// backlog.cpp - manifiesto de backups pendientes con espejo en RAM
+// Sustituye al escaneo de la raíz de la SD y a los .idx por archivo: el
+// escritor y el reenvío actualizan la entrada del archivo que tocan.
+
+#include "backlog.h"
+#include "sdlog.h"
+#include "bufwriter.h"
+#include "backup_record.h"
+#include <SD.h>
+#include <stdlib.h>
+
+#define BACKLOG_DIR       "/backup"
+#define BACKLOG_MANIFEST  "/backup/manifest.csv"
+#define BACKLOG_TMP       "/backup/manifest.tmp"
+#define BACKLOG_CUARENTENA "/backup/cuarentena"
+
+// Los cambios de tamaño se persisten con retardo (al arrancar se releen de
+// la SD); altas, bajas y avances de offset se persisten en el momento.
+#ifndef BACKLOG_PERSIST_MS
+#define BACKLOG_PERSIST_MS 30000
+#endif
+
+static BacklogEntrada g_ent[BACKLOG_MAX_ARCHIVOS];
+static size_t g_n = 0;
+static bool g_dirty = false;
+static unsigned long g_ultimoPersistMs = 0;
+// Algún archivo quedó fuera por tabla llena: se vuelve a recorrer /backup/
+// cuando el reenvío libere entradas (backlogTick)
+static bool g_reescanear = false;
+
+static const char* baseDe(const char* path) {
+  const char* s = strrchr(path, '/');
+  return s ? s + 1 : path;
+}
+
+// backup_YYYYMMDD.csv|.bin o backup_unsync.csv|.bin
+static bool parseNombreBackup(const char* base, uint32_t& fecha, bool& bin) {
+  if (strncmp(base, "backup_", 7) != 0) return false;
+  const char* p = base + 7;
+  const char* ext = strrchr(p, '.');
+  if (!ext) return false;
+  if (strcmp(ext, ".csv") == 0) bin = false;
+  else if (strcmp(ext, ".bin") == 0) bin = true;
+  else return false;
+
+  if (ext - p == 6 && strncmp(p, "unsync", 6) == 0) { fecha = 0; return true; }
+  if (ext - p != 8) return false;
+  uint32_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    if (p[i] < '0' || p[i] > '9') return false;
+    v = v * 10 + (uint32_t)(p[i] - '0');
+  }
+  if (v / 10000 == 1970) return false;   // RTC sin hora: se conserva en la raíz para análisis
+  fecha = v;
+  return true;
+}
+
+void backlogRutaArchivo(uint32_t fecha, bool binario, char* out, size_t n, bool crearDirs) {
+  const char* ext = binario ? "bin" : "csv";
+  if (fecha == 0) {
+    if (crearDirs) SD.mkdir(BACKLOG_DIR);
+    snprintf(out, n, BACKLOG_DIR "/backup_unsync.%s", ext);
+    return;
+  }
+  unsigned long anio = fecha / 10000, mes = (fecha / 100) % 100;
+  if (crearDirs) {
+    char dir[24];
+    SD.mkdir(BACKLOG_DIR);
+    snprintf(dir, sizeof(dir), BACKLOG_DIR "/%04lu", anio);
+    SD.mkdir(dir);
+    snprintf(dir, sizeof(dir), BACKLOG_DIR "/%04lu/%02lu", anio, mes);
+    SD.mkdir(dir);
+  }
+  snprintf(out, n, BACKLOG_DIR "/%04lu/%02lu/backup_%08lu.%s", anio, mes, (unsigned long)fecha, ext);
+}
+
+static int buscar(uint32_t fecha, bool binario) {
+  for (size_t i = 0; i < g_n; i++) {
+    if (g_ent[i].fecha == fecha && g_ent[i].binario == binario) return (int)i;
+  }
+  return -1;
+}
+
+static int alta(uint32_t fecha, bool binario, uint32_t size, uint32_t offset) {
+  int i = buscar(fecha, binario);
+  if (i >= 0) return i;
+  if (g_n >= BACKLOG_MAX_ARCHIVOS) {
+    static unsigned long ultimoLogMs = 0;
+    g_reescanear = true;
+    if (ultimoLogMs == 0 || millis() - ultimoLogMs > 60000) {
+      LOGW("BACKLOG", "BACKLOG_FULL", "max=%u;fecha=%lu", (unsigned)BACKLOG_MAX_ARCHIVOS, (unsigned long)fecha);
+      ultimoLogMs = millis();
+    }
+    return -1;
+  }
+  g_ent[g_n] = BacklogEntrada{ fecha, size, offset, binario };
+  return (int)g_n++;
+}
+
+// ====== Persistencia ======
+static bool guardarManifiesto() {
+  SD.mkdir(BACKLOG_DIR);
+  if (SD.exists(BACKLOG_TMP)) SD.remove(BACKLOG_TMP);
+  File f = SD.open(BACKLOG_TMP, FILE_WRITE);
+  if (!f) {
+    LOGE("BACKLOG", "SD_ERR", "op=write;path=" BACKLOG_TMP);
+    return false;
+  }
+  f.print("# fecha,fmt,size,offset\n");
+  FixedBuf<48> linea;
+  for (size_t i = 0; i < g_n; i++) {
+    linea.clear();
+    linea.appendU64(g_ent[i].fecha).append(',').append(g_ent[i].binario ? "bin" : "csv").append(',')
+         .appendU64(g_ent[i].size).append(',').appendU64(g_ent[i].offset).append('\n');
+    f.write((const uint8_t*)linea.c_str(), linea.length());
+  }
+  f.flush();
+  f.close();
+  if (SD.exists(BACKLOG_MANIFEST)) SD.remove(BACKLOG_MANIFEST);
+  if (!SD.rename(BACKLOG_TMP, BACKLOG_MANIFEST)) {
+    LOGE("BACKLOG", "SD_ERR", "op=rename;path=" BACKLOG_MANIFEST);
+    return false;
+  }
+  g_dirty = false;
+  g_ultimoPersistMs = millis();
+  return true;
+}
+
+static bool cargarManifiesto(const char* path) {
+  File f = SD.open(path, FILE_READ);
+  if (!f) return false;
+  g_n = 0;
+  char linea[64];
+  while (f.available()) {
+    size_t len = f.readBytesUntil('\n', linea, sizeof(linea) - 1);
+    linea[len] = '\0';
+    if (len == 0 || linea[0] == '#') continue;
+
+    char* p = linea;
+    uint32_t fecha = (uint32_t)strtoul(p, &p, 10);
+    if (*p++ != ',') continue;
+    bool bin = strncmp(p, "bin", 3) == 0;
+    if (!bin && strncmp(p, "csv", 3) != 0) continue;
+    p += 3;
+    if (*p++ != ',') continue;
+    uint32_t size = (uint32_t)strtoul(p, &p, 10);
+    if (*p++ != ',') continue;
+    uint32_t offset = (uint32_t)strtoul(p, &p, 10);
+    alta(fecha, bin, size, offset);
+  }
+  f.close();
+  return true;
+}
+
+// Relee el tamaño real de cada archivo y descarta los que ya no existen
+static void reconciliar() {
+  char ruta[48];
+  size_t j = 0;
+  for (size_t i = 0; i < g_n; i++) {
+    backlogRutaArchivo(g_ent[i].fecha, g_ent[i].binario, ruta, sizeof(ruta));
+    File f = SD.open(ruta, FILE_READ);
+    if (!f) {
+      LOGI("BACKLOG", "BACKLOG_MISSING", "path=%s", ruta);
+      g_dirty = true;
+      continue;
+    }
+    if (g_ent[i].size != (uint32_t)f.size()) { g_ent[i].size = (uint32_t)f.size(); g_dirty = true; }
+    f.close();
+    g_ent[j++] = g_ent[i];
+  }
+  g_n = j;
+}
+
+// ====== Reconstrucción / migración ======
+static uint32_t leerIdxLegado(const char* idxPath) {
+  File f = SD.open(idxPath, FILE_READ);
+  if (!f) return 0;
+  char s[16];
+  size_t len = f.readBytesUntil('\n', s, sizeof(s) - 1);
+  s[len] = '\0';
+  f.close();
+  return (uint32_t)strtoul(s, nullptr, 10);
+}
+
+// backup_*.csv|.bin de la raíz (+ su .idx) → /backup/YYYY/MM/
+static uint16_t migrarRaiz() {
+  static BacklogEntrada encontrados[BACKLOG_MAX_ARCHIVOS];
+  size_t n = 0;
+  File root = SD.open("/");
+  if (!root) return 0;
+  while (n < BACKLOG_MAX_ARCHIVOS) {
+    File e = root.openNextFile();
+    if (!e) break;
+    bool dir = e.isDirectory();
+    uint32_t fecha; bool bin;
+    if (!dir && parseNombreBackup(baseDe(e.name()), fecha, bin)) {
+      encontrados[n++] = BacklogEntrada{ fecha, (uint32_t)e.size(), 0, bin };
+    }
+    e.close();
+  }
+  root.close();
+
+  uint16_t migrados = 0;
+  for (size_t i = 0; i < n; i++) {
+    char viejo[40], idx[48], nuevo[48];
+    if (encontrados[i].fecha) snprintf(viejo, sizeof(viejo), "/backup_%08lu.%s", (unsigned long)encontrados[i].fecha, encontrados[i].binario ? "bin" : "csv");
+    else                      snprintf(viejo, sizeof(viejo), "/backup_unsync.%s", encontrados[i].binario ? "bin" : "csv");
+    snprintf(idx, sizeof(idx), "%s.idx", viejo);
+    backlogRutaArchivo(encontrados[i].fecha, encontrados[i].binario, nuevo, sizeof(nuevo), true);
+
+    if (SD.exists(nuevo) || !SD.rename(viejo, nuevo)) {
+      LOGW("BACKLOG", "BACKLOG_WARN", "op=migrate;path=%s", viejo);
+      continue;
+    }
+    uint32_t offset = SD.exists(idx) ? leerIdxLegado(idx) : 0;
+    if (SD.exists(idx)) SD.remove(idx);
+    if (alta(encontrados[i].fecha, encontrados[i].binario, encontrados[i].size, offset) >= 0) migrados++;
+  }
+  return migrados;
+}
+
+static void recorrerDir(const char* dir, uint8_t nivel, uint16_t& n) {
+  File d = SD.open(dir);
+  if (!d) return;
+  while (true) {
+    File e = d.openNextFile();
+    if (!e) break;
+    const char* base = baseDe(e.name());
+    if (e.isDirectory()) {
+      // /backup/YYYY → /backup/YYYY/MM (la cuarentena no vuelve al manifiesto)
+      if (nivel < 2 && strcmp(base, "cuarentena") != 0) {
+        char sub[24];
+        snprintf(sub, sizeof(sub), "%s/%s", dir, base);
+        e.close();
+        recorrerDir(sub, nivel + 1, n);
+        continue;
+      }
+    } else {
+      uint32_t fecha; bool bin;
+      if (parseNombreBackup(base, fecha, bin) && buscar(fecha, bin) < 0) {
+        // Sin manifiesto no se conoce el offset: se reenvía desde el principio
+        if (alta(fecha, bin, (uint32_t)e.size(), 0) >= 0) n++;
+      }
+    }
+    e.close();
+  }
+  d.close();
+}
+
+// Más antiguo primero (unsync = 0 va delante)
+static void ordenar() {
+  for (size_t i = 1; i < g_n; i++) {
+    BacklogEntrada e = g_ent[i];
+    size_t j = i;
+    while (j > 0 && g_ent[j - 1].fecha > e.fecha) { g_ent[j] = g_ent[j - 1]; j--; }
+    g_ent[j] = e;
+  }
+}
+
+static void reconstruir() {
+  g_n = 0;
+  uint16_t migrados = migrarRaiz();
+  uint16_t encontrados = 0;
+  recorrerDir(BACKLOG_DIR, 0, encontrados);
+  ordenar();
+  guardarManifiesto();
+
+  LOGI("BACKLOG", "BACKLOG_REBUILD", "migrados=%u;encontrados=%u;archivos=%u",
+       (unsigned)migrados, (unsigned)encontrados, (unsigned)g_n);
+}
+
+// ====== API ======
+void backlogIniciar() {
+  // Un corte entre remove y rename deja solo el .tmp, que está completo
+  if (cargarManifiesto(BACKLOG_MANIFEST) || cargarManifiesto(BACKLOG_TMP)) {
+    reconciliar();
+    if (g_dirty) guardarManifiesto();
+  } else {
+    reconstruir();
+  }
+  g_ultimoPersistMs = millis();
+
+  LOGI("BACKLOG", "MOD_UP", "archivos=%u;pendientes=%d", (unsigned)g_n, backlogHayPendientes() ? 1 : 0);
+}
+
+void backlogTick() {
+  // Los que no cupieron siguen en /backup/YYYY/MM: se dan de alta (offset 0)
+  // en cuanto hay hueco. Si vuelve a llenarse, alta() rearma la marca.
+  if (g_reescanear && g_n < BACKLOG_MAX_ARCHIVOS) {
+    g_reescanear = false;
+    uint16_t encontrados = 0;
+    recorrerDir(BACKLOG_DIR, 0, encontrados);
+    if (encontrados) {
+      ordenar();
+      guardarManifiesto();
+    }
+    LOGI("BACKLOG", "BACKLOG_RESCAN", "encontrados=%u;archivos=%u;lleno=%d",
+         (unsigned)encontrados, (unsigned)g_n, g_reescanear ? 1 : 0);
+  }
+  if (g_dirty && millis() - g_ultimoPersistMs >= BACKLOG_PERSIST_MS) guardarManifiesto();
+}
+
+void backlogRegistrarEscritura(uint32_t fecha, bool binario, uint32_t size) {
+  int i = buscar(fecha, binario);
+  if (i < 0) {
+    if (alta(fecha, binario, size, 0) >= 0) guardarManifiesto();
+    return;
+  }
+  if (g_ent[i].size != size) { g_ent[i].size = size; g_dirty = true; }
+}
+
+bool backlogAvanzar(uint32_t fecha, bool binario, uint32_t offset) {
+  int i = buscar(fecha, binario);
+  if (i < 0) return false;
+  g_ent[i].offset = offset;
+  return guardarManifiesto();
+}
+
+void backlogQuitar(uint32_t fecha, bool binario) {
+  int i = buscar(fecha, binario);
+  if (i < 0) return;
+  for (size_t j = (size_t)i; j + 1 < g_n; j++) g_ent[j] = g_ent[j + 1];
+  g_n--;
+  guardarManifiesto();
+}
+
+bool backlogCuarentena(uint32_t fecha, bool binario) {
+  if (buscar(fecha, binario) < 0) return false;
+  char ruta[48], dest[64];
+  backlogRutaArchivo(fecha, binario, ruta, sizeof(ruta));
+  SD.mkdir(BACKLOG_CUARENTENA);
+  snprintf(dest, sizeof(dest), BACKLOG_CUARENTENA "/%s", baseDe(ruta));
+  if (SD.exists(dest)) SD.remove(dest);
+  const bool movido = SD.exists(ruta) && SD.rename(ruta, dest);
+  LOGW("BACKLOG", "BACKLOG_WARN", "op=cuarentena;path=%s;movido=%d", ruta, movido ? 1 : 0);
+  backlogQuitar(fecha, binario);   // aunque no se pudiera mover: deja de estar pendiente
+  return true;
+}
+
+bool backlogHayPendientes() {
+  for (size_t i = 0; i < g_n; i++) {
+    const BacklogEntrada& e = g_ent[i];
+    if (e.offset == 0) {
+      if (e.size > 0) return true;    // sin inicializar: el reenvío decide
+      continue;
+    }
+    if (e.offset >= e.size) continue;
+    // Registro final incompleto. El manifiesto no guarda la versión del .bin:
+    // con el mínimo (v1) una cola v2 de 16..19 B cuenta como pendiente y el
+    // reenvío, que sí lee la cabecera, la descarta.
+    if (e.binario && e.size - e.offset < BKP_REC_LEN_MIN) continue;
+    return true;
+  }
+  return false;
+}
+
+bool backlogObtener(uint32_t fecha, bool binario, BacklogEntrada& out) {
+  int i = buscar(fecha, binario);
+  if (i < 0) return false;
+  out = g_ent[i];
+  return true;
+}
+
+size_t backlogNumArchivos() { return g_n; }
+
+bool backlogEntrada(size_t i, BacklogEntrada& out) {
+  if (i >= g_n) return false;
+  out = g_ent[i];
+  return true;
+}
@@ -0,0 +1,60 @@
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+// Manifiesto de backups pendientes (/backup/manifest.csv + espejo en RAM).
+// Una entrada por archivo de respaldo con su tamaño y el offset de reenvío;
+// lo actualizan el escritor (sdbackup) y el reenvío (reenviarBackupSD), así
+// que saber si hay pendientes no toca la SD.
+//
+// Los archivos viven en particiones por fecha:
+//   /backup/YYYY/MM/backup_YYYYMMDD.csv|.bin
+//   /backup/backup_unsync.csv|.bin          (RTC no fiable, fecha = 0)
+
+#include <Arduino.h>
+
+#ifndef BACKLOG_MAX_ARCHIVOS
+#define BACKLOG_MAX_ARCHIVOS 128
+#endif
+
+struct BacklogEntrada {
+  uint32_t fecha;     // YYYYMMDD (UTC); 0 = unsync
+  uint32_t size;      // bytes escritos (commit del escritor)
+  uint32_t offset;    // siguiente byte por reenviar; 0 = aún sin inicializar
+  bool binario;
+};
+
+// Carga el manifiesto; si no existe lo reconstruye (migra backups antiguos
+// de la raíz con su .idx y recorre /backup/). Llamar tras inicializar la SD.
+void backlogIniciar();
+
+// Guarda el manifiesto si hay cambios de tamaño pendientes de persistir
+void backlogTick();
+
+// Ruta del archivo de respaldo de 'fecha' (crea las carpetas si 'crearDirs')
+void backlogRutaArchivo(uint32_t fecha, bool binario, char* out, size_t n, bool crearDirs = false);
+
+// El escritor informa del tamaño tras cada commit (alta si no existía)
+void backlogRegistrarEscritura(uint32_t fecha, bool binario, uint32_t size);
+
+// El reenvío avanza el offset confirmado (se persiste de inmediato)
+bool backlogAvanzar(uint32_t fecha, bool binario, uint32_t offset);
+
+// Baja del archivo (consumido y archivado)
+void backlogQuitar(uint32_t fecha, bool binario);
+
+// Aparta un archivo ilegible (cabecera no válida, no se puede abrir) a
+// /backup/cuarentena/ y lo da de baja: deja de contar como pendiente.
+// false si no estaba en el manifiesto.
+bool backlogCuarentena(uint32_t fecha, bool binario);
+
+// true si algún archivo tiene datos sin reenviar. Solo RAM.
+bool backlogHayPendientes();
+
+// Entrada actual de un archivo concreto. false si no está en el manifiesto.
+bool backlogObtener(uint32_t fecha, bool binario, BacklogEntrada& out);
+
+// Acceso a las entradas (orden de alta: el más antiguo primero)
+size_t backlogNumArchivos();
+bool backlogEntrada(size_t i, BacklogEntrada& out);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef BACKUP_RECORD_H
+#define BACKUP_RECORD_H
+
+// Formato binario de respaldo (/backup/YYYY/MM/backup_YYYYMMDD.bin, ver
+// backlog.h), alternativo al CSV.
+//
+//   Cabecera (16 B): "OXBK" | version u8 | recSize u8 | reservado u16 |
+//                    fecha u32 (YYYYMMDD, 0 = unsync) | reservado u32
+//   Registro v2 (20 B): ts u64 (µs) | sensor u8 | valor f32 | flags u8 | seq u32 | crc16
+//   Registro v1 (16 B): ts u64 (µs) | sensor u8 | valor f32 | flags u8 | crc16  (sin seq)
+//
+// Todo en little-endian y serializado byte a byte (sin structs empaquetados)
+// para que el firmware y las herramientas de host lean lo mismo. El registro N
+// está en BKP_HDR_LEN + N * recSize (acceso O(1)); un CRC incorrecto marca el
+// registro como corrupto y el lector lo salta. Se escribe siempre v2; los
+// archivos v1 se siguen leyendo (recSize sale de la cabecera).
+// Sin dependencias de Arduino.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BKP_MAGIC        "OXBK"
+#define BKP_VERSION      2
+#define BKP_HDR_LEN      16
+#define BKP_REC_LEN      20          // v2 (actual)
+#define BKP_REC_LEN_V1   16
+#define BKP_REC_LEN_MIN  BKP_REC_LEN_V1
+
+// flags (bits libres reservados, se escriben a 0)
+#define BKP_FLAG_ORIGEN_BACKUP  0x01 // source=backup (si no, wifi)
+
+struct BackupRecord {
+  unsigned long long timestamp;   // µs UNIX
+  uint8_t sensor;                 // SensorId (sample.h)
+  float valor;
+  uint8_t flags;
+  uint32_t seq;                   // secuencia por dispositivo (0 = desconocida, v1)
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF). 'crc' permite encadenar trozos.
+inline uint16_t bkpCrc16(const uint8_t* p, size_t n, uint16_t crc = 0xFFFF) {
+  while (n--) {
+    crc ^= (uint16_t)(*p++) << 8;
+    for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+inline void bkpPutU16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void bkpPutU32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i)); }
+inline void bkpPutU64(uint8_t* p, unsigned long long v) { for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i)); }
+inline uint16_t bkpGetU16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t bkpGetU32(const uint8_t* p) {
+  uint32_t v = 0; for (int i = 3; i >= 0; i--) v = (v << 8) | p[i]; return v;
+}
+inline unsigned long long bkpGetU64(const uint8_t* p) {
+  unsigned long long v = 0; for (int i = 7; i >= 0; i--) v = (v << 8) | p[i]; return v;
+}
+
+inline void bkpCodificarCabecera(uint8_t out[BKP_HDR_LEN], uint32_t fechaYmd) {
+  memset(out, 0, BKP_HDR_LEN);
+  memcpy(out, BKP_MAGIC, 4);
+  out[4] = BKP_VERSION;
+  out[5] = BKP_REC_LEN;
+  bkpPutU32(out + 8, fechaYmd);
+}
+
+// Tamaño de registro declarado por la cabecera (20 v2, 16 v1); 0 si no es válida
+inline uint8_t bkpRecLen(const uint8_t in[BKP_HDR_LEN]) {
+  if (memcmp(in, BKP_MAGIC, 4) != 0) return 0;
+  if (in[4] == 2 && in[5] == BKP_REC_LEN) return BKP_REC_LEN;
+  if (in[4] == 1 && in[5] == BKP_REC_LEN_V1) return BKP_REC_LEN_V1;
+  return 0;
+}
+
+inline bool bkpCabeceraValida(const uint8_t in[BKP_HDR_LEN]) { return bkpRecLen(in) != 0; }
+
+// Codifica en el formato de 'recLen' (v1 descarta seq)
+inline void bkpCodificar(const BackupRecord& r, uint8_t* out, uint8_t recLen = BKP_REC_LEN) {
+  uint32_t bits;
+  memcpy(&bits, &r.valor, sizeof(bits));
+  bkpPutU64(out, r.timestamp);
+  out[8] = r.sensor;
+  bkpPutU32(out + 9, bits);
+  out[13] = r.flags;
+  if (recLen == BKP_REC_LEN) bkpPutU32(out + 14, r.seq);
+  bkpPutU16(out + recLen - 2, bkpCrc16(out, recLen - 2));
+}
+
+// false si el CRC no coincide (registro corrupto o a medio escribir)
+inline bool bkpDecodificar(const uint8_t* in, BackupRecord& r, uint8_t recLen = BKP_REC_LEN) {
+  if (bkpGetU16(in + recLen - 2) != bkpCrc16(in, recLen - 2)) return false;
+  uint32_t bits = bkpGetU32(in + 9);
+  r.timestamp = bkpGetU64(in);
+  r.sensor = in[8];
+  memcpy(&r.valor, &bits, sizeof(bits));
+  r.flags = in[13];
+  r.seq = (recLen == BKP_REC_LEN) ? bkpGetU32(in + 14) : 0;
+  return true;
+}
+
+inline size_t bkpOffsetRegistro(size_t n, uint8_t recLen = BKP_REC_LEN) { return BKP_HDR_LEN + n * recLen; }
+
+#endif
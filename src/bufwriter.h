@@ -0,0 +1,118 @@
+#ifndef BUFWRITER_H
+#define BUFWRITER_H
+
+// Escritor sobre buffer fijo: construye URLs, filas CSV y cuerpos line
+// protocol sin tocar el heap. Nunca escribe fuera de 'cap'; si no cabe,
+// trunca y marca overflow() para que el llamador descarte el resultado.
+// Sin dependencias de Arduino (utilizable en host).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class BufWriter {
+public:
+  BufWriter(char* buf, size_t cap) : buf_(buf), cap_(cap) { clear(); }
+
+  void clear() { len_ = 0; ovf_ = false; if (cap_) buf_[0] = '\0'; }
+
+  const char* c_str() const { return buf_; }
+  size_t length() const { return len_; }
+  bool overflow() const { return ovf_; }
+
+  BufWriter& append(char c) {
+    if (len_ + 1 < cap_) { buf_[len_++] = c; buf_[len_] = '\0'; }
+    else ovf_ = true;
+    return *this;
+  }
+
+  BufWriter& append(const char* s, size_t n) {
+    if (!s) return *this;
+    size_t libre = (cap_ > len_ + 1) ? (cap_ - len_ - 1) : 0;
+    if (n > libre) { n = libre; ovf_ = true; }
+    memcpy(buf_ + len_, s, n);
+    len_ += n;
+    if (cap_) buf_[len_] = '\0';
+    return *this;
+  }
+
+  BufWriter& append(const char* s) { return s ? append(s, strlen(s)) : *this; }
+
+  // Codificación de URL (RFC 3986: sin reservar A-Z a-z 0-9 - _ . ~)
+  BufWriter& appendUrlEncoded(const char* s) {
+    static const char hex[] = "0123456789ABCDEF";
+    if (!s) return *this;
+    for (; *s; ++s) {
+      unsigned char c = (unsigned char)*s;
+      if (('a'<=c && c<='z') || ('A'<=c && c<='Z') || ('0'<=c && c<='9') ||
+          c=='-' || c=='_' || c=='.' || c=='~') {
+        append((char)c);
+      } else {
+        append('%');
+        append(hex[(c >> 4) & 0xF]);
+        append(hex[c & 0xF]);
+      }
+    }
+    return *this;
+  }
+
+  BufWriter& appendU64(unsigned long long v) {
+    char tmp[21];
+    size_t i = sizeof(tmp);
+    do { tmp[--i] = (char)('0' + (v % 10)); v /= 10; } while (v);
+    return append(tmp + i, sizeof(tmp) - i);
+  }
+
+  BufWriter& appendI64(long long v) {
+    if (v < 0) { append('-'); return appendU64(0ULL - (unsigned long long)v); }
+    return appendU64((unsigned long long)v);
+  }
+
+  // Punto fijo con 'dec' decimales (0..6). Redondeo al más cercano con
+  // empates a par, igual que printf("%.*f") / String(v, dec): float * 10^dec
+  // es exacto en double, así que el empate se detecta sin error.
+  BufWriter& appendFixed(float v, uint8_t dec = 2) {
+    static const uint32_t POT10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    if (v != v) return append("nan");
+    if (dec > 6) dec = 6;
+    double x = (double)v;
+    bool neg = x < 0;
+    if (neg) x = -x;
+    if (x >= 1e12) return append(neg ? "-inf" : "inf");
+    double y = x * POT10[dec];
+    unsigned long long q = (unsigned long long)y;
+    double resto = y - (double)q;
+    if (resto > 0.5 || (resto == 0.5 && (q & 1))) q++;
+    unsigned long long ent = q / POT10[dec];
+    uint32_t frac = (uint32_t)(q % POT10[dec]);
+    // Signo si el valor redondeado no es cero, aunque la parte entera lo sea
+    // (-0.05 → "-0.05"); "-0.00" sale sin signo
+    const bool conSigno = neg && (ent != 0 || frac != 0);
+    if (conSigno) append('-');
+    appendU64(ent);
+    if (dec) {
+      append('.');
+      char f[6];
+      for (int i = dec - 1; i >= 0; --i) { f[i] = (char)('0' + frac % 10); frac /= 10; }
+      append(f, dec);
+    }
+    return *this;
+  }
+
+private:
+  char* buf_;
+  size_t cap_;
+  size_t len_ = 0;
+  bool ovf_ = false;
+};
+
+// BufWriter con almacenamiento propio (típicamente en la pila)
+template <size_t N>
+class FixedBuf : public BufWriter {
+public:
+  FixedBuf() : BufWriter(storage_, N) {}
+private:
+  char storage_[N];
+};
+
+#endif
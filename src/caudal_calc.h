@@ -0,0 +1,126 @@
+#ifndef CAUDAL_CALC_H
+#define CAUDAL_CALC_H
+
+// Cálculo del caudal del YF-S201 a partir de instantáneas del hardware.
+//
+// El driver (sensores_CAUDALIMETRO_YF-S201.cpp) solo lee registros: contador
+// PCNT (pulsos filtrados) y captura MCPWM (marca de tiempo de cada flanco,
+// APB 80 MHz). Todo lo demás está aquí, sin dependencias de Arduino, para
+// poder alimentarlo en el PC con trenes de pulsos sintéticos.
+//
+// Con flancos capturados la frecuencia es recíproca: flancos / tiempo entre
+// el último flanco de la ventana anterior y el último de esta, con resolución
+// de 12.5 ns en vez de ±1 pulso. Sin capturas válidas, pulsos PCNT / duración
+// medida de la ventana (no se supone 1 s).
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef CAUDAL_HZ_POR_LPM
+#define CAUDAL_HZ_POR_LPM 7.5f       // YF-S201: F(Hz) = 7.5 · Q(L/min)
+#endif
+#ifndef CAUDAL_PULSOS_POR_LITRO
+#define CAUDAL_PULSOS_POR_LITRO 450.0  // 7.5 Hz por L/min · 60 s
+#endif
+#ifndef CAUDAL_PARADO_US
+#define CAUDAL_PARADO_US 2000000LL   // sin flancos en este tiempo → caudal 0
+#endif
+
+#define CAUDAL_PCNT_LIM 32767        // el PCNT vuelve a 0 al llegar aquí
+#define CAUDAL_TICKS_US 80u          // ticks de captura por µs (APB)
+#define CAUDAL_CAPTURA_MAX_US 50000000LL  // la captura de 32 bits da la vuelta a los ~53 s
+
+// Lo que el driver lee del hardware en un instante
+struct CaudalCrudo {
+  int16_t pcnt;          // contador PCNT
+  uint32_t nCap;         // flancos capturados desde el arranque
+  uint32_t capTicks;     // captura del último flanco
+  uint32_t capPrevTicks; // captura del anterior
+  int64_t flancoUs;      // esp_timer del último flanco (0 = ninguno)
+  int64_t ahoraUs;       // esp_timer de la lectura
+};
+
+// Estado entre ventanas: la instantánea que abrió la ventana actual
+struct CaudalAcum {
+  bool iniciado;
+  CaudalCrudo base;
+};
+
+struct CaudalLectura {
+  uint32_t pulsos;       // PCNT en la ventana
+  uint32_t flancos;      // capturas en la ventana
+  int64_t ventanaUs;     // duración medida de la ventana
+  float spanUs;          // último flanco anterior → último flanco (0 = no válido)
+  float periodoUs;       // último periodo flanco a flanco (0 = no hay)
+  int64_t desdeFlancoUs; // cierre de la ventana − último flanco
+};
+
+// Pulsos PCNT entre dos lecturas del contador
+inline uint32_t caudalDeltaPcnt(int16_t antes, int16_t ahora) {
+  return (uint32_t)((ahora - antes + CAUDAL_PCNT_LIM) % CAUDAL_PCNT_LIM);
+}
+
+inline void caudalReiniciar(CaudalAcum& a, const CaudalCrudo& c) {
+  a.base = c;
+  a.iniciado = true;
+}
+
+// Cierra la ventana [a.base, c] y abre la siguiente en c
+inline CaudalLectura caudalVentana(CaudalAcum& a, const CaudalCrudo& c) {
+  CaudalLectura l = {};
+  if (!a.iniciado) {
+    caudalReiniciar(a, c);
+    return l;
+  }
+  const CaudalCrudo& b = a.base;
+  l.pulsos = caudalDeltaPcnt(b.pcnt, c.pcnt);
+  l.flancos = c.nCap - b.nCap;
+  l.ventanaUs = c.ahoraUs - b.ahoraUs;
+  l.desdeFlancoUs = c.flancoUs ? c.ahoraUs - c.flancoUs : l.ventanaUs;
+  if (c.nCap >= 2) l.periodoUs = (float)(uint32_t)(c.capTicks - c.capPrevTicks) / CAUDAL_TICKS_US;
+
+  if (l.flancos && b.nCap && c.flancoUs - b.flancoUs < CAUDAL_CAPTURA_MAX_US) {
+    l.spanUs = (float)(uint32_t)(c.capTicks - b.capTicks) / CAUDAL_TICKS_US;
+  } else if (l.flancos >= 2) {
+    // Sin flanco de referencia previo: desde el primero de esta ventana no se
+    // sabe; se usa el último periodo
+    l.spanUs = l.periodoUs;
+    l.flancos = 1;
+  }
+  caudalReiniciar(a, c);
+  return l;
+}
+
+// Frecuencia de pulsos (Hz) de una ventana
+inline float caudalFrecuenciaHz(const CaudalLectura& l) {
+  if (l.desdeFlancoUs >= CAUDAL_PARADO_US) return 0.0f;
+
+  // Recíproca si captura y PCNT coinciden (±1: un flanco en el borde de la
+  // ventana); si no, un glitch que el filtro del PCNT sí quitó → conteo
+  const uint32_t dif = l.flancos > l.pulsos ? l.flancos - l.pulsos : l.pulsos - l.flancos;
+  float f = 0.0f;
+  if (l.flancos && l.spanUs > 0.0f && dif <= 1) {
+    f = (float)l.flancos * 1e6f / l.spanUs;
+  } else if (l.ventanaUs > 0 && l.pulsos) {
+    f = (float)l.pulsos * 1e6f / (float)l.ventanaUs;
+  } else if (l.periodoUs > 0.0f) {
+    f = 1e6f / l.periodoUs;
+  }
+
+  // Si desde el último flanco ya pasó más de un periodo, el caudal está bajando:
+  // la frecuencia no puede ser mayor que 1 / ese tiempo
+  if (f > 0.0f && (float)l.desdeFlancoUs * f > 1e6f) f = 1e6f / (float)l.desdeFlancoUs;
+  return f;
+}
+
+// Frecuencia (Hz) de los últimos n flancos (µs, del más antiguo al más reciente)
+inline float caudalHzDeFlancos(const int64_t* tUs, size_t n) {
+  if (n < 2 || tUs[n - 1] <= tUs[0]) return 0.0f;
+  return (float)(n - 1) * 1e6f / (float)(tUs[n - 1] - tUs[0]);
+}
+
+inline float caudalLpm(const CaudalLectura& l, float hzPorLpm = CAUDAL_HZ_POR_LPM) {
+  return caudalFrecuenciaHz(l) / hzPorLpm;
+}
+
+#endif
@@ -37,6 +37,38 @@ Config loadDefaultConfig() {
             "123456789ABCDEF"                   // API Key
         },
 
+        // === Transporte de subida (FSM en vivo + reenvío desde SD) ===
+        .uplink = {
+            // HTTP_GET | HTTP_POST_LOTE | MQTT. GET es lo que acepta el api.php
+            // desplegado; POST (format=lp) y MQTT solo con el servidor/broker listos
+            UplinkTipo::HTTP_GET,
+            {
+                "iotbcn.com",                   // Broker MQTT (p.ej. IP del PC con mosquitto)
+                1883,                           // Puerto
+                "",                             // Usuario (vacío = anónimo)
+                "",                             // Clave
+                "oxigeno"                       // Topic base → oxigeno/<mac>/lp
+            }
+        },
+
+        // === Respaldo en SD ===
+        .backup = {
+            BackupFormato::CSV                  // CSV | BINARIO (convertir con tools/backup_bin2csv)
+        },
+
+        // === Eventlog en SD ===
+        .log = {
+            LogFormato::CSV                     // CSV | BINARIO (convertir con tools/eventlog_bin2csv)
+        },
+
+        // === Retención en SD (KB, días) ===
+        .retencion = {
+            { 1024UL * 1024, 730 },             // raw: 1 GB, 2 años
+            { 64UL * 1024,   180 },             // auditoría CSV antigua: 64 MB, 6 meses
+            { 256UL * 1024,  90 },              // eventlog: 256 MB, 3 meses
+            7                                   // compactar /sent/raw tras 7 días
+        },
+
         // === NTP (hora global) ===
         .ntp = {
             "pool.ntp.org",     // Servidor NTP
@@ -51,7 +83,8 @@ Config loadDefaultConfig() {
              5,  // SD_CS   (Chip Select tarjeta SD)
             18,  // SCK     (SPI Clock)
             19,  // MISO    (SPI Master In)
-            23   // MOSI    (SPI Master Out)
+            23,  // MOSI    (SPI Master Out)
+             4   // RTC_SQW (DS3231 SQW, pull-up interno)
         },
 
         // === Tiempo por ventana de ejecución (segundos del minuto) ===
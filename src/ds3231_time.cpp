@@ -2,100 +2,360 @@
 #include "sdlog.h"
 #include <Wire.h>
 #include <RTClib.h>
+#include <esp_timer.h>
 
 static RTC_DS3231 rtc;
 static bool rtc_ok = false;
 static bool rtc_needs_set = false;
 
-static uint32_t last_unix_sec = 0;
-static unsigned long last_micros_snap = 0;
+// ====== Reloj por software ======
+// La hora se sirve desde RAM: ancla (µs UNIX ↔ esp_timer) + esp_timer
+// transcurrido. El ancla la pone el DS3231 (una lectura I2C) y la corrige cada
+// flanco de SQW (1 Hz, el segundo del RTC cambia en el flanco de bajada); sin
+// SQW se relee el RTC cada RELOJ_RELECTURA_MS. Todas las lecturas I2C ocurren
+// en relojTick() (loop), setRTCFromUnix() e initDS3231().
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool g_anclado = false;
+static int64_t g_anclaEsp = 0;                 // esp_timer_get_time() del ancla
+static unsigned long long g_anclaUs = 0;       // µs UNIX en ese instante
+static unsigned long long g_ultimoUs = 0;      // último ts entregado (monótono)
+
+static int g_pinSqw = -1;
+static volatile uint32_t g_sqwN = 0;           // flancos vistos (ISR)
+static volatile int64_t g_sqwEsp = 0;          // esp_timer del último flanco (ISR)
+static uint32_t g_sqwProcesados = 0;
+static bool g_realinear = true;                // el próximo flanco relee el segundo del RTC
+static unsigned long g_ultimoFlancoMs = 0;
+static unsigned long g_ultimaLecturaMs = 0;
+static RelojEstado g_estado = {};
+
+// ====== Disciplina NTP ======
+// Hora entregada = reloj por software (RTC) + corrección. La corrección es la
+// diferencia NTP − RTC: una base, una frecuencia (deriva estimada del RTC entre
+// sincronías) y un resto pendiente que entra a como mucho RELOJ_SLEW_PPM, así
+// que la hora nunca salta ni retrocede por una sincronía normal.
+static int64_t g_corrEsp = 0;       // esp_timer de la base
+static long long g_corrUs = 0;      // corrección en g_corrEsp
+static long long g_slewUs = 0;      // pendiente de aplicar desde g_corrEsp
+static int32_t g_frecPpb = 0;       // deriva compensada (positivo: el RTC atrasa)
+static int64_t g_syncEsp = 0;       // última sincronía (0 = ninguna)
+static unsigned long g_rebaseMs = 0;
 
 static bool plausibleUnix(uint32_t t) {
   return (t >= 1577836800UL) && (t < 4102444800UL);
 }
 
-bool initDS3231(int sda, int scl) {
+static void IRAM_ATTR isrSqw() {
+  int64_t t = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&g_mux);
+  g_sqwEsp = t;
+  g_sqwN++;
+  portEXIT_CRITICAL_ISR(&g_mux);
+}
+
+static void anclar(unsigned long long us, int64_t esp) {
+  portENTER_CRITICAL(&g_mux);
+  g_anclaUs = us;
+  g_anclaEsp = esp;
+  g_anclado = true;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+// Hora del reloj por software en el instante 'esp' (0 si no hay ancla)
+static unsigned long long horaEn(int64_t esp) {
+  portENTER_CRITICAL(&g_mux);
+  unsigned long long us = g_anclado ? g_anclaUs + (unsigned long long)(esp - g_anclaEsp) : 0ULL;
+  portEXIT_CRITICAL(&g_mux);
+  return us;
+}
+
+// Corrección en 'esp'. Llamar con g_mux tomado.
+static long long correccionEn(int64_t esp) {
+  long long dt = (long long)(esp - g_corrEsp);
+  if (dt < 0) dt = 0;
+  long long c = g_corrUs + dt * g_frecPpb / 1000000000LL;
+  long long maxSlew = dt * RELOJ_SLEW_PPM / 1000000LL;
+  c += (g_slewUs >= 0) ? (g_slewUs < maxSlew ? g_slewUs : maxSlew)
+                       : (-g_slewUs < maxSlew ? g_slewUs : -maxSlew);
+  return c;
+}
+
+// Consolida la corrección aplicada hasta 'esp' en la base. Llamar con g_mux tomado.
+static void rebaseCorreccion(int64_t esp) {
+  long long dt = (long long)(esp - g_corrEsp);
+  if (dt < 0) dt = 0;
+  long long c = correccionEn(esp);
+  g_slewUs -= c - g_corrUs - dt * g_frecPpb / 1000000000LL;
+  g_corrUs = c;
+  g_corrEsp = esp;
+}
+
+// Una lectura I2C; 0 si el RTC no responde o la hora no es plausible
+static uint32_t leerRTC() {
+  g_estado.lecturas++;
+  g_ultimaLecturaMs = millis();
+  uint32_t s = rtc.now().unixtime();
+  return plausibleUnix(s) ? s : 0;
+}
+
+static void cambiarFuente(RelojFuente f) {
+  if (g_estado.fuente == f) return;
+  RelojFuente antes = g_estado.fuente;
+  g_estado.fuente = f;
+  g_estado.cotaErrorUs = (f == RELOJ_SQW) ? RELOJ_COTA_SQW_US : 1000000UL;
+  if (f == RELOJ_LECTURA && antes == RELOJ_SQW) {
+    LOGW("RTC", "RTC_FALLBACK", "reason=no_sqw;pin=%d;relectura_ms=%lu", g_pinSqw, (unsigned long)RELOJ_RELECTURA_MS);
+  } else if (f == RELOJ_SQW) {
+    LOGI("RTC", "RTC_SQW", "pin=%d;cota_us=%lu", g_pinSqw, (unsigned long)RELOJ_COTA_SQW_US);
+  }
+}
+
+bool initDS3231(int sda, int scl, int sqw) {
   Wire.begin(sda, scl);
   delay(10);
   rtc_ok = rtc.begin();
 
   if (!rtc_ok) {
-    logEventoM("RTC", "MOD_FAIL", "i2c=0x68;err=no_response");
+    LOGE("RTC", "MOD_FAIL", "i2c=0x68;err=no_response");
     return false;
   }
 
   if (rtc.lostPower()) {
     rtc_needs_set = true;
-    logEventoM("RTC", "MOD_UP", "i2c=0x68;need_set=1");
+    LOGI("RTC", "MOD_UP", "i2c=0x68;need_set=1");
   } else {
     rtc_needs_set = false;
-    logEventoM("RTC", "MOD_UP", "i2c=0x68;need_set=0");
+    LOGI("RTC", "MOD_UP", "i2c=0x68;need_set=0");
   }
 
-  last_unix_sec = 0;
-  last_micros_snap = micros();
+  // Ancla inicial (error < 1 s hasta el primer flanco)
+  uint32_t s = rtc_needs_set ? 0 : leerRTC();
+  if (s) anclar((unsigned long long)s * 1000000ULL, esp_timer_get_time());
+  g_estado.fuente = RELOJ_LECTURA;
+  g_estado.cotaErrorUs = 1000000UL;
+
+  g_pinSqw = sqw;
+  if (g_pinSqw >= 0) {
+    rtc.writeSqwPinMode(DS3231_SquareWave1Hz);
+    pinMode(g_pinSqw, INPUT_PULLUP);   // SQW es open-drain
+    attachInterrupt(digitalPinToInterrupt(g_pinSqw), isrSqw, FALLING);
+    g_ultimoFlancoMs = millis();
+  }
   return rtc_ok;
 }
 
 bool rtcIsPresent() { return rtc_ok; }
 
 bool rtcIsTimeValid() {
-  if (!rtc_ok) return false;
-  if (rtc_needs_set) return false;
-  DateTime now = rtc.now();
-  return plausibleUnix(now.unixtime());
+  if (!rtc_ok || rtc_needs_set) return false;
+  return plausibleUnix((uint32_t)(horaEn(esp_timer_get_time()) / 1000000ULL));
 }
 
 bool setRTCFromUnix(uint32_t unixSeconds) {
   if (!rtc_ok) {
-    logEventoM("RTC", "MOD_FAIL", "op=set;err=not_present");
+    LOGE("RTC", "MOD_FAIL", "op=set;err=not_present");
     return false;
   }
   if (!plausibleUnix(unixSeconds)) {
-    logEventoM("RTC", "MOD_FAIL", "op=set;err=ts_implausible");
+    LOGE("RTC", "MOD_FAIL", "op=set;err=ts_implausible");
     return false;
   }
   rtc.adjust(DateTime(unixSeconds));
   rtc_needs_set = false;
-  last_unix_sec = unixSeconds;
-  last_micros_snap = micros();
+  int64_t w = esp_timer_get_time();
+  anclar((unsigned long long)unixSeconds * 1000000ULL, w);
+  portENTER_CRITICAL(&g_mux);
+  g_ultimoUs = 0;                // un ajuste explícito puede retroceder
+  g_corrUs = 0;
+  g_slewUs = 0;
+  g_corrEsp = w;
+  portEXIT_CRITICAL(&g_mux);
+  g_realinear = true;            // escribir el RTC reinicia su divisor: fase nueva
+  g_ultimaLecturaMs = millis();
   return true;
 }
 
 uint32_t getUnixSeconds() {
-  if (!rtc_ok || rtc_needs_set) return 0;
-  DateTime now = rtc.now();
-  uint32_t s = now.unixtime();
+  uint32_t s = (uint32_t)(getTimestampMicros() / 1000000ULL);
   return plausibleUnix(s) ? s : 0;
 }
 
 unsigned long long getTimestampMicros() {
   if (!rtc_ok || rtc_needs_set) return 0ULL;
+  int64_t esp = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  unsigned long long us = 0ULL;
+  if (g_anclado) {
+    us = g_anclaUs + (unsigned long long)(esp - g_anclaEsp) + (unsigned long long)correccionEn(esp);
+    // La corrección de un flanco no hace retroceder lo ya entregado
+    if (us < g_ultimoUs && g_ultimoUs - us < 1000000ULL) us = g_ultimoUs;
+    g_ultimoUs = us;
+  }
+  portEXIT_CRITICAL(&g_mux);
+  return us;
+}
 
-  uint32_t secs = getUnixSeconds();
-  if (!secs) return 0ULL;
+// Flanco de SQW: el segundo del RTC acaba de cambiar en 'esp'
+static void procesarFlanco(int64_t esp) {
+  g_ultimoFlancoMs = millis();
+  g_estado.flancos++;
+  cambiarFuente(RELOJ_SQW);
 
-  unsigned long m = micros();
-  if (secs != last_unix_sec) {
-    last_unix_sec = secs;
-    last_micros_snap = m;
+  const bool verificar = millis() - g_ultimaLecturaMs >= RELOJ_VERIFICAR_MS;
+  if (!g_anclado || g_realinear || verificar) {
+    // Se lee el segundo del RTC; vale solo si seguimos dentro de ese segundo
+    if (esp_timer_get_time() - esp > 900000) return;
+    uint32_t s = leerRTC();
+    if (!s) return;
+    unsigned long long rtcUs = (unsigned long long)s * 1000000ULL;
+    if (g_anclado && !g_realinear && horaEn(esp) / 1000000ULL != s) {
+      LOGW("RTC", "RTC_WARN", "op=verify;rtc=%lu;soft=%lu", (unsigned long)s,
+           (unsigned long)(horaEn(esp) / 1000000ULL));
+    }
+    anclar(rtcUs, esp);
+    g_realinear = false;
+    return;
   }
-  unsigned long delta_us = (unsigned long)(m - last_micros_snap);
-  if (delta_us >= 1000000UL) delta_us = 999999UL;
 
-  return (unsigned long long)secs * 1000000ULL + (unsigned long long)delta_us;
+  // Flanco = segundo entero: se redondea la hora por software y se reancla
+  unsigned long long soft = horaEn(esp);
+  unsigned long long entero = (soft + 500000ULL) / 1000000ULL * 1000000ULL;
+  g_estado.ultimaCorreccionUs = (int32_t)((long long)entero - (long long)soft);
+  anclar(entero, esp);
+}
+
+// Sin SQW: relectura periódica. El RTC dice que la hora está en [s, s+1);
+// se mueve el reloj lo mínimo para volver a ese intervalo.
+static void relecturaPeriodica() {
+  if (g_anclado && millis() - g_ultimaLecturaMs < RELOJ_RELECTURA_MS) return;
+  int64_t esp = esp_timer_get_time();
+  uint32_t s = leerRTC();
+  if (!s) return;
+  unsigned long long lo = (unsigned long long)s * 1000000ULL;
+  unsigned long long hi = lo + 999999ULL;
+  unsigned long long soft = horaEn(esp);
+  if (!g_anclado || soft < lo) { g_estado.ultimaCorreccionUs = g_anclado ? (int32_t)(lo - soft) : 0; anclar(lo, esp); }
+  else if (soft > hi)         { g_estado.ultimaCorreccionUs = -(int32_t)(soft - hi); anclar(hi, esp); }
+}
+
+// Pasa los segundos enteros de la corrección al RTC para que no se pierdan en
+// un reinicio. Escribir los segundos reinicia el divisor del DS3231, así que
+// el ancla pasa a ese instante y la fracción de segundo queda en la
+// corrección: la hora entregada no cambia.
+static void plegarEnRTC() {
+  int64_t e0 = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  long long k = correccionEn(e0) / 1000000LL;
+  portEXIT_CRITICAL(&g_mux);
+  if (k == 0) return;
+  unsigned long long soft = horaEn(e0);
+  uint32_t s = (uint32_t)(soft / 1000000ULL + k);
+  if (!plausibleUnix(s)) return;
+  rtc.adjust(DateTime(s));
+  int64_t w = esp_timer_get_time();
+  long long frac = (long long)(soft % 1000000ULL) + (long long)(w - e0);
+  portENTER_CRITICAL(&g_mux);
+  rebaseCorreccion(w);
+  g_corrUs += frac - k * 1000000LL;
+  g_anclaUs = (unsigned long long)s * 1000000ULL;
+  g_anclaEsp = w;
+  portEXIT_CRITICAL(&g_mux);
+  g_ultimaLecturaMs = millis();
+  LOGI("RTC", "RTC_SYNC", "action=fold;s=%lld", k);
 }
 
-void keepRTCInSyncWithNTP(bool ntpOk, uint32_t ntpUnixSeconds) {
-  if (!rtc_ok) return;
-  if (!ntpOk) return;
-  if (!plausibleUnix(ntpUnixSeconds)) {
-    logEventoM("RTC", "MOD_WARN", "op=sync;err=ntp_ts_implausible");
+void relojTick() {
+  if (!rtc_ok || rtc_needs_set) return;
+
+  if (millis() - g_rebaseMs >= RELOJ_REBASE_MS) {
+    g_rebaseMs = millis();
+    int64_t esp = esp_timer_get_time();
+    portENTER_CRITICAL(&g_mux);
+    rebaseCorreccion(esp);
+    long long c = g_corrUs;
+    portEXIT_CRITICAL(&g_mux);
+    if (c >= 1000000LL || c <= -1000000LL) plegarEnRTC();
+  }
+
+  uint32_t n;
+  int64_t esp;
+  portENTER_CRITICAL(&g_mux);
+  n = g_sqwN;
+  esp = g_sqwEsp;
+  portEXIT_CRITICAL(&g_mux);
+
+  if (g_pinSqw >= 0 && n != g_sqwProcesados) {
+    g_sqwProcesados = n;
+    procesarFlanco(esp);
     return;
   }
+  if (g_pinSqw >= 0 && millis() - g_ultimoFlancoMs < RELOJ_SQW_TIMEOUT_MS) return;
+  cambiarFuente(RELOJ_LECTURA);
+  relecturaPeriodica();
+}
+
+RelojEstado relojEstado() {
+  RelojEstado e = g_estado;
+  portENTER_CRITICAL(&g_mux);
+  e.derivaPpb = g_frecPpb;
+  int64_t esp = esp_timer_get_time();
+  long long dt = (long long)(esp - g_corrEsp);
+  e.slewPendienteUs = (int32_t)(g_slewUs - (correccionEn(esp) - g_corrUs - dt * g_frecPpb / 1000000000LL));
+  portEXIT_CRITICAL(&g_mux);
+  return e;
+}
+
+bool keepRTCInSyncWithNTP(bool ntpOk, unsigned long long ntpUs) {
+  if (!rtc_ok) return false;
+  if (!ntpOk) return false;
+  const uint32_t ntpS = (uint32_t)(ntpUs / 1000000ULL);
+  if (!plausibleUnix(ntpS)) {
+    LOGW("RTC", "MOD_WARN", "op=sync;err=ntp_ts_implausible");
+    return false;
+  }
 
-  uint32_t rtcS = getUnixSeconds();
-  if (!rtcS || (rtcS > ntpUnixSeconds + 2) || (ntpUnixSeconds > rtcS + 2)) {
-    setRTCFromUnix(ntpUnixSeconds);
+  int64_t esp = esp_timer_get_time();
+  const unsigned long long soft = horaEn(esp);
+  g_estado.sincronias++;
+
+  // Sin hora previa o error grande: paso (la hora puede saltar). La fracción
+  // de segundo que no cabe en el RTC queda en la corrección.
+  portENTER_CRITICAL(&g_mux);
+  long long salida = (long long)soft + correccionEn(esp);
+  portEXIT_CRITICAL(&g_mux);
+  long long err = (long long)ntpUs - salida;
+  if (rtc_needs_set || soft == 0 || err > RELOJ_PASO_US || err < -RELOJ_PASO_US) {
+    if (!setRTCFromUnix(ntpS)) return false;
+    portENTER_CRITICAL(&g_mux);
+    g_corrUs = (long long)(ntpUs % 1000000ULL) + (long long)(g_anclaEsp - esp);
+    g_corrEsp = g_anclaEsp;
+    g_syncEsp = g_anclaEsp;
+    portEXIT_CRITICAL(&g_mux);
+    g_estado.pasos++;
+    g_estado.offsetUs = (int32_t)(err > INT32_MAX ? INT32_MAX : err < INT32_MIN ? INT32_MIN : err);
+    LOGW("RTC", "RTC_SYNC", "action=step;offset_us=%lld", err);
+    return true;
+  }
+
+  // Error pequeño: slew. Lo que queda tras el slew aún pendiente es error de
+  // frecuencia acumulado desde la última sincronía (lazo de frecuencia, ganancia 1/2).
+  portENTER_CRITICAL(&g_mux);
+  rebaseCorreccion(esp);
+  long long residuo = err - g_slewUs;
+  long long dtSync = g_syncEsp ? (long long)(esp - g_syncEsp) : 0;
+  if (dtSync >= (long long)RELOJ_DERIVA_MIN_S * 1000000LL) {
+    long long f = g_frecPpb + residuo * 1000000000LL / dtSync / 2;
+    if (f > RELOJ_FREC_MAX_PPB) f = RELOJ_FREC_MAX_PPB;
+    if (f < -RELOJ_FREC_MAX_PPB) f = -RELOJ_FREC_MAX_PPB;
+    g_frecPpb = (int32_t)f;
   }
+  g_slewUs = err;
+  int32_t frec = g_frecPpb;
+  portEXIT_CRITICAL(&g_mux);
+  g_syncEsp = esp;
+  g_estado.offsetUs = (int32_t)err;
+
+  LOGI("RTC", "RTC_SYNC", "action=slew;offset_us=%lld;drift_ppm=%.3f;slew_s=%lu", err, frec / 1000.0,
+       (unsigned long)((err < 0 ? -err : err) / RELOJ_SLEW_PPM));
+  return true;
 }
@@ -1,8 +1,42 @@
 #pragma once
 #include <Arduino.h>
 
-// Inicializa I2C y el DS3231. Devuelve true si el RTC responde.
-bool initDS3231(int sda = 21, int scl = 22);
+// La hora se sirve desde un reloj por software (esp_timer) disciplinado por el
+// DS3231: con SQW cableado (1 Hz, interrupción) cada flanco lo reancla al
+// segundo entero; sin SQW se relee el RTC por I2C cada RELOJ_RELECTURA_MS.
+// getTimestampMicros()/getUnixSeconds() no tocan el bus I2C.
+
+#ifndef RELOJ_RELECTURA_MS
+#define RELOJ_RELECTURA_MS 10000UL     // sin SQW: lectura I2C periódica
+#endif
+#ifndef RELOJ_VERIFICAR_MS
+#define RELOJ_VERIFICAR_MS 600000UL    // con SQW: comprobación del segundo del RTC
+#endif
+#ifndef RELOJ_SQW_TIMEOUT_MS
+#define RELOJ_SQW_TIMEOUT_MS 2500UL    // sin flancos en este tiempo → modo lectura
+#endif
+#ifndef RELOJ_SLEW_PPM
+#define RELOJ_SLEW_PPM 500LL           // velocidad máxima de corrección (500 µs por segundo)
+#endif
+#ifndef RELOJ_PASO_US
+#define RELOJ_PASO_US 2000000LL        // error NTP mayor → paso en vez de slew
+#endif
+#ifndef RELOJ_DERIVA_MIN_S
+#define RELOJ_DERIVA_MIN_S 900UL       // intervalo mínimo entre sincronías para estimar deriva
+#endif
+#ifndef RELOJ_FREC_MAX_PPB
+#define RELOJ_FREC_MAX_PPB 100000L     // deriva compensada máxima (100 ppm)
+#endif
+#ifndef RELOJ_REBASE_MS
+#define RELOJ_REBASE_MS 60000UL        // consolidación de la corrección / paso de segundos al RTC
+#endif
+#ifndef RELOJ_COTA_SQW_US
+#define RELOJ_COTA_SQW_US 50UL         // latencia de ISR + deriva del cristal del ESP en 1 s
+#endif
+
+// Inicializa I2C y el DS3231. 'sqw' = GPIO de la salida SQW (-1 = sin cablear).
+// Devuelve true si el RTC responde.
+bool initDS3231(int sda = 21, int scl = 22, int sqw = -1);
 
 // ¿El RTC está presente en el bus y responde?
 bool rtcIsPresent();
@@ -13,12 +47,35 @@ bool rtcIsTimeValid();
 // Ajusta el RTC con un timestamp UNIX (seg).
 bool setRTCFromUnix(uint32_t unixSeconds);
 
-// Devuelve UNIX time en segundos desde DS3231 si válido; si no, 0.
+// Devuelve UNIX time en segundos (reloj por software) si válido; si no, 0.
 uint32_t getUnixSeconds();
 
-// Devuelve timestamp en microsegundos con base RTC + microsegundos locales.
+// Devuelve timestamp en microsegundos (incluida la corrección NTP), monótono
+// salvo paso o ajuste explícito del RTC.
 // Si no hay RTC válido, devuelve 0.
 unsigned long long getTimestampMicros();
 
-// Sincroniza RTC con NTP si NTP está OK (idempotente).
-void keepRTCInSyncWithNTP(bool ntpOk, uint32_t ntpUnixSeconds);
+// Procesa flancos de SQW y relecturas del RTC. Llamar en cada vuelta del loop.
+void relojTick();
+
+enum RelojFuente : uint8_t { RELOJ_NINGUNA = 0, RELOJ_SQW, RELOJ_LECTURA };
+
+struct RelojEstado {
+  RelojFuente fuente;
+  uint32_t flancos;             // flancos de SQW procesados
+  uint32_t lecturas;            // lecturas I2C del RTC
+  uint32_t cotaErrorUs;         // cota del error respecto al RTC con la fuente actual
+  int32_t ultimaCorreccionUs;   // último ajuste aplicado al reloj por software
+  uint32_t sincronias;          // llamadas a keepRTCInSyncWithNTP con hora válida
+  uint32_t pasos;               // sincronías que ajustaron el RTC de golpe
+  int32_t offsetUs;             // NTP − hora entregada en la última sincronía
+  int32_t derivaPpb;            // deriva del RTC compensada (ppb; positivo = atrasa)
+  int32_t slewPendienteUs;      // corrección aún por aplicar
+};
+RelojEstado relojEstado();
+
+// Disciplina el reloj con una hora NTP en µs tomada justo antes de llamar.
+// Error < RELOJ_PASO_US: se corrige gradualmente (slew, monótono) y se
+// actualiza la deriva estimada. Mayor, o sin hora previa: ajusta el RTC de
+// golpe. Devuelve false si el RTC no está o la hora NTP no es plausible.
+bool keepRTCInSyncWithNTP(bool ntpOk, unsigned long long ntpUs);
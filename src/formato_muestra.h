@@ -0,0 +1,103 @@
+#ifndef FORMATO_MUESTRA_H
+#define FORMATO_MUESTRA_H
+
+// Texto de una muestra en el cable y en el respaldo CSV: query del GET,
+// línea line protocol del lote y fila de backup_*.csv. Sin dependencias de
+// Arduino: lo usan api.cpp, sdbackup.cpp y las herramientas de host
+// (tools/bufwriter_test.cpp, tools/backlog_bench.cpp), así que lo que se
+// prueba y se mide en el PC es esto mismo.
+// Si no cabe, el BufWriter marca overflow() y el llamador descarta.
+
+#include "bufwriter.h"
+#include "sample.h"
+
+// Máximo de muestras por POST en lote (line protocol). El reenvío desde SD
+// sube bloques de este tamaño; el cuerpo (~112 B por muestra) no se guarda
+// entero: se envía por tramos de API_TRAMO_LEN.
+#ifndef API_LOTE_MAX
+#define API_LOTE_MAX 256
+#endif
+// El cuerpo del lote se envía por tramos de este tamaño (un segmento TCP de lwIP)
+#ifndef API_TRAMO_LEN
+#define API_TRAMO_LEN 1436
+#endif
+// Máximo de una línea del lote (~112 B en la práctica)
+#ifndef API_LINEA_MAX
+#define API_LINEA_MAX 128
+#endif
+
+// Query de enviarDatoAPI() (una muestra por GET). false si no cabe.
+inline bool formatoQueryGet(BufWriter& q, const char* key, const char* measurement, const char* sensor, float valor,
+                            unsigned long long ts, const char* mac, const char* source, uint32_t seq) {
+  q.append("?api_key=").appendUrlEncoded(key)
+   .append("&measurement=").appendUrlEncoded(measurement)
+   .append("&sensor=").appendUrlEncoded(sensor)
+   .append("&valor=").appendFixed(valor, 2)
+   .append("&ts=").appendU64(ts)
+   .append("&mac=").append(mac)
+   .append("&source=").appendUrlEncoded(source);
+  if (seq) q.append("&seq=").appendU64(seq);
+  return !q.overflow();
+}
+
+// Una línea por muestra (sensor desconocido: nada):
+//   <measurement>,sensor=<sensor>,mac=<mac>,source=<source> valor=<v>[,seq=<n>i] <ts_us>
+inline void formatoLineaLP(BufWriter& body, const Sample& s, const char* mac) {
+  const SensorDef* def = sensorDef(s.sensor);
+  if (!def) return;
+  body.append(def->measurement)
+      .append(",sensor=").append(def->sensor)
+      .append(",mac=").append(mac)
+      .append(",source=").append(origenNombre(s.origen))
+      .append(" valor=").appendFixed(s.valor, 2);
+  if (s.seq) body.append(",seq=").appendU64(s.seq).append('i');
+  body.append(' ').appendU64(s.timestamp).append('\n');
+}
+
+// Longitud del cuerpo de un lote (Content-Length), sin guardarlo.
+// false si alguna línea no cabe en API_LINEA_MAX.
+inline bool formatoLoteLPLongitud(const Sample* m, size_t n, const char* mac, size_t& len) {
+  len = 0;
+  for (size_t i = 0; i < n; i++) {
+    FixedBuf<API_LINEA_MAX> l;
+    formatoLineaLP(l, m[i], mac);
+    if (l.overflow()) return false;
+    len += l.length();
+  }
+  return true;
+}
+
+// Vuelve a formatear el lote en 'tramo' (cap bytes, líneas enteras) y
+// entrega cada tramo a escribir(const char*, size_t) -> bool. Devuelve los
+// bytes entregados; se corta en el primer escribir() que falle.
+template <class Escribir>
+inline size_t formatoLoteLPPorTramos(const Sample* m, size_t n, const char* mac, char* tramo, size_t cap,
+                                     Escribir escribir) {
+  size_t usado = 0, total = 0;
+  for (size_t i = 0; i < n; i++) {
+    FixedBuf<API_LINEA_MAX> l;
+    formatoLineaLP(l, m[i], mac);
+    if (usado + l.length() > cap) {
+      if (!escribir(tramo, usado)) return total;
+      total += usado;
+      usado = 0;
+    }
+    memcpy(tramo + usado, l.c_str(), l.length());
+    usado += l.length();
+  }
+  if (usado) {
+    if (!escribir(tramo, usado)) return total;
+    total += usado;
+  }
+  return total;
+}
+
+// Fila de backup_*.csv:
+//   timestamp,measurement,sensor,valor,source,PENDIENTE,,seq\r\n
+inline void formatoFilaCsv(BufWriter& fila, unsigned long long ts, const char* measurement, const char* sensor,
+                           float valor, const char* source, uint32_t seq) {
+  fila.appendU64(ts).append(',').append(measurement).append(',').append(sensor).append(',')
+      .appendFixed(valor, 2).append(',').append(source).append(",PENDIENTE,,").appendU64(seq).append("\r\n");
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef LOG_BIN_H
+#define LOG_BIN_H
+
+// Eventlog binario (/eventlog_YYYY.MM.DD.bin), alternativo al CSV
+// (config.log.formato). Módulo, código y nivel se guardan como ids de las
+// tablas de abajo y el timestamp como delta varint; el kv va tal cual.
+//
+//   Cabecera (16 B): "OXLG" | version u8 | reservado (3 B) | fecha u32 (YYYYMMDD, 0 = unsync) |
+//                    nMod u16 | nCod u16 (tamaño de las tablas del firmware que lo escribió)
+//   Registro: len varint (bytes que siguen) | cab u8 | tiempo | mod | code | kvLen varint | kv
+//     cab:    bits 0-1 nivel (LOG_NIVEL_*), bit 2 LOGBIN_ABS
+//     tiempo: ABS  → ts µs varint | zz(offset local en minutos)
+//             si no → zz(Δts µs respecto al registro anterior)
+//     mod/code: id varint (≥ 1, tablas) | 0 + len varint + texto (no internado)
+//
+// Cada buffer volcado por sdlog empieza con un registro ABS, así que el delta
+// nunca cruza un volcado ni un reinicio. Un registro final a medias (corte al
+// escribir) no llega a 'len' bytes y el lector lo ignora. tools/eventlog_bin2csv
+// lo devuelve al CSV de siempre (ts_iso,ts_us,level,mod,code,fsm,kv).
+//
+// Las tablas solo crecen por el final: el id es la posición y está en los
+// archivos ya escritos. Un texto que no esté en la tabla se guarda en línea.
+// Sin dependencias de Arduino.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "backup_record.h"   // bkpPut*/bkpGet*
+#include "varint.h"
+
+#define LOGBIN_MAGIC    "OXLG"
+#define LOGBIN_VERSION  1
+#define LOGBIN_HDR_LEN  16
+#define LOGBIN_ABS      0x04
+#define LOGBIN_TEXTO_MAX 40    // mod/code en línea
+#define LOGBIN_KV_MAX   160
+#define LOGBIN_REG_MAX  (VARINT_MAX_LEN * 6 + 1 + 2 * LOGBIN_TEXTO_MAX + LOGBIN_KV_MAX)
+
+enum LogNivel : uint8_t { LOG_NIVEL_INFO = 0, LOG_NIVEL_WARN = 1, LOG_NIVEL_ERROR = 2, LOG_NIVEL_DEBUG = 3 };
+
+static const char* const LOG_NIVELES[4] = { "INFO", "WARN", "ERROR", "DEBUG" };
+
+// id 0 = texto en línea
+static const char* const LOG_MODULOS[] = {
+  nullptr,
+  "SYS", "FSM", "SD", "SD_BACKUP", "BACKLOG", "RETENCION", "LOG",
+  "API", "MQTT", "UPLINK", "WIFI", "NTP", "RTC", "SEQ",
+  "MAX6675", "ZMPT101B", "YF-S201",
+};
+
+static const char* const LOG_CODIGOS[] = {
+  nullptr,
+  // comunes
+  "MOD_UP", "MOD_FAIL", "MOD_WARN", "SD_ERR", "FSM_STATE",
+  // sistema
+  "BOOT", "BOOT_INFO", "STARTUP_SUMMARY", "SD_OK", "LOG_DROP",
+  // respaldo y reenvío
+  "RESPALDO", "BACKUP_OK", "BACKUP_WARN", "BACKUP_DROP", "BACKUP_ARCHIVE", "TS_INVALID_BACKUP",
+  "REINTENTO_INFO", "REINTENTO_OK", "REINTENTO_ERR", "REINTENTO_CRC", "REINTENTO_EOF", "REINTENTO_FIX",
+  "REINTENTO_HOLD", "REINTENTO_WAIT", "REINTENTO_SUMMARY",
+  "BACKLOG_FULL", "BACKLOG_MISSING", "BACKLOG_REBUILD", "BACKLOG_WARN",
+  "RET_COMPACT", "RET_PURGE", "RET_SUMMARY", "RET_ERR",
+  // red
+  "API_OK", "API_5XX", "API_CONN_ERR", "API_SKIP", "API_BREAKER", "API_BREAKER_WARN",
+  "MQTT_CONN_ERR", "MQTT_ERR", "WIFI_UP", "WIFI_WAIT",
+  // hora
+  "NTP_ERR", "NTP_SKIP", "NTP_WARN", "RTC_RESYNC", "RTC_SET_OK", "RTC_SET_ERR",
+  "RTC_OK", "RTC_ERR", "RTC_TIME_INVALID",
+  // sensores
+  "LECTURA_OK", "READ_OK", "READ_ERR",
+  // (añadir siempre al final)
+  "LOG_SUPPRESSED",
+  "RTC_FALLBACK", "RTC_SQW", "RTC_WARN",
+  "RTC_SYNC",
+  "LOOP_STATS",
+  "BACKLOG_RESCAN",
+  "ADC_RATE",
+};
+
+#define LOGBIN_N_MOD ((uint16_t)(sizeof(LOG_MODULOS) / sizeof(LOG_MODULOS[0])))
+#define LOGBIN_N_COD ((uint16_t)(sizeof(LOG_CODIGOS) / sizeof(LOG_CODIGOS[0])))
+
+// Posición de 's' en la tabla; 0 si no está
+inline uint16_t logbinId(const char* const* tabla, uint16_t n, const char* s) {
+  for (uint16_t i = 1; i < n; i++) {
+    if (tabla[i][0] == s[0] && strcmp(tabla[i], s) == 0) return i;
+  }
+  return 0;
+}
+
+struct LogBinEvento {
+  unsigned long long ts;   // µs
+  int16_t tzMin;           // offset de la hora local (solo en ABS)
+  uint8_t nivel;
+  const char* mod;
+  const char* code;
+  const char* kv;
+};
+
+inline void logbinCodificarCabecera(uint8_t out[LOGBIN_HDR_LEN], uint32_t fechaYmd) {
+  memset(out, 0, LOGBIN_HDR_LEN);
+  memcpy(out, LOGBIN_MAGIC, 4);
+  out[4] = LOGBIN_VERSION;
+  bkpPutU32(out + 8, fechaYmd);
+  bkpPutU16(out + 12, LOGBIN_N_MOD);
+  bkpPutU16(out + 14, LOGBIN_N_COD);
+}
+
+inline bool logbinCabeceraValida(const uint8_t in[LOGBIN_HDR_LEN]) {
+  return memcmp(in, LOGBIN_MAGIC, 4) == 0 && in[4] == LOGBIN_VERSION;
+}
+
+inline size_t logbinPutTexto(uint8_t* out, const char* const* tabla, uint16_t n, const char* s) {
+  uint16_t id = logbinId(tabla, n, s);
+  if (id) return varintPut(out, id);
+  size_t L = strnlen(s, LOGBIN_TEXTO_MAX);
+  size_t k = varintPut(out, 0);
+  k += varintPut(out + k, L);
+  memcpy(out + k, s, L);
+  return k + L;
+}
+
+// Codifica e en out (≥ LOGBIN_REG_MAX). 'prevTs' es el ts del registro anterior
+// del mismo buffer; se ignora si 'abs'. Devuelve los bytes escritos.
+inline size_t logbinCodificar(const LogBinEvento& e, bool abs, unsigned long long prevTs, uint8_t* out) {
+  uint8_t cuerpo[LOGBIN_REG_MAX];
+  size_t k = 0;
+  cuerpo[k++] = (uint8_t)((e.nivel & 0x03) | (abs ? LOGBIN_ABS : 0));
+  if (abs) {
+    k += varintPut(cuerpo + k, e.ts);
+    k += varintPut(cuerpo + k, zigzagCodificar(e.tzMin));
+  } else {
+    k += varintPut(cuerpo + k, zigzagCodificar((int64_t)(e.ts - prevTs)));
+  }
+  k += logbinPutTexto(cuerpo + k, LOG_MODULOS, LOGBIN_N_MOD, e.mod);
+  k += logbinPutTexto(cuerpo + k, LOG_CODIGOS, LOGBIN_N_COD, e.code);
+  size_t L = strnlen(e.kv, LOGBIN_KV_MAX);
+  k += varintPut(cuerpo + k, L);
+  memcpy(cuerpo + k, e.kv, L);
+  k += L;
+
+  size_t h = varintPut(out, k);
+  memcpy(out + h, cuerpo, k);
+  return h + k;
+}
+
+// Registro decodificado; mod/code/kv apuntan al buffer de entrada (sin '\0')
+// salvo los ids de tabla, que apuntan a la tabla.
+struct LogBinTexto {
+  uint16_t id;              // 0 = en línea; ≥ nTabla = id desconocido (firmware más nuevo)
+  const char* p;
+  size_t len;
+};
+
+struct LogBinRegistro {
+  bool abs;
+  uint8_t nivel;
+  unsigned long long ts;    // absoluto (ya aplicado el delta)
+  int16_t tzMin;            // último offset ABS visto
+  LogBinTexto mod, code, kv;
+};
+
+inline size_t logbinGetTexto(const uint8_t* p, const uint8_t* fin, const char* const* tabla, uint16_t n,
+                             LogBinTexto& t) {
+  uint64_t v;
+  size_t k = varintGet(p, fin, v);
+  if (!k) return 0;
+  t.id = (uint16_t)v;
+  if (v) {
+    t.p = (v < n) ? tabla[v] : nullptr;
+    t.len = t.p ? strlen(t.p) : 0;
+    return k;
+  }
+  size_t k2 = varintGet(p + k, fin, v);
+  if (!k2 || v > (uint64_t)(fin - p - k - k2)) return 0;
+  t.p = (const char*)(p + k + k2);
+  t.len = (size_t)v;
+  return k + k2 + (size_t)v;
+}
+
+// Decodifica un registro de [p, fin). 'r' trae el ts/tz del registro anterior
+// (delta). Devuelve los bytes consumidos, 0 si está truncado o mal formado.
+inline size_t logbinDecodificar(const uint8_t* p, const uint8_t* fin, LogBinRegistro& r) {
+  uint64_t len, v;
+  size_t h = varintGet(p, fin, len);
+  if (!h || len == 0 || len > (uint64_t)(fin - p - h)) return 0;
+  const uint8_t* q = p + h;
+  const uint8_t* f = q + len;
+  r.nivel = *q & 0x03;
+  r.abs = (*q & LOGBIN_ABS) != 0;
+  q++;
+  size_t k;
+  if (r.abs) {
+    if (!(k = varintGet(q, f, v))) return 0;
+    r.ts = v; q += k;
+    if (!(k = varintGet(q, f, v))) return 0;
+    r.tzMin = (int16_t)zigzagDecodificar(v); q += k;
+  } else {
+    if (!(k = varintGet(q, f, v))) return 0;
+    r.ts += (unsigned long long)zigzagDecodificar(v); q += k;
+  }
+  if (!(k = logbinGetTexto(q, f, LOG_MODULOS, LOGBIN_N_MOD, r.mod))) return 0;
+  q += k;
+  if (!(k = logbinGetTexto(q, f, LOG_CODIGOS, LOGBIN_N_COD, r.code))) return 0;
+  q += k;
+  if (!(k = varintGet(q, f, v)) || v != (uint64_t)(f - q - k)) return 0;
+  r.kv.id = 0;
+  r.kv.p = (const char*)(q + k);
+  r.kv.len = (size_t)v;
+  return h + (size_t)len;
+}
+
+#endif
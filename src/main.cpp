@@ -11,6 +11,11 @@ Config config = loadDefaultConfig();
 #include "sdlog.h"
 #include "sdbackup.h"
 #include "reenviarBackupSD.h"
+#include "backlog.h"
+#include "secuencia.h"
+#include "retencion.h"
+#include "uplink.h"
+#include "uplink_transport.h"
 #include "sensores_CAUDALIMETRO_YF-S201.h"
 #include "sensores_TERMOCUPLA_MAX6675.h"
 #include "sensores_VOLTAJE_ZMPT101B.h"
@@ -71,136 +76,164 @@ static inline unsigned long long ts_fallback_micros() {
 static uint8_t g_upCount = 0;
 static uint8_t g_failCount = 0;
 
+// Duración de cada vuelta del loop; resumen LOOP_STATS cada LOOP_STATS_MS
+#ifndef LOOP_STATS_MS
+#define LOOP_STATS_MS 60000UL
+#endif
+static uint32_t g_loopN = 0;
+static uint32_t g_loopMaxUs = 0;
+static uint64_t g_loopSumUs = 0;
+static unsigned long g_loopStatsMs = 0;
+
+static void loopStatsRegistrar(uint32_t us) {
+  g_loopN++;
+  g_loopSumUs += us;
+  if (us > g_loopMaxUs) g_loopMaxUs = us;
+  if (millis() - g_loopStatsMs < LOOP_STATS_MS) return;
+  LOGI("SYS", "LOOP_STATS", "n=%lu;avg_us=%lu;max_us=%lu;ntp=%d", (unsigned long)g_loopN,
+       (unsigned long)(g_loopSumUs / g_loopN), (unsigned long)g_loopMaxUs, ntpEnCurso() ? 1 : 0);
+  g_loopN = 0;
+  g_loopSumUs = 0;
+  g_loopMaxUs = 0;
+  g_loopStatsMs = millis();
+}
+
+// Publica una muestra en vivo: la encola hacia la tarea uplink (core 0) o,
+// si no hay WiFi, el transporte no está disponible (breaker abierto, broker
+// caído) o la cola está llena,
+// la respalda en SD sin esperar a la red.
+static void publicarMuestra(uint8_t sensorId, float valor, unsigned long long ts, bool nowReady) {
+  const SensorDef* def = sensorDef(sensorId);
+  if (!def) return;
+  const uint32_t seq = secuenciaSiguiente();
+  const char* reason = "no_wifi";
+  if (nowReady) {
+    reason = "uplink_down";
+    if (uplinkTransporte().disponible()) {
+      Sample s = { ts, valor, sensorId, ORIGEN_WIFI, seq };
+      if (uplinkEncolar(s)) return;
+      reason = "queue_full";
+    }
+  }
+  guardarEnBackupSD(def->measurement, def->sensor, valor, ts, "backup", seq);
+  LOGW("SD_BACKUP", "RESPALDO", "reason=%s;sensor=%s", reason, def->sensor);
+}
+
 void setup() {
   const uint32_t t0 = millis();
   Serial.begin(115200);
   delay(50);
   Serial.println(F("== Boot IoT ESP32 + DS3231 =="));
 
-  char kv[160];
-  snprintf(kv, sizeof(kv), "fw=%s;build=%s;heap=%luB", FW_VERSION, FW_BUILD, (unsigned long)ESP.getFreeHeap());
-  logEventoM("SYS", "BOOT_INFO", kv);
+  LOGI("SYS", "BOOT_INFO", "fw=%s;build=%s;heap=%luB", FW_VERSION, FW_BUILD, (unsigned long)ESP.getFreeHeap());
 
   wifiSetup(config.network.ssid, config.network.password);
-  initDS3231(config.pins.SDA, config.pins.SCL);
+  initDS3231(config.pins.SDA, config.pins.SCL, config.pins.RTC_SQW);
 
   inicializarSD();
   sdDisponible = (SD.cardType() != CARD_NONE);
-  if (sdDisponible) { logEventoM("SD", "MOD_UP",   "logger=v2"); g_upCount++; }
-  else              { logEventoM("SD", "MOD_FAIL", "err=not_detected"); g_failCount++; }
+  if (sdDisponible) { LOGI("SD", "MOD_UP",   "logger=v2"); g_upCount++; backlogIniciar(); }
+  else              { LOGE("SD", "MOD_FAIL", "err=not_detected"); g_failCount++; }
 
   if (!rtcIsPresent()) {
-    logEventoM("RTC", "RTC_ERR", "no_i2c");
-    logEventoM("RTC", "MOD_FAIL", "err=no_i2c");
+    LOGE("RTC", "RTC_ERR", "no_i2c");
+    LOGE("RTC", "MOD_FAIL", "err=no_i2c");
     g_failCount++;
   } else if (!rtcIsTimeValid()) {
-    logEventoM("RTC", "RTC_TIME_INVALID", "will_set_ntp");
-    logEventoM("RTC", "MOD_FAIL", "err=time_invalid");
+    LOGI("RTC", "RTC_TIME_INVALID", "will_set_ntp");
+    LOGE("RTC", "MOD_FAIL", "err=time_invalid");
     g_failCount++;
   } else {
-    logEventoM("RTC", "RTC_OK", "valid=1");
-    logEventoM("RTC", "MOD_UP", "source=RTC_only");
+    LOGI("RTC", "RTC_OK", "valid=1");
+    LOGI("RTC", "MOD_UP", "source=RTC_only");
     g_upCount++;
   }
 
   // === Inicialización de módulos ===
+  secuenciaIniciar();
+  uplinkIniciar();
   inicializarSensorCaudal();
   iniciarSPITermocupla(); // Inicializa HSPI dedicado
   inicializarSensorTermocupla();
   inicializarSensorVoltaje();
 
+  // La respuesta NTP llega como evento en el loop (ntpTick)
   if (wifiReady()) {
-    if (sincronizarNTP(5, 2000)) {
-      uint32_t unixNtp = (uint32_t)getTimestamp();
-      if (setRTCFromUnix(unixNtp)) {
-        logEventoM("NTP", "RTC_SET_OK", "phase=setup");
-        logEventoM("NTP", "MOD_UP", "phase=setup");
-        g_upCount++;
-      } else {
-        logEventoM("NTP", "RTC_SET_ERR", "phase=setup");
-        logEventoM("NTP", "MOD_FAIL", "err=set_rtc");
-        g_failCount++;
-      }
-    } else {
-      logEventoM("NTP", "NTP_ERR", "phase=setup");
-      logEventoM("NTP", "MOD_FAIL", "err=ntp_sync");
-      g_failCount++;
-    }
+    ntpSolicitar("setup");
   } else {
-    logEventoM("WIFI", "WIFI_WAIT", "ntp_initial");
-    logEventoM("WIFI", "MOD_FAIL", "err=no_ip_boot");
+    LOGI("WIFI", "WIFI_WAIT", "ntp_initial");
+    LOGE("WIFI", "MOD_FAIL", "err=no_ip_boot");
     g_failCount++;
   }
 
   lastSyncMs = millis();
   estadoActual = sdDisponible ? IDLE : ERROR_RECUPERABLE;
 
-  snprintf(kv, sizeof(kv), "up=%u;fail=%u;elapsed_ms=%lu", (unsigned)g_upCount, (unsigned)g_failCount, (unsigned long)(millis() - t0));
-  logEventoM("SYS", "STARTUP_SUMMARY", kv);
-  logEventoM("SYS", "BOOT", "device_start");
+  LOGI("SYS", "STARTUP_SUMMARY", "up=%u;fail=%u;elapsed_ms=%lu", (unsigned)g_upCount, (unsigned)g_failCount, (unsigned long)(millis() - t0));
+  LOGI("SYS", "BOOT", "device_start");
 }
 
 // ================== LOOP ==================
 void loop() {
+  const uint32_t tLoop0 = micros();
+
+  // Reloj por software (flancos SQW / relectura del RTC)
+  relojTick();
+  // Totalizador de caudal (cuenta también fuera de la ventana)
+  caudalTick();
+
   // Watchdog WiFi (no bloqueante)
   wifiLoop();
 
+  // Respaldo en SD de lo que la tarea uplink no pudo enviar
+  uplinkDrenarRespaldo();
+  backupTick();
+  backlogTick();
+  logTick();
+
   // Flanco de subida WiFi
   bool nowReady = wifiReady();
   if (nowReady && !wasWifiReady) {
     if (millis() - lastRetryScanMs > MIN_RETRY_SCAN_GAP_MS) {
       kickReintentoBackups = true;
       lastRetryScanMs = millis();
-      logEventoM("WIFI", "WIFI_UP", "reintentos_backup=1");
+      LOGI("WIFI", "WIFI_UP", "reintentos_backup=1");
     }
 
     // Sincronizar NTP al tener WiFi
-    bool ntp_ok = sincronizarNTP(4, 800);
-    if (ntp_ok) {
-      uint32_t unixNtp = (uint32_t)getTimestamp();
-      if (setRTCFromUnix(unixNtp)) {
-        logEventoM("NTP", "RTC_SET_OK", "phase=wifi_up");
-        logEventoM("NTP", "MOD_UP", "phase=wifi_up");
-      } else {
-        logEventoM("NTP", "RTC_SET_ERR", "phase=wifi_up");
-        logEventoM("NTP", "MOD_FAIL", "err=set_rtc_wifiup");
-      }
-    } else {
-      logEventoM("NTP", "NTP_ERR", "phase=wifi_up");
-      logEventoM("NTP", "MOD_FAIL", "err=ntp_sync_wifiup");
-    }
+    ntpSolicitar("wifi_up");
   }
   wasWifiReady = nowReady;
 
   // Retry NTP si RTC inválido
-  if (nowReady && !rtcIsTimeValid() && (millis() - lastInvalidRtcSyncTryMs > INVALID_RTC_SYNC_RETRY_MS)) {
+  if (nowReady && !rtcIsTimeValid() && !ntpEnCurso() &&
+      (millis() - lastInvalidRtcSyncTryMs > INVALID_RTC_SYNC_RETRY_MS)) {
     lastInvalidRtcSyncTryMs = millis();
-    bool ntp_ok = sincronizarNTP(3, 800);
-    if (ntp_ok) {
-      uint32_t unixNtp = (uint32_t)getTimestamp();
-      if (setRTCFromUnix(unixNtp)) {
-        logEventoM("NTP", "RTC_SET_OK", "phase=retry_invalid");
-        logEventoM("NTP", "MOD_UP", "phase=retry_invalid");
-      } else {
-        logEventoM("NTP", "RTC_SET_ERR", "phase=retry_invalid");
-        logEventoM("NTP", "MOD_FAIL", "err=set_rtc_retry");
-      }
-    } else {
-      logEventoM("NTP", "NTP_WARN", "retry_with_invalid_rtc");
-    }
+    ntpSolicitar("retry_invalid");
   }
 
   // Resincronización periódica
   if ((millis() - lastSyncMs) > SYNC_PERIOD_MS && nowReady) {
-    bool ntp_ok = sincronizarNTP(2, 1500);
-    if (ntp_ok) {
-      uint32_t unixNtp = (uint32_t)getTimestamp();
-      keepRTCInSyncWithNTP(true, unixNtp);
-      logEventoM("NTP", "RTC_RESYNC", "periodic");
+    ntpSolicitar("periodic");
+    lastSyncMs = millis();
+  }
+
+  // Respuesta NTP (evento): disciplina el reloj sin parar las ventanas
+  NtpResultado ntp;
+  if (ntpTick(ntp)) {
+    if (!ntp.ok) {
+      LOGW("NTP", "NTP_WARN", "phase=%s;rtc_valid=%d", ntp.fase, rtcIsTimeValid() ? 1 : 0);
+    } else if (keepRTCInSyncWithNTP(true, ntp.us)) {
+      LOGI("NTP", "RTC_SET_OK", "phase=%s", ntp.fase);
+      // Calidad del reloj como series: offset medido y deriva compensada
+      const RelojEstado reloj = relojEstado();
+      const unsigned long long ts = getTimestampMicros();
+      publicarMuestra(SENSOR_RELOJ_OFFSET, reloj.offsetUs / 1000.0f, ts, nowReady);
+      publicarMuestra(SENSOR_RELOJ_DERIVA, reloj.derivaPpb / 1000.0f, ts, nowReady);
     } else {
-      logEventoM("NTP", "NTP_WARN", "periodic_resync_failed");
+      LOGE("NTP", "RTC_SET_ERR", "phase=%s", ntp.fase);
+      LOGE("NTP", "MOD_FAIL", "err=set_rtc;phase=%s", ntp.fase);
     }
-    lastSyncMs = millis();
   }
 
   // Segundo del minuto (con fallback si RTC inválido)
@@ -210,8 +243,7 @@ void loop() {
   static unsigned long long timestamp = 0ULL;
 
   if (estadoActual != estadoAnterior) {
-    char kv[24]; snprintf(kv, sizeof(kv), "state=%d", (int)estadoActual);
-    logEventoM("FSM", "FSM_STATE", kv);
+    LOGI("FSM", "FSM_STATE", "state=%d", (int)estadoActual);
     estadoAnterior = estadoActual;
   }
 
@@ -234,13 +266,17 @@ void loop() {
         lastRetryScanMs = millis();
         estadoActual = REINTENTO_BACKUP;
 
-      } else if (nowReady && hayBackupsPendientes()) {
+      } else if (nowReady && (reenvioEnCurso() || (uplinkTransporte().disponible() && hayBackupsPendientes()))) {
         lastRetryScanMs = millis();
         estadoActual = REINTENTO_BACKUP;
 
       } else if (nowReady && (millis() - lastRetryScanMs > 30000)) {
         lastRetryScanMs = millis();
         estadoActual = REINTENTO_BACKUP;
+
+      } else if (sdDisponible) {
+        // Fuera de las ventanas de muestreo: un paso corto de retención
+        retencionTick();
       }
       break;
     }
@@ -253,28 +289,22 @@ void loop() {
           unsigned long long ts_fb = ts_fallback_micros();
           actualizarCaudal();
           float caudal = obtenerCaudalLPM();
-          guardarEnBackupSD("caudal", "YF-S201", caudal, ts_fb, "backup");
-          logEventoM("SD_BACKUP", "TS_INVALID_BACKUP", "sensor=YF-S201");
+          guardarEnBackupSD("caudal", "YF-S201", caudal, ts_fb, "backup", secuenciaSiguiente());
+          LOGW("SD_BACKUP", "TS_INVALID_BACKUP", "sensor=YF-S201");
         } else {
           actualizarCaudal();
-          float caudal = obtenerCaudalLPM();
-
-          if (nowReady) {
-            bool ok = enviarDatoAPI("caudal", "YF-S201", caudal, timestamp, "wifi");
-            if (!ok) {
-              guardarEnBackupSD("caudal", "YF-S201", caudal, timestamp, "backup");
-              logEventoM("SD_BACKUP", "RESPALDO", "reason=api_fail;sensor=YF-S201");
-            } else {
-              logEventoM("API", "API_OK", String("sensor=YF-S201;valor=" + String(caudal)).c_str());
-            }
-          } else {
-            guardarEnBackupSD("caudal", "YF-S201", caudal, timestamp, "backup");
-            logEventoM("SD_BACKUP", "RESPALDO", "reason=no_wifi;sensor=YF-S201");
-          }
+          publicarMuestra(SENSOR_CAUDAL, obtenerCaudalLPM(), timestamp, nowReady);
         }
         ultimoEnvioCaudal = millis();
       }
       if (segundo > config.timing.window_caudal) {
+        // Volumen acumulado en L enteros (exacto en float), una vez por
+        // ventana; sin hora válida lo lleva la siguiente
+        timestamp = getTimestampMicros();
+        if (timestamp != TS_INVALIDO_1 && timestamp != TS_INVALIDO_2) {
+          publicarMuestra(SENSOR_CAUDAL_TOTAL, (float)caudalTotalLitrosEnteros(), timestamp, nowReady);
+        }
+        uplinkFlush();
         detenerLecturaCaudal();
         estadoActual = IDLE;
       }
@@ -287,23 +317,12 @@ void loop() {
         unsigned long long ts_fb = ts_fallback_micros();
         actualizarTermocupla();
         float temp = obtenerTemperatura();
-        guardarEnBackupSD("temperatura", "MAX6675", temp, ts_fb, "backup");
-        logEventoM("SD_BACKUP", "TS_INVALID_BACKUP", "sensor=MAX6675");
+        guardarEnBackupSD("temperatura", "MAX6675", temp, ts_fb, "backup", secuenciaSiguiente());
+        LOGW("SD_BACKUP", "TS_INVALID_BACKUP", "sensor=MAX6675");
       } else {
         actualizarTermocupla();
-        float temp = obtenerTemperatura();
-        if (nowReady) {
-          bool ok = enviarDatoAPI("temperatura", "MAX6675", temp, timestamp, "wifi");
-          if (!ok) {
-            guardarEnBackupSD("temperatura", "MAX6675", temp, timestamp, "backup");
-            logEventoM("SD_BACKUP", "RESPALDO", "reason=api_fail;sensor=MAX6675");
-          } else {
-            logEventoM("API", "API_OK", String("sensor=MAX6675;valor=" + String(temp)).c_str());
-          }
-        } else {
-          guardarEnBackupSD("temperatura", "MAX6675", temp, timestamp, "backup");
-          logEventoM("SD_BACKUP", "RESPALDO", "reason=no_wifi;sensor=MAX6675");
-        }
+        publicarMuestra(SENSOR_TEMPERATURA, obtenerTemperatura(), timestamp, nowReady);
+        uplinkFlush();
       }
       estadoActual = IDLE;
       break;
@@ -311,27 +330,25 @@ void loop() {
 
     case LECTURA_VOLTAJE: {
       timestamp = getTimestampMicros();
-      if (timestamp == TS_INVALIDO_1 || timestamp == TS_INVALIDO_2) {
+      if (!actualizarVoltaje()) {
+        // Sin ventana nueva: no se republica la anterior con marca nueva
+      } else if (timestamp == TS_INVALIDO_1 || timestamp == TS_INVALIDO_2) {
         unsigned long long ts_fb = ts_fallback_micros();
-        actualizarVoltaje();
         float volt = obtenerVoltajeAC();
-        guardarEnBackupSD("voltaje", "ZMPT101B", volt, ts_fb, "backup");
-        logEventoM("SD_BACKUP", "TS_INVALID_BACKUP", "sensor=ZMPT101B");
+        guardarEnBackupSD("voltaje", "ZMPT101B", volt, ts_fb, "backup", secuenciaSiguiente());
+        LOGW("SD_BACKUP", "TS_INVALID_BACKUP", "sensor=ZMPT101B");
       } else {
-        actualizarVoltaje();
-        float volt = obtenerVoltajeAC();
-        if (nowReady) {
-          bool ok = enviarDatoAPI("voltaje", "ZMPT101B", volt, timestamp, "wifi");
-          if (!ok) {
-            guardarEnBackupSD("voltaje", "ZMPT101B", volt, timestamp, "backup");
-            logEventoM("SD_BACKUP", "RESPALDO", "reason=api_fail;sensor=ZMPT101B");
-          } else {
-            logEventoM("API", "API_OK", String("sensor=ZMPT101B;valor=" + String(volt)).c_str());
-          }
-        } else {
-          guardarEnBackupSD("voltaje", "ZMPT101B", volt, timestamp, "backup");
-          logEventoM("SD_BACKUP", "RESPALDO", "reason=no_wifi;sensor=ZMPT101B");
+        publicarMuestra(SENSOR_VOLTAJE, obtenerVoltajeAC(), timestamp, nowReady);
+        // Análisis de la misma ventana, como series hermanas con la misma marca
+        AcResultado ac = obtenerAnalisisVoltaje();
+        if (ac.valido) {
+          publicarMuestra(SENSOR_VOLTAJE_FRECUENCIA, ac.frecuenciaHz, timestamp, nowReady);
+          publicarMuestra(SENSOR_VOLTAJE_CRESTA, ac.cresta, timestamp, nowReady);
+          publicarMuestra(SENSOR_VOLTAJE_THD, ac.thd * 100.0f, timestamp, nowReady);
+          publicarMuestra(SENSOR_VOLTAJE_H3, ac.armonicos[3] * 100.0f, timestamp, nowReady);
+          publicarMuestra(SENSOR_VOLTAJE_H5, ac.armonicos[5] * 100.0f, timestamp, nowReady);
         }
+        uplinkFlush();
       }
       estadoActual = nowReady ? REINTENTO_BACKUP : IDLE;
       break;
@@ -341,13 +358,13 @@ void loop() {
       if (sdDisponible && nowReady) {
         static unsigned long lastRetryLogMs = 0;
         if (millis() - lastRetryLogMs > 10000) {
-          logEventoM("SD_BACKUP", "REINTENTO_INFO", "scan=1");
+          LOGI("SD_BACKUP", "REINTENTO_INFO", "scan=1");
           lastRetryLogMs = millis();
         }
         reenviarDatosDesdeBackup();
       } else if (!nowReady) {
         if (millis() - lastNoWifiLogMs > NO_WIFI_LOG_EVERY_MS) {
-          logEventoM("SD_BACKUP", "REINTENTO_WAIT", "no_wifi");
+          LOGI("SD_BACKUP", "REINTENTO_WAIT", "no_wifi");
           lastNoWifiLogMs = millis();
         }
       }
@@ -358,10 +375,13 @@ void loop() {
 
     case ERROR_RECUPERABLE: {
       delay(1000);
+      backupCerrar();
+      retencionAbortar();
       inicializarSD();
       sdDisponible = (SD.cardType() != CARD_NONE);
       if (sdDisponible) {
-        logEventoM("SD", "SD_OK", "reinit_after_error");
+        LOGI("SD", "SD_OK", "reinit_after_error");
+        backlogIniciar();
         reintentarLogsPendientes();
         estadoActual = IDLE;
       }
@@ -372,49 +392,13 @@ void loop() {
       estadoActual = IDLE;
       break;
   }
-}
-
-// ================== DETECCIÓN DE BACKUPS ==================
-static bool leerIdxLocal(const String& idxPath, uint32_t& off) {
-  if (!SD.exists(idxPath)) return false;
-  File f = SD.open(idxPath, FILE_READ);
-  if (!f) return false;
-  String s = f.readStringUntil('\n'); f.close();
-  s.trim();
-  if (!s.length()) return false;
-  off = (uint32_t)strtoul(s.c_str(), nullptr, 10);
-  return true;
-}
 
-static String rootSlash(const String& p) {
-  return (p.length() && p[0]=='/') ? p : ("/" + p);
+  loopStatsRegistrar(micros() - tLoop0);
 }
 
+// ================== DETECCIÓN DE BACKUPS ==================
+// Consulta el espejo en RAM del manifiesto (backlog.h): no toca la SD.
 bool hayBackupsPendientes() {
   if (!sdDisponible) return false;
-
-  File root = SD.open("/");
-  if (!root) return false;
-
-  bool pendiente = false;
-  while (true) {
-    File e = root.openNextFile();
-    if (!e) break;
-    String name = e.name(); e.close();
-
-    if (!name.startsWith("backup_") || !name.endsWith(".csv")) continue;
-    if (name.indexOf("1970") >= 0) continue;
-
-    String path = rootSlash(name);
-    File csv = SD.open(path, FILE_READ);
-    if (!csv) continue;
-    uint32_t size = csv.size();
-    csv.close();
-
-    uint32_t off = 0;
-    if (!leerIdxLocal(path + ".idx", off)) { pendiente = true; break; }
-    if (off < size)                 { pendiente = true; break; }
-  }
-  root.close();
-  return pendiente;
+  return backlogHayPendientes();
 }
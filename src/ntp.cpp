@@ -3,34 +3,79 @@
 #include "wifi_mgr.h"
 #include "config.h"
 #include <time.h>
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
 
-bool sincronizarNTP(uint8_t intentosMax, uint16_t tiempoEntreIntentos) {
-  uint32_t t0 = millis();
-  while (!wifiReady() && millis() - t0 < 5000) delay(100);
+// El callback corre en la tarea de lwIP: solo deja la hora y el instante.
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool g_respuesta = false;
+static unsigned long long g_respUs = 0;
+static int64_t g_respEsp = 0;
+
+static bool g_enCurso = false;
+static const char* g_fase = "";
+static unsigned long g_t0 = 0;
+
+static void alSincronizar(struct timeval* tv) {
+  int64_t esp = esp_timer_get_time();
+  portENTER_CRITICAL(&g_mux);
+  g_respUs = (unsigned long long)tv->tv_sec * 1000000ULL + (unsigned long long)tv->tv_usec;
+  g_respEsp = esp;
+  g_respuesta = true;
+  portEXIT_CRITICAL(&g_mux);
+}
+
+bool ntpSolicitar(const char* fase) {
+  if (g_enCurso) return false;
   if (!wifiReady()) {
-    Serial.println("[NTP] No hay WiFi; omito sincronización.");
-    logEventoM("NTP", "NTP_SKIP", "reason=no_wifi");
+    LOGI("NTP", "NTP_SKIP", "reason=no_wifi;phase=%s", fase);
     return false;
   }
-
+  portENTER_CRITICAL(&g_mux);
+  g_respuesta = false;
+  portEXIT_CRITICAL(&g_mux);
+  sntp_set_time_sync_notification_cb(alSincronizar);
   configTime(config.ntp.gmtOffset, config.ntp.dstOffset, config.ntp.servidor.c_str());
+  g_enCurso = true;
+  g_fase = fase;
+  g_t0 = millis();
+  return true;
+}
+
+bool ntpEnCurso() { return g_enCurso; }
 
-  struct tm timeinfo;
-  for (uint8_t i = 0; i < intentosMax; i++) {
-    delay(tiempoEntreIntentos);
-    if (getLocalTime(&timeinfo)) {
-      Serial.println("Tiempo sincronizado:");
-      Serial.println(&timeinfo, "%A, %d %B %Y %H:%M:%S");
-      logEventoM("NTP", "MOD_UP", "phase=sync");
-      return true;
-    }
+bool ntpTick(NtpResultado& r) {
+  if (!g_enCurso) return false;
+
+  portENTER_CRITICAL(&g_mux);
+  bool ok = g_respuesta;
+  unsigned long long us = g_respUs;
+  int64_t esp = g_respEsp;
+  portEXIT_CRITICAL(&g_mux);
+
+  const uint32_t ms = millis() - g_t0;
+  if (!ok && ms < NTP_TIMEOUT_MS) return false;
+
+  g_enCurso = false;
+  r.ok = ok;
+  r.fase = g_fase;
+  r.duracionMs = ms;
+  r.us = ok ? us + (unsigned long long)(esp_timer_get_time() - esp) : 0ULL;
+  if (ok) {
+    LOGI("NTP", "MOD_UP", "phase=%s;ms=%lu", g_fase, (unsigned long)ms);
+  } else {
+    LOGE("NTP", "NTP_ERR", "err=sync_timeout;phase=%s;ms=%lu", g_fase, (unsigned long)ms);
   }
-  Serial.println("[NTP] Fallo al sincronizar con NTP");
-  logEventoM("NTP", "NTP_ERR", "err=sync_timeout");
-  logEventoM("NTP", "MOD_FAIL", "err=sync_timeout");
-  return false;
+  return true;
 }
 
 time_t getTimestamp() {
   return time(nullptr);
-}
\ No newline at end of file
+}
+
+unsigned long long getTimestampNtpMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (unsigned long long)tv.tv_sec * 1000000ULL + (unsigned long long)tv.tv_usec;
+}
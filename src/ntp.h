@@ -3,7 +3,30 @@
 
 #include <Arduino.h>
 
-bool sincronizarNTP(uint8_t intentosMax = 3, uint16_t tiempoEntreIntentos = 5000);
+// Sincronización NTP no bloqueante. ntpSolicitar() arranca SNTP y vuelve al
+// momento; el callback de SNTP marca la respuesta y ntpTick(), llamado desde
+// el loop, la entrega como evento (o el fallo tras NTP_TIMEOUT_MS).
+
+#ifndef NTP_TIMEOUT_MS
+#define NTP_TIMEOUT_MS 15000UL
+#endif
+
+struct NtpResultado {
+  bool ok;
+  unsigned long long us;    // hora NTP en µs en el momento de la entrega (si ok)
+  const char* fase;         // la pasada a ntpSolicitar()
+  uint32_t duracionMs;
+};
+
+// Pide una sincronía. false si no hay WiFi o ya hay una en curso.
+bool ntpSolicitar(const char* fase);
+bool ntpEnCurso();
+
+// true una vez por solicitud, cuando hay respuesta o vence el plazo.
+bool ntpTick(NtpResultado& r);
+
 time_t getTimestamp();
+// Hora del sistema (NTP) en µs, sin truncar al segundo
+unsigned long long getTimestampNtpMicros();
 
 #endif
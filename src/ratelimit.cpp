@@ -0,0 +1,122 @@
+#include "ratelimit.h"
+#include <stdio.h>
+#include <string.h>
+
+static_assert((RL_SLOTS & (RL_SLOTS - 1)) == 0, "RL_SLOTS debe ser potencia de 2");
+static_assert(RL_SONDAS <= RL_SLOTS, "RL_SONDAS > RL_SLOTS");
+static_assert((RL_TEXTOS & (RL_TEXTOS - 1)) == 0, "RL_TEXTOS debe ser potencia de 2");
+
+static const uint32_t CREDITO_MAX = RL_RAFAGA * RL_PERIODO_MS;
+static_assert(RL_RAFAGA * RL_PERIODO_MS <= 0xFFFF, "el crédito es de 16 bits");
+
+struct RlEntrada {
+  uint32_t hash;            // 0 = libre
+  uint32_t recargaMs;       // última recarga del crédito = último acceso (LRU)
+  uint32_t pasoMs;          // último evento que pasó
+  uint16_t credito;         // ms acumulados; cada evento cuesta RL_PERIODO_MS
+  uint16_t suprimidos;
+};
+
+// Texto de las claves con retenidos, para LOG_SUPPRESSED
+struct RlTexto {
+  uint32_t hash;
+  char clave[RL_CLAVE_LEN];
+};
+
+static RlEntrada g_tabla[RL_SLOTS];
+static RlTexto g_textos[RL_TEXTOS];
+static uint16_t g_ocupadas = 0;
+static uint32_t g_desalojos = 0;
+static uint32_t g_perdidos = 0;
+static uint16_t g_cursor = 0;   // rlResumen()
+
+static uint32_t fnv1a(const char* s) {
+  uint32_t h = 2166136261u;
+  while (*s) { h ^= (uint8_t)*s++; h *= 16777619u; }
+  return h ? h : 1;   // 0 marca entrada libre
+}
+
+// Índice con los bits altos: los de la tabla salen de los bajos
+static RlTexto& textoDe(uint32_t h) {
+  return g_textos[(h >> 16) & (RL_TEXTOS - 1)];
+}
+
+static RlEntrada* buscar(const char* clave, uint32_t ahoraMs) {
+  const uint32_t h = fnv1a(clave);
+  RlEntrada* libre = nullptr;
+  RlEntrada* lru = nullptr;
+  for (uint16_t i = 0; i < RL_SONDAS; i++) {
+    RlEntrada& e = g_tabla[(h + i) & (RL_SLOTS - 1)];
+    if (e.hash == h) return &e;
+    if (!e.hash) { if (!libre) libre = &e; continue; }
+    if (!lru || (ahoraMs - e.recargaMs) > (ahoraMs - lru->recargaMs)) lru = &e;
+  }
+
+  // Con la tabla llena no se sabe si la clave ya estuvo y fue desalojada: en
+  // vez de una ráfaga entera estrena crédito para un solo evento
+  RlEntrada* e = libre;
+  uint16_t credito = (uint16_t)CREDITO_MAX;
+  if (e) {
+    g_ocupadas++;
+  } else {
+    e = lru;
+    g_desalojos++;
+    g_perdidos += e->suprimidos;
+    credito = (uint16_t)RL_PERIODO_MS;
+  }
+  e->hash = h;
+  e->recargaMs = ahoraMs;
+  e->credito = credito;
+  e->pasoMs = ahoraMs;
+  e->suprimidos = 0;
+  return e;
+}
+
+bool rlPermitir(const char* clave, uint32_t ahoraMs, uint16_t& suprimidos) {
+  RlEntrada& e = *buscar(clave, ahoraMs);
+
+  uint32_t dt = ahoraMs - e.recargaMs;
+  e.recargaMs = ahoraMs;
+  e.credito = (uint16_t)((dt >= CREDITO_MAX - e.credito) ? CREDITO_MAX : e.credito + dt);
+
+  if (e.credito < RL_PERIODO_MS) {
+    if (e.suprimidos == 0) {
+      RlTexto& t = textoDe(e.hash);
+      t.hash = e.hash;
+      strncpy(t.clave, clave, RL_CLAVE_LEN - 1);
+      t.clave[RL_CLAVE_LEN - 1] = '\0';
+    }
+    if (e.suprimidos < 0xFFFF) e.suprimidos++;
+    suprimidos = 0;
+    return false;
+  }
+  e.credito -= RL_PERIODO_MS;
+  e.pasoMs = ahoraMs;
+  suprimidos = e.suprimidos;
+  e.suprimidos = 0;
+  return true;
+}
+
+bool rlResumen(uint32_t ahoraMs, char* clave, size_t n, uint16_t& suprimidos) {
+  for (uint16_t i = 0; i < RL_RESUMEN_PASO; i++) {
+    RlEntrada& e = g_tabla[g_cursor];
+    g_cursor = (g_cursor + 1) & (RL_SLOTS - 1);
+    if (!e.hash || !e.suprimidos || ahoraMs - e.pasoMs < RL_RESUMEN_MS) continue;
+    const RlTexto& t = textoDe(e.hash);
+    if (t.hash == e.hash) {
+      strncpy(clave, t.clave, n - 1);
+      clave[n - 1] = '\0';
+    } else {
+      snprintf(clave, n, "#%08lx", (unsigned long)e.hash);
+    }
+    suprimidos = e.suprimidos;
+    e.suprimidos = 0;
+    e.pasoMs = ahoraMs;
+    return true;
+  }
+  return false;
+}
+
+RlStats rlStats() {
+  return RlStats{ g_ocupadas, g_desalojos, g_perdidos };
+}
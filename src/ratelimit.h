@@ -0,0 +1,74 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+// Limitador de eventos repetidos de logEventoM() por clave "mod|code".
+//
+// Tabla fija de RL_SLOTS entradas de 16 B con direccionamiento abierto: la
+// clave se busca por su hash FNV-1a de 32 bits (la entrada no guarda el texto)
+// en como mucho RL_SONDAS posiciones consecutivas. Si no está y no hay hueco en
+// esas posiciones, se reemplaza la usada hace más tiempo (LRU dentro de la
+// ventana de sondeo). La clave que entra desalojando a otra estrena crédito
+// para un solo evento, no una ráfaga: si ella misma había sido desalojada no
+// recupera los eventos que ya gastó. Coste por llamada acotado (como mucho
+// RL_SONDAS comparaciones), aunque crece con la ocupación de la tabla.
+//
+// Capacidad: hasta RL_SLOTS / 2 claves el límite es exacto por clave; por
+// encima los desalojos lo degradan mucho: con tantas claves como entradas el
+// error por clave ya ronda el 10 %, y con más llega al 50-95 %
+// (tools/ratelimit_bench). El firmware usa unas 85 claves
+// mod|code: 256 entradas (4 KB) dejan margen. El primer desalojo se avisa con
+// LOG,MOD_WARN,err=rl_lleno.
+//
+// El texto de la clave solo hace falta para LOG_SUPPRESSED: se copia a una
+// tabla de RL_TEXTOS entradas (indexada por hash) al retener su primer evento.
+// Si otra clave lo pisó, el resumen sale como "#<hash>".
+//
+// Cada clave tiene un token bucket: RL_RAFAGA eventos seguidos y después uno
+// cada RL_PERIODO_MS. Los retenidos se cuentan; el siguiente que pasa los
+// informa (count=N) y, si la clave se calla, rlResumen() los devuelve pasado
+// RL_RESUMEN_MS para la línea LOG_SUPPRESSED.
+// Sin dependencias de Arduino (el tiempo lo pasa el llamador).
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RL_SLOTS
+#define RL_SLOTS 256           // potencia de 2; 16 B por entrada (4 KB)
+#endif
+#ifndef RL_SONDAS
+#define RL_SONDAS 8
+#endif
+#ifndef RL_PERIODO_MS
+#define RL_PERIODO_MS 2000UL   // un evento por clave cada RL_PERIODO_MS...
+#endif
+#ifndef RL_RAFAGA
+#define RL_RAFAGA 3            // ...tras una ráfaga de hasta RL_RAFAGA
+#endif
+#ifndef RL_RESUMEN_MS
+#define RL_RESUMEN_MS 60000UL  // retenidos sin evento posterior → LOG_SUPPRESSED
+#endif
+#ifndef RL_RESUMEN_PASO
+#define RL_RESUMEN_PASO 32     // entradas revisadas por llamada a rlResumen()
+#endif
+#ifndef RL_TEXTOS
+#define RL_TEXTOS 32           // potencia de 2; claves con retenidos por informar
+#endif
+
+#define RL_CLAVE_LEN 40
+
+// true si el evento de 'clave' pasa. En 'suprimidos' devuelve los retenidos
+// desde el último que pasó (0 si no hubo), que quedan a cero.
+bool rlPermitir(const char* clave, uint32_t ahoraMs, uint16_t& suprimidos);
+
+// Revisa RL_RESUMEN_PASO entradas; true si una tiene retenidos sin informar
+// desde hace RL_RESUMEN_MS (copia la clave y los pone a cero).
+bool rlResumen(uint32_t ahoraMs, char* clave, size_t n, uint16_t& suprimidos);
+
+struct RlStats {
+  uint16_t claves;          // entradas ocupadas
+  uint32_t desalojos;       // claves reemplazadas por LRU
+  uint32_t perdidos;        // retenidos de claves desalojadas antes de informarlos
+};
+RlStats rlStats();
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef RAW_PACK_H
+#define RAW_PACK_H
+
+// Archivo mensual de backups ya enviados (/sent/arch/raw_YYYYMM.oxz). La
+// retención (retencion.cpp) compacta aquí los /sent/raw/ antiguos.
+//
+//   Cabecera (16 B): "OXPK" | version u8 | reservado (3 B) | mes u32 (YYYYMM) | reservado u32
+//   Segmento v2, uno por backup compactado:
+//     cabecera (32 B): "OXS2" | fecha u32 (YYYYMMDD, 0 = unsync) | fmt u8 (0 csv, 1 bin) |
+//                      reservado (3 B) | n u32 | len u32 | nAck u32 | reservado u32 |
+//                      crc16 del payload | crc16 de los 30 B anteriores
+//     payload (len B): nAck confirmaciones y después n registros, delta + varint (varint.h)
+//   Confirmación: zz(Δinicio) | fin - inicio | zz(Δts_envio µs)
+//     las entradas de /sent/ack.jrn de ese backup, en el orden del diario
+//   Registro: zz(Δts µs) | (sensor << 1 | origen backup) | zz(Δvalor en centésimas,
+//             respecto al anterior del mismo sensor) | zz(Δseq) | zz(Δoffset)
+//     offset = byte del backup original donde empieza el registro, para
+//     situarlo en los rangos [inicio, fin) de las confirmaciones
+//
+// Segmento v1 ("OXSG", cabecera de 24 B sin nAck): solo registros y sin
+// offset; se sigue leyendo. Un mensual puede mezclar ambos.
+//
+// El valor se guarda con 2 decimales, la misma resolución que se envía. Un
+// segmento a medias (corte al añadirlo) no pasa los CRC; el lector busca la
+// siguiente cabecera. Si un backup aparece dos veces (corte entre el añadido
+// y el borrado del original) vale el último segmento completo.
+// Sin dependencias de Arduino.
+
+#include <math.h>
+#include "backup_record.h"   // BackupRecord, bkpCrc16, bkpPut*/bkpGet*
+#include "varint.h"
+
+#define PACK_MAGIC        "OXPK"
+#define PACK_VERSION      2
+#define PACK_HDR_LEN      16
+#define PACK_SEG_MAGIC    "OXS2"
+#define PACK_SEG_LEN      32
+#define PACK_SEG_MAGIC_V1 "OXSG"
+#define PACK_SEG_LEN_V1   24
+#define PACK_REG_MAX      32    // bytes máximos de un registro o confirmación codificados
+#define PACK_SENSORES     32    // Δvalor por sensor (id % PACK_SENSORES)
+
+struct PackSegmento {
+  uint8_t version;              // 1 o 2 (formato de la cabecera y los registros)
+  uint32_t fecha;
+  bool binario;                 // formato del backup de origen
+  uint32_t n;                   // registros
+  uint32_t len;                 // bytes de payload
+  uint32_t nAck;                // confirmaciones (v2)
+  uint16_t crc;                 // CRC16 del payload
+};
+
+// Rango del backup original confirmado en un envío (ack_journal.h)
+struct PackAck {
+  uint32_t inicio;
+  uint32_t fin;
+  unsigned long long tsEnvio;   // µs UNIX
+};
+
+// Estado del delta; se reinicia al empezar cada segmento
+struct PackEstado {
+  unsigned long long ts;
+  uint32_t seq;
+  uint32_t offset;
+  int32_t valor[PACK_SENSORES];
+  uint32_t ackInicio;
+  unsigned long long ackTs;
+};
+
+inline void packReiniciar(PackEstado& e) { memset(&e, 0, sizeof(e)); }
+
+inline void packCodificarCabecera(uint8_t out[PACK_HDR_LEN], uint32_t mesYm) {
+  memset(out, 0, PACK_HDR_LEN);
+  memcpy(out, PACK_MAGIC, 4);
+  out[4] = PACK_VERSION;
+  bkpPutU32(out + 8, mesYm);
+}
+
+inline bool packCabeceraValida(const uint8_t in[PACK_HDR_LEN]) {
+  return memcmp(in, PACK_MAGIC, 4) == 0 && (in[4] == 1 || in[4] == PACK_VERSION);
+}
+
+// Siempre v2
+inline void packCodificarSegmento(const PackSegmento& s, uint8_t out[PACK_SEG_LEN]) {
+  memset(out, 0, PACK_SEG_LEN);
+  memcpy(out, PACK_SEG_MAGIC, 4);
+  bkpPutU32(out + 4, s.fecha);
+  out[8] = s.binario ? 1 : 0;
+  bkpPutU32(out + 12, s.n);
+  bkpPutU32(out + 16, s.len);
+  bkpPutU32(out + 20, s.nAck);
+  bkpPutU16(out + 28, s.crc);
+  bkpPutU16(out + 30, bkpCrc16(out, 30));
+}
+
+// true si 'in' empieza como una cabecera de segmento (v1 o v2)
+inline bool packPareceSegmento(const uint8_t* in) {
+  return memcmp(in, PACK_SEG_MAGIC, 4) == 0 || memcmp(in, PACK_SEG_MAGIC_V1, 4) == 0;
+}
+
+// Longitud de la cabecera (24 o 32 B), o 0 si no es una cabecera válida o no
+// cabe en 'disponible'
+inline size_t packDecodificarSegmento(const uint8_t* in, size_t disponible, PackSegmento& s) {
+  if (disponible >= PACK_SEG_LEN && memcmp(in, PACK_SEG_MAGIC, 4) == 0) {
+    if (bkpGetU16(in + 30) != bkpCrc16(in, 30)) return 0;
+    s.version = 2;
+    s.nAck    = bkpGetU32(in + 20);
+    s.crc     = bkpGetU16(in + 28);
+  } else if (disponible >= PACK_SEG_LEN_V1 && memcmp(in, PACK_SEG_MAGIC_V1, 4) == 0) {
+    if (bkpGetU16(in + 22) != bkpCrc16(in, 22)) return 0;
+    s.version = 1;
+    s.nAck    = 0;
+    s.crc     = bkpGetU16(in + 20);
+  } else {
+    return 0;
+  }
+  s.fecha   = bkpGetU32(in + 4);
+  s.binario = in[8] != 0;
+  s.n       = bkpGetU32(in + 12);
+  s.len     = bkpGetU32(in + 16);
+  return s.version == 2 ? PACK_SEG_LEN : PACK_SEG_LEN_V1;
+}
+
+// Siguiente segmento completo de un mensual en memoria a partir de 'pos'
+// (tras la cabecera del archivo). Devuelve su payload y deja 'pos' detrás;
+// nullptr al final. Los dañados se saltan buscando la siguiente cabecera y se
+// cuentan en 'malos'. Para las herramientas de PC.
+inline const uint8_t* packSiguienteSegmento(const uint8_t* buf, size_t size, size_t& pos,
+                                            PackSegmento& s, size_t& malos) {
+  while (pos + PACK_SEG_LEN_V1 <= size) {
+    const size_t h = packDecodificarSegmento(buf + pos, size - pos, s);
+    if (h && s.len <= size - pos - h && bkpCrc16(buf + pos + h, s.len) == s.crc) {
+      const uint8_t* payload = buf + pos + h;
+      pos += h + s.len;
+      return payload;
+    }
+    if (packPareceSegmento(buf + pos)) malos++;
+    pos++;
+  }
+  return nullptr;
+}
+
+// Codifica una confirmación en out (hasta PACK_REG_MAX bytes); devuelve los bytes escritos
+inline size_t packCodificarAck(PackEstado& e, const PackAck& a, uint8_t* out) {
+  size_t n = 0;
+  n += varintPut(out + n, zigzagCodificar((int64_t)a.inicio - (int64_t)e.ackInicio));
+  n += varintPut(out + n, a.fin - a.inicio);
+  n += varintPut(out + n, zigzagCodificar((int64_t)(a.tsEnvio - e.ackTs)));
+  e.ackInicio = a.inicio;
+  e.ackTs = a.tsEnvio;
+  return n;
+}
+
+// Decodifica una confirmación de [p, fin); devuelve los bytes consumidos o 0 si está truncada
+inline size_t packDecodificarAck(PackEstado& e, const uint8_t* p, const uint8_t* fin, PackAck& a) {
+  uint64_t v[3];
+  size_t n = 0;
+  for (int i = 0; i < 3; i++) {
+    size_t k = varintGet(p + n, fin, v[i]);
+    if (!k) return 0;
+    n += k;
+  }
+  a.inicio = (uint32_t)((int64_t)e.ackInicio + zigzagDecodificar(v[0]));
+  a.fin = a.inicio + (uint32_t)v[1];
+  a.tsEnvio = e.ackTs + (unsigned long long)zigzagDecodificar(v[2]);
+  e.ackInicio = a.inicio;
+  e.ackTs = a.tsEnvio;
+  return n;
+}
+
+// Codifica r (que empieza en 'offset' del backup original) en out (hasta
+// PACK_REG_MAX bytes); devuelve los bytes escritos
+inline size_t packCodificar(PackEstado& e, const BackupRecord& r, uint32_t offset, uint8_t* out) {
+  int32_t cent = (int32_t)lroundf(r.valor * 100.0f);
+  int32_t& prev = e.valor[r.sensor % PACK_SENSORES];
+  size_t n = 0;
+  n += varintPut(out + n, zigzagCodificar((int64_t)(r.timestamp - e.ts)));
+  n += varintPut(out + n, ((uint64_t)r.sensor << 1) | (r.flags & BKP_FLAG_ORIGEN_BACKUP));
+  n += varintPut(out + n, zigzagCodificar((int64_t)cent - prev));
+  n += varintPut(out + n, zigzagCodificar((int64_t)r.seq - (int64_t)e.seq));
+  n += varintPut(out + n, zigzagCodificar((int64_t)offset - (int64_t)e.offset));
+  e.ts = r.timestamp;
+  e.seq = r.seq;
+  e.offset = offset;
+  prev = cent;
+  return n;
+}
+
+// Decodifica un registro de un segmento 'version' de [p, fin); devuelve los
+// bytes consumidos o 0 si está truncado. En v1 'offset' queda a 0.
+inline size_t packDecodificar(PackEstado& e, uint8_t version, const uint8_t* p, const uint8_t* fin,
+                              BackupRecord& r, uint32_t& offset) {
+  uint64_t v[5];
+  const int campos = (version >= 2) ? 5 : 4;
+  size_t n = 0;
+  for (int i = 0; i < campos; i++) {
+    size_t k = varintGet(p + n, fin, v[i]);
+    if (!k) return 0;
+    n += k;
+  }
+  r.timestamp = e.ts + (unsigned long long)zigzagDecodificar(v[0]);
+  r.sensor = (uint8_t)(v[1] >> 1);
+  r.flags = (uint8_t)(v[1] & BKP_FLAG_ORIGEN_BACKUP);
+  int32_t& prev = e.valor[r.sensor % PACK_SENSORES];
+  prev = (int32_t)(prev + zigzagDecodificar(v[2]));
+  r.valor = prev / 100.0f;
+  r.seq = (uint32_t)((int64_t)e.seq + zigzagDecodificar(v[3]));
+  offset = (campos == 5) ? (uint32_t)((int64_t)e.offset + zigzagDecodificar(v[4])) : 0;
+  e.ts = r.timestamp;
+  e.seq = r.seq;
+  e.offset = offset;
+  return n;
+}
+
+#endif
@@ -1,32 +1,37 @@
 // reenviarBackupSD.cpp
-// Modo append-only con índice .idx atómico y silencioso (sin errores VFS)
-// + Auditoría: por cada envío OK, escribir en /sent/backup_YYYYMMDD.csv con status=ENVIADO,ts_envio
+// Reenvío de los backups pendientes del manifiesto (backlog.h): el offset de
+// cada archivo se guarda en el manifiesto, sin .idx ni escaneo de la SD.
+// + Tubería: el loop lee el bloque siguiente mientras la tarea uplink envía el actual
+// + Auditoría: una entrada por bloque confirmado en /sent/ack.jrn (ack_journal.h);
+//   tools/ack_expand genera el CSV con status=ENVIADO,ts_envio
+// + Formatos: backup_*.csv (filas de texto) y backup_*.bin (registros fijos con CRC, backup_record.h)
 
 #include <Arduino.h>
 #include <SD.h>
 #include <WiFi.h>
 #include <stdlib.h>
 #include <time.h>
-#include "sdlog.h"          // <-- usar logEventoM
+#include "sdlog.h"
 #include "ds3231_time.h"    // getUnixSeconds(), getTimestampMicros()
-#include "api.h"            // enviarDatoAPI()
-
-#ifndef MAX_REENVIOS_POR_LLAMADA
-#define MAX_REENVIOS_POR_LLAMADA 6
-#endif
-#ifndef RETRY_EVERY_MS
-#define RETRY_EVERY_MS 500
+#include "api.h"            // API_LOTE_MAX
+#include "uplink_transport.h" // uplinkTransporte()
+#include "bufwriter.h"
+#include "backup_record.h"
+#include "ack_journal.h"
+#include "sdbackup.h"        // backupSync(), backupEsArchivoActivo()
+#include "backlog.h"
+#include "uplink.h"          // canal de reenvío
+#include "reenviarBackupSD.h" // REENVIO_BLOQUE, REENVIO_LECTURA_REGS
+
+// Pausa tras un bloque fallido o un error de SD
+#ifndef REENVIO_PAUSA_MS
+#define REENVIO_PAUSA_MS 2000
 #endif
-#ifndef SCAN_BACKUPS_EVERY_MS
-#define SCAN_BACKUPS_EVERY_MS 1000
+// Intentos de abrir un archivo que existe antes de apartarlo a la cuarentena
+#ifndef REENVIO_MAX_FALLOS_APERTURA
+#define REENVIO_MAX_FALLOS_APERTURA 5
 #endif
 
-static inline String ensureRootSlash(const String& p) {
-  if (p.length() == 0) return "/";
-  return (p[0] == '/') ? p : ("/" + p);
-}
-static inline String idxPathFor(const String& csvPath) { return csvPath + ".idx"; }
-
 static unsigned long long now_us_auditable() {
   unsigned long long ts = getTimestampMicros();
   if (ts != 0ULL && ts != 943920000000000ULL) return ts;
@@ -39,19 +44,10 @@ static String baseName(const String& path) {
   int slash = path.lastIndexOf('/');
   return (slash >= 0) ? path.substring(slash + 1) : path;
 }
-static String sentAuditPathForCsv(const String& csvPath) {
-  SD.mkdir("/sent");
-  return String("/sent/") + baseName(csvPath);
-}
-static void ensureAuditHeader(const String& auditPath) {
-  if (!SD.exists(auditPath)) {
-    File f = SD.open(auditPath, FILE_WRITE);
-    if (f) { f.println("timestamp,measurement,sensor,valor,source,status,ts_envio"); f.close(); }
-  }
-}
-static bool parseCsv7(const String& line, String out[7]) {
+// Columnas que falten (CSV sin seq) quedan vacías
+static bool parseCsv(const String& line, String* out, int n) {
   int pos = 0;
-  for (int i = 0; i < 7; i++) {
+  for (int i = 0; i < n; i++) {
     int coma = line.indexOf(',', pos);
     if (coma < 0) coma = line.length();
     out[i] = line.substring(pos, coma);
@@ -59,222 +55,407 @@ static bool parseCsv7(const String& line, String out[7]) {
   }
   return true;
 }
-static bool readIdx(const String& idxPath, uint32_t& offsetOut) {
-  if (!SD.exists(idxPath)) return false;
-  File f = SD.open(idxPath, FILE_READ);
-  if (!f) return false;
-  String s = f.readStringUntil('\n');
-  f.close();
-  s.trim();
-  if (s.length() == 0) return false;
-  offsetOut = (uint32_t)strtoul(s.c_str(), nullptr, 10);
-  return true;
-}
-static bool writeIdxAtomic(const String& idxPath, uint32_t offset) {
-  String tmp = idxPath + ".tmp";
-  if (SD.exists(tmp)) SD.remove(tmp);
-  File f = SD.open(tmp, FILE_WRITE);
-  if (!f) return false;
-  f.seek(0);
-  f.println(String(offset));
-  f.flush();
-  f.close();
-  if (SD.exists(idxPath)) SD.remove(idxPath);
-  return SD.rename(tmp, idxPath);
-}
 
-// ====== Archivo/rotación de CSV consumidos ======
-static bool archiveBackupCsv(const String& csvPath) {
-  String idxPath = idxPathFor(csvPath);
-  if (SD.exists(idxPath)) SD.remove(idxPath);
+// ====== Archivo/rotación de backups consumidos ======
+// El archivo que el escritor mantiene abierto (día en curso) no se archiva:
+// sigue creciendo y se archivará cuando rote.
+static bool archiveBackup(const BacklogEntrada& e, const String& path) {
+  if (backupEsArchivoActivo(e.fecha, e.binario)) return false;
 
   SD.mkdir("/sent/raw");
-  String base = baseName(csvPath);
+  String base = baseName(path);
   String dest = String("/sent/raw/") + base;
   if (SD.exists(dest)) SD.remove(dest);
 
-  bool ok = SD.rename(csvPath, dest);
+  bool ok = SD.rename(path, dest);
   if (ok) {
-    logEventoM("SD_BACKUP", "BACKUP_ARCHIVE", String("path=raw/") + base);
+    backlogQuitar(e.fecha, e.binario);
+    LOGI("SD_BACKUP", "BACKUP_ARCHIVE", "path=raw/%s", base.c_str());
   } else {
-    logEventoM("SD_BACKUP", "BACKUP_WARN", String("path=") + base + ";op=archive;err=rename_failed");
+    LOGW("SD_BACKUP", "BACKUP_WARN", "path=%s;op=archive;err=rename_failed", base.c_str());
   }
   return ok;
 }
 
-// ====== Auditoría ENVIADO ======
-static void appendAuditSent(const String& csvPath, const String c[7]) {
-  String audit = sentAuditPathForCsv(csvPath);
-  ensureAuditHeader(audit);
-  unsigned long long ts_envio = now_us_auditable();
-  String linea = c[0] + "," + c[1] + "," + c[2] + "," + c[3] + "," + c[4] + ",ENVIADO," + String(ts_envio);
-  File f = SD.open(audit, FILE_APPEND);
-  if (!f) { f = SD.open(audit, FILE_WRITE); if (f) f.seek(f.size()); }
-  if (f) { f.println(linea); f.flush(); f.close(); }
-}
-
-// ====== Núcleo IDX: procesa un CSV con índice .idx ======
-static void procesarBackupConIdx(const String& csvPathIn) {
-  static unsigned long lastRetryMs = 0;
-  if (!WiFi.isConnected()) {
-    logEventoM("SD_BACKUP", "REINTENTO_SKIP_WIFI", "wifi=0");
-    return;
-  }
-  if (millis() - lastRetryMs < RETRY_EVERY_MS) return;
-  lastRetryMs = millis();
-
-  String csvPath = ensureRootSlash(csvPathIn);
-  String idxPath = idxPathFor(csvPath);
-
-  File fsize0 = SD.open(csvPath, FILE_READ);
-  if (!fsize0) {
-    logEventoM("SD_BACKUP", "REINTENTO_ERR", String("op=size;path=") + csvPath);
-    return;
-  }
-  uint32_t size0 = (uint32_t)fsize0.size();
-  fsize0.close();
+// ====== Diario de confirmaciones (/sent/ack.jrn) ======
+// Una entrada de 28 B por bloque confirmado, escrita antes de avanzar el
+// manifiesto: si se corta entre ambas, el bloque se reenvía y el diario
+// tendrá dos entradas con rangos solapados (ack_expand las deduplica).
 
-  uint32_t offset = 0;
-  bool haveIdx = readIdx(idxPath, offset);
-
-  if (!haveIdx) {
-    File f0 = SD.open(csvPath, FILE_READ);
-    if (!f0) {
-      logEventoM("SD_BACKUP", "REINTENTO_ERR", String("op=init_idx;path=") + csvPath);
-      return;
-    }
-    (void)f0.readStringUntil('\n');  // saltar header
-    offset = (uint32_t)f0.position();
-    f0.close();
-    if (writeIdxAtomic(idxPath, offset)) {
-      logEventoM("SD_BACKUP", "REINTENTO_INFO", String("init_idx=") + String(offset) + ";path=" + csvPath);
-    }
+static bool anotarAck(const AckEntrada& a) {
+  static bool dirOk = false;
+  if (!dirOk) dirOk = SD.mkdir("/sent") || SD.exists("/sent");
+  File f = SD.open(ACK_JOURNAL_PATH, FILE_APPEND);
+  if (!f) {
+    LOGE("SD_BACKUP", "SD_ERR", "op=append;path=" ACK_JOURNAL_PATH);
+    return false;
   }
-
-  if (offset >= size0) {
-    logEventoM("SD_BACKUP", "REINTENTO_EOF", String("idx=") + String(offset) + ";size=" + String(size0) + ";path=" + csvPath);
-    (void)archiveBackupCsv(csvPath);
-    return;
+  uint32_t sz = (uint32_t)f.size();
+  if (sz == 0) {
+    uint8_t hdr[ACK_HDR_LEN];
+    ackCodificarCabecera(hdr);
+    f.write(hdr, sizeof(hdr));
+  } else if (sz >= ACK_HDR_LEN && (sz - ACK_HDR_LEN) % ACK_REC_LEN) {
+    // Entrada a medias de un corte: rellenar hasta la frontera (falla el CRC)
+    static const uint8_t ceros[ACK_REC_LEN] = {0};
+    f.write(ceros, ACK_REC_LEN - (sz - ACK_HDR_LEN) % ACK_REC_LEN);
   }
+  uint8_t rec[ACK_REC_LEN];
+  ackCodificar(a, rec);
+  size_t w = f.write(rec, sizeof(rec));
+  f.flush();
+  f.close();
+  return w == sizeof(rec);
+}
 
-  logEventoM("SD_BACKUP", "REINTENTO_DEBUG", String("path=") + csvPath);
-
-  File f = SD.open(csvPath, FILE_READ);
-  if (!f) {
-    logEventoM("SD_BACKUP", "REINTENTO_ERR", String("op=open;path=") + csvPath);
-    return;
-  }
-  if (!f.seek(offset)) {
-    f.close();
-    File f2 = SD.open(csvPath, FILE_READ);
-    if (!f2) return;
-    (void)f2.readStringUntil('\n');
-    uint32_t off0 = (uint32_t)f2.position();
-    f2.close();
-    writeIdxAtomic(idxPath, off0);
-    logEventoM("SD_BACKUP", "REINTENTO_FIX", String("reset_idx=") + String(off0) + ";path=" + csvPath);
-    return;
+// ====== Bloques de reenvío (doble buffer) ======
+// Mientras la tarea uplink envía un bloque, el loop lee el siguiente en el
+// otro buffer. El offset del manifiesto avanza una vez por bloque confirmado.
+struct Bloque {
+  uint32_t fecha;
+  bool binario;
+  uint8_t recLen;                        // .bin: tamaño de registro (cabecera)
+  uint32_t inicio;                       // offset del primer registro leído
+  uint32_t fin;                          // offset tras el último leído (incl. saltados)
+  size_t n;                              // muestras enviables
+  int saltados;
+  int corruptos;
+  Sample m[REENVIO_BLOQUE];
+  uint16_t finRegistro[REENVIO_BLOQUE];  // offset tras cada muestra, relativo a 'inicio'
+};
+
+// finRegistro es relativo y de 16 bits: un bloque no abarca más de esto
+#define REENVIO_BLOQUE_MAX_BYTES 0xFFFFu
+static_assert(REENVIO_BLOQUE * BKP_REC_LEN <= REENVIO_BLOQUE_MAX_BYTES, "REENVIO_BLOQUE demasiado grande para finRegistro");
+
+static Bloque g_bloque[2];
+static int g_enVuelo = -1;               // bloque entregado a la tarea uplink
+static int g_listo = -1;                 // bloque leído, esperando turno
+
+// Cursor de lectura: archivo actual y siguiente byte por leer
+static bool g_cursorValido = false;
+static uint32_t g_cursorFecha = 0;
+static bool g_cursorBin = false;
+static uint8_t g_cursorRecLen = BKP_REC_LEN;
+static uint32_t g_cursor = 0;
+
+static unsigned long g_pausaHastaMs = 0;
+
+// Fallos seguidos al abrir el mismo archivo (elegirArchivo)
+static uint8_t g_fallosApertura = 0;
+static uint32_t g_fallosFecha = 0;
+static bool g_fallosBin = false;
+
+// Métricas del archivo en curso (REINTENTO_SUMMARY con ritmo de vaciado)
+static unsigned long g_archivoInicioMs = 0;
+static uint32_t g_archivoEnviados = 0;
+
+// Offset del primer registro: tras la línea de cabecera (CSV) o la cabecera fija (BIN),
+// que además da el tamaño de registro (v1/v2) en 'recLen'.
+// 0 si el archivo no se puede abrir ('abierto' = false) o la cabecera no es válida.
+static uint32_t offsetPrimerRegistro(const String& path, bool bin, uint8_t& recLen, bool& abierto) {
+  File f = SD.open(path, FILE_READ);
+  abierto = (bool)f;
+  if (!f) return 0;
+  uint32_t off = 0;
+  if (bin) {
+    uint8_t hdr[BKP_HDR_LEN];
+    if (f.read(hdr, sizeof(hdr)) == sizeof(hdr) && (recLen = bkpRecLen(hdr)) != 0) off = BKP_HDR_LEN;
+  } else {
+    (void)f.readStringUntil('\n');  // saltar header
+    off = (uint32_t)f.position();
   }
+  f.close();
+  return off;
+}
 
-  int enviados = 0;
-  int saltados = 0;
-  uint32_t newOffset = offset;
+// Sin datos pendientes a partir de 'offset'. En .bin un registro final
+// incompleto (corte de alimentación a mitad de escritura) no cuenta.
+static inline bool finDeDatos(bool bin, uint8_t recLen, uint32_t offset, uint32_t size) {
+  if (offset >= size) return true;
+  return bin && (size - offset) < recLen;
+}
 
-  while (WiFi.isConnected() && f.available() && enviados < MAX_REENVIOS_POR_LLAMADA) {
-    uint32_t lineStart = (uint32_t)f.position();
+static void leerBloqueCsv(File& f, uint32_t size, Bloque& b) {
+  while (f.available() && (uint32_t)f.position() < size && b.n < REENVIO_BLOQUE) {
+    // Una fila nunca pasa de ~112 B: cortar antes de salir del rango de finRegistro
+    if ((uint32_t)f.position() - b.inicio > REENVIO_BLOQUE_MAX_BYTES - 512) break;
     String line = f.readStringUntil('\n');
-    newOffset = (uint32_t)f.position();
+    b.fin = (uint32_t)f.position();
 
     line.trim();
-    if (line.length() < 5) { saltados++; continue; }
+    if (line.length() < 5) { b.saltados++; continue; }
 
-    String c[7]; parseCsv7(line, c);
+    String c[8]; parseCsv(line, c, 8);
     const String& tsS    = c[0];
     const String& meas   = c[1];
     const String& sens   = c[2];
     const String& valS   = c[3];
     const String& status = c[5];
 
-    if (status != "PENDIENTE") { saltados++; continue; }
+    if (status != "PENDIENTE") { b.saltados++; continue; }
+
+    uint8_t id = sensorIdDesde(meas.c_str(), sens.c_str());
+    if (id == SENSOR_DESCONOCIDO) { b.saltados++; continue; }
 
-    unsigned long long ts = strtoull(tsS.c_str(), nullptr, 10);
-    float val = valS.toFloat();
+    Sample& s = b.m[b.n];
+    s.timestamp = strtoull(tsS.c_str(), nullptr, 10);
+    s.valor     = valS.toFloat();
+    s.sensor    = id;
+    s.origen    = ORIGEN_BACKUP;
+    s.seq       = (uint32_t)strtoul(c[7].c_str(), nullptr, 10);
+    b.finRegistro[b.n++] = (uint16_t)(b.fin - b.inicio);
+  }
+}
 
-    if (enviarDatoAPI(meas, sens, val, ts, "backup")) {
-      appendAuditSent(csvPath, c);
-      enviados++;
-    } else {
-      newOffset = lineStart; // mantener posición para reintento
-      break;
+// Lee registros enteros, REENVIO_LECTURA_REGS por read(); los de CRC inválido
+// se saltan y se cuentan.
+static void leerBloqueBin(File& f, uint32_t size, Bloque& b) {
+  static uint8_t buf[REENVIO_LECTURA_REGS * BKP_REC_LEN];
+  const size_t rl = b.recLen;
+  size_t regs = (size - b.inicio) / rl;
+  if (regs > REENVIO_BLOQUE) regs = REENVIO_BLOQUE;
+
+  while (regs > 0) {
+    size_t pedir = (regs < REENVIO_LECTURA_REGS) ? regs : REENVIO_LECTURA_REGS;
+    size_t leidos = f.read(buf, pedir * rl) / rl;
+    for (size_t i = 0; i < leidos; i++) {
+      b.fin += (uint32_t)rl;
+      BackupRecord r;
+      if (!bkpDecodificar(buf + i * rl, r, b.recLen)) { b.corruptos++; b.saltados++; continue; }
+      if (!sensorDef(r.sensor)) { b.saltados++; continue; }
+
+      Sample& s = b.m[b.n];
+      s.timestamp = r.timestamp;
+      s.valor     = r.valor;
+      s.sensor    = r.sensor;
+      s.origen    = ORIGEN_BACKUP;
+      s.seq       = r.seq;
+      b.finRegistro[b.n++] = (uint16_t)(b.fin - b.inicio);
     }
+    if (leidos < pedir) break;   // lectura corta: el resto en el siguiente bloque
+    regs -= leidos;
   }
-  f.close();
+}
+
+static bool hayBloquesDe(uint32_t fecha, bool bin) {
+  for (int i : { g_enVuelo, g_listo }) {
+    if (i >= 0 && g_bloque[i].fecha == fecha && g_bloque[i].binario == bin) return true;
+  }
+  return false;
+}
 
-  File fsize1 = SD.open(csvPath, FILE_READ);
-  uint32_t size1 = 0;
-  if (fsize1) { size1 = (uint32_t)fsize1.size(); fsize1.close(); }
+static void logResumenArchivo(const String& path) {
+  unsigned long ms = millis() - g_archivoInicioMs;
+  ApiSesionStats st = apiSesionStats();
+  LOGI("SD_BACKUP", "REINTENTO_SUMMARY", "enviados=%lu;ms=%lu;reg_s=%lu;http_reusos=%lu;http_handshakes=%lu;path=%s",
+       (unsigned long)g_archivoEnviados, ms,
+       ms ? (unsigned long)((unsigned long long)g_archivoEnviados * 1000ULL / ms) : 0UL,
+       (unsigned long)st.reusos, (unsigned long)st.handshakes, path.c_str());
+}
 
-  if (newOffset != offset) {
-    if (writeIdxAtomic(idxPath, newOffset)) {
-      logEventoM("SD_BACKUP", "REINTENTO_OK",
-                 String("idx=") + String(newOffset) + ";enviados=" + String(enviados) + ";saltados=" + String(saltados) + ";path=" + csvPath);
+// Elige el archivo más antiguo con datos pendientes; archiva los ya consumidos.
+static bool elegirArchivo() {
+  BacklogEntrada e;
+  for (size_t i = 0; backlogEntrada(i, e); i++) {
+    if (hayBloquesDe(e.fecha, e.binario)) continue;   // su manifiesto aún no refleja lo que está en vuelo
+    char ruta[48];
+    backlogRutaArchivo(e.fecha, e.binario, ruta, sizeof(ruta));
+    const String path(ruta);
+
+    // La cabecera se relee siempre en .bin: da el tamaño de registro del archivo
+    uint32_t off = e.offset;
+    uint8_t recLen = BKP_REC_LEN;
+    if (off == 0 || e.binario) {
+      bool abierto = false;
+      uint32_t primero = offsetPrimerRegistro(path, e.binario, recLen, abierto);
+      if (primero == 0) {
+        if (backupEsArchivoActivo(e.fecha, e.binario)) continue;   // el escritor aún no lo volcó
+        if (!abierto && SD.exists(path)) {
+          // Fallo de apertura quizá pasajero: pausa y reintento, hasta un límite
+          if (g_fallosFecha != e.fecha || g_fallosBin != e.binario) g_fallosApertura = 0;
+          g_fallosFecha = e.fecha;
+          g_fallosBin = e.binario;
+          if (++g_fallosApertura < REENVIO_MAX_FALLOS_APERTURA) {
+            LOGE("SD_BACKUP", "REINTENTO_ERR", "op=open;intento=%u;path=%s", (unsigned)g_fallosApertura, path.c_str());
+            g_pausaHastaMs = millis() + REENVIO_PAUSA_MS;
+            return false;
+          }
+        }
+        // Ilegible o desaparecido: fuera del manifiesto, o seguiría pendiente para siempre
+        LOGE("SD_BACKUP", "REINTENTO_ERR", "op=%s;abierto=%d;path=%s", e.binario ? "header" : "init_idx",
+             abierto ? 1 : 0, path.c_str());
+        g_fallosApertura = 0;
+        if (backlogCuarentena(e.fecha, e.binario)) i--;   // la entrada salió del manifiesto
+        continue;
+      }
+      if (g_fallosFecha == e.fecha && g_fallosBin == e.binario) g_fallosApertura = 0;
+      if (off == 0) {
+        off = primero;
+        if (backlogAvanzar(e.fecha, e.binario, off)) {
+          LOGI("SD_BACKUP", "REINTENTO_INFO", "init_idx=%lu;path=%s", (unsigned long)off, path.c_str());
+        }
+      }
     }
-    logEventoM("SD_BACKUP", "REINTENTO",
-               String("enviados=") + String(enviados) + ";saltados=" + String(saltados) + ";path=" + csvPath);
-  } else {
-    if (!WiFi.isConnected()) {
-      logEventoM("SD_BACKUP", "REINTENTO_SKIP_WIFI", String("path=") + csvPath);
-      return;
+
+    if (finDeDatos(e.binario, recLen, off, e.size)) {
+      if (backupEsArchivoActivo(e.fecha, e.binario)) continue;   // al día; nada que hacer
+      LOGI("SD_BACKUP", "REINTENTO_EOF", "idx=%lu;size=%lu;path=%s", (unsigned long)off, (unsigned long)e.size, path.c_str());
+      if (archiveBackup(e, path)) i--;   // la entrada salió del manifiesto
+      continue;
     }
-    if (newOffset >= size1) {
-      logEventoM("SD_BACKUP", "REINTENTO_EOF", String("idx=") + String(newOffset) + ";size=" + String(size1) + ";path=" + csvPath);
-      (void)archiveBackupCsv(csvPath);
-      return;
+
+    // Un offset que no cae en frontera de registro también se considera inválido
+    if (e.binario && (off < BKP_HDR_LEN || (off - BKP_HDR_LEN) % recLen != 0)) {
+      off = BKP_HDR_LEN;
+      backlogAvanzar(e.fecha, e.binario, off);
+      LOGI("SD_BACKUP", "REINTENTO_FIX", "reset_idx=%lu;path=%s", (unsigned long)off, path.c_str());
     }
-    logEventoM("SD_BACKUP", "REINTENTO_HOLD", String("path=") + csvPath + ";reason=api_fail");
+
+    g_cursorValido = true;
+    g_cursorFecha = e.fecha;
+    g_cursorBin = e.binario;
+    g_cursorRecLen = recLen;
+    g_cursor = off;
+    g_archivoInicioMs = millis();
+    g_archivoEnviados = 0;
+    return true;
   }
+  return false;
 }
 
-// ====== Escáner de backups ======
-static bool esBackupCsvValido(const String& name) {
-  if (!name.startsWith("backup_")) return false;
-  if (!name.endsWith(".csv")) return false;
-  if (name.indexOf("1970") >= 0) return false;
+// Lee el siguiente bloque desde el cursor en el buffer libre. false si no hay nada que leer.
+static bool leerSiguienteBloque(int libre) {
+  if (!g_cursorValido && !elegirArchivo()) return false;
+
+  BacklogEntrada e;
+  char ruta[48];
+  backlogRutaArchivo(g_cursorFecha, g_cursorBin, ruta, sizeof(ruta));
+  const String path(ruta);
+  if (!backlogObtener(g_cursorFecha, g_cursorBin, e)) { g_cursorValido = false; return false; }
+
+  if (finDeDatos(e.binario, g_cursorRecLen, g_cursor, e.size)) {
+    // Archivo leído entero: se cierra cuando se confirme su último bloque
+    if (hayBloquesDe(e.fecha, e.binario)) return false;
+    if (g_archivoEnviados) logResumenArchivo(path);
+    g_cursorValido = false;
+    if (!backupEsArchivoActivo(e.fecha, e.binario)) {
+      LOGI("SD_BACKUP", "REINTENTO_EOF", "idx=%lu;size=%lu;path=%s", (unsigned long)g_cursor, (unsigned long)e.size, ruta);
+      (void)archiveBackup(e, path);
+    }
+    return false;
+  }
+
+  File f = SD.open(path, FILE_READ);
+  if (!f) {
+    LOGE("SD_BACKUP", "REINTENTO_ERR", "op=open;path=%s", ruta);
+    g_cursorValido = false;
+    g_pausaHastaMs = millis() + REENVIO_PAUSA_MS;
+    return false;
+  }
+  if (!f.seek(g_cursor)) {
+    f.close();
+    LOGE("SD_BACKUP", "REINTENTO_ERR", "op=seek;idx=%lu;path=%s", (unsigned long)g_cursor, ruta);
+    g_cursorValido = false;
+    g_pausaHastaMs = millis() + REENVIO_PAUSA_MS;
+    return false;
+  }
+
+  Bloque& b = g_bloque[libre];
+  b.fecha = e.fecha;
+  b.binario = e.binario;
+  b.recLen = g_cursorRecLen;
+  b.inicio = g_cursor;
+  b.fin = g_cursor;
+  b.n = 0;
+  b.saltados = 0;
+  b.corruptos = 0;
+  if (e.binario) leerBloqueBin(f, e.size, b);
+  else           leerBloqueCsv(f, e.size, b);
+  f.close();
+
+  if (b.corruptos > 0) {
+    LOGI("SD_BACKUP", "REINTENTO_CRC", "corruptos=%d;idx=%lu;path=%s", b.corruptos, (unsigned long)b.inicio, ruta);
+  }
+  if (b.fin == b.inicio) return false;   // nada legible (registro a medias): esperar a más datos
+  g_cursor = b.fin;
+  g_listo = libre;
   return true;
 }
 
-void reenviarDatosDesdeBackup() {
-  static unsigned long lastScan = 0;
-  if (millis() - lastScan < SCAN_BACKUPS_EVERY_MS) return;
-  lastScan = millis();
+// Procesa el resultado del bloque en vuelo: auditoría + avance del manifiesto.
+static void cerrarBloqueEnVuelo(size_t ok) {
+  Bloque& b = g_bloque[g_enVuelo];
+  g_enVuelo = -1;
 
-  if (!WiFi.isConnected()) {
-    logEventoM("SD_BACKUP", "REINTENTO_WAIT", "wifi=0");
-    return;
-  }
+  char ruta[48];
+  backlogRutaArchivo(b.fecha, b.binario, ruta, sizeof(ruta));
 
-  logEventoM("SD_BACKUP", "REINTENTO_INFO", "scan=1");
+  // Bloque completo: avanzar hasta 'fin' (incluye los saltados del final)
+  uint32_t nuevo = (ok == b.n) ? b.fin : (b.inicio + (ok ? b.finRegistro[ok - 1] : 0));
+  if (ok > 0) {
+    AckEntrada a{ b.fecha, b.binario, (uint16_t)ok, b.inicio, nuevo, now_us_auditable() };
+    anotarAck(a);
+  }
+  if (nuevo != b.inicio) {
+    if (backlogAvanzar(b.fecha, b.binario, nuevo)) {
+      LOGI("SD_BACKUP", "REINTENTO_OK", "idx=%lu;enviados=%u;saltados=%d;path=%s",
+           (unsigned long)nuevo, (unsigned)ok, b.saltados, ruta);
+    }
+  }
+  g_archivoEnviados += ok;
+
+  if (ok < b.n) {
+    // Fallo: se descarta lo leído por delante y se relee desde lo confirmado
+    g_listo = -1;
+    g_cursorValido = true;
+    g_cursorFecha = b.fecha;
+    g_cursorBin = b.binario;
+    g_cursorRecLen = b.recLen;
+    g_cursor = nuevo;
+    g_pausaHastaMs = millis() + REENVIO_PAUSA_MS;
+    LOGI("SD_BACKUP", "REINTENTO_HOLD", "path=%s;reason=api_fail;ok=%u", ruta, (unsigned)ok);
+  }
+}
 
-  File root = SD.open("/");
-  if (!root) {
-    logEventoM("SD_BACKUP", "SD_ERR", "err=open_root");
-    return;
+// ====== Motor de reenvío (un paso por llamada, no bloquea) ======
+void reenviarDatosDesdeBackup() {
+  // 1) Resultado del bloque en vuelo
+  size_t ok;
+  if (g_enVuelo >= 0 && uplinkReenvioResultado(ok)) cerrarBloqueEnVuelo(ok);
+
+  if ((long)(millis() - g_pausaHastaMs) < 0) return;
+
+  // 2) Entregar el bloque ya leído si el canal está libre
+  if (g_enVuelo < 0 && g_listo >= 0) {
+    if (!WiFi.isConnected() || !uplinkTransporte().disponible()) {
+      static unsigned long ultimoLogMs = 0;
+      if (millis() - ultimoLogMs > 10000) {
+        LOGI("SD_BACKUP", "REINTENTO_WAIT", "%s", WiFi.isConnected() ? "uplink=down" : "wifi=0");
+        ultimoLogMs = millis();
+      }
+      return;
+    }
+    Bloque& b = g_bloque[g_listo];
+    if (b.n == 0) {
+      // Solo registros saltados: se confirma sin pasar por la red
+      g_enVuelo = g_listo;
+      g_listo = -1;
+      cerrarBloqueEnVuelo(0);
+    } else if (uplinkReenvioEnviar(b.m, b.n)) {
+      g_enVuelo = g_listo;
+      g_listo = -1;
+    }
   }
 
-  uint16_t candidatos = 0;
-  while (true) {
-    File entry = root.openNextFile();
-    if (!entry) break;
-    String name = entry.name();
-    entry.close();
-
-    String base = baseName(name);
-    if (!esBackupCsvValido(base)) continue;
-    candidatos++;
-    String path = ensureRootSlash(base);
-    procesarBackupConIdx(path);
+  // 3) Leer el siguiente bloque mientras el anterior está en vuelo
+  if (g_listo < 0) {
+    if (g_enVuelo < 0) backupSync();   // lo que esté en el buffer del escritor, a disco
+    int libre = (g_enVuelo == 0) ? 1 : 0;
+    leerSiguienteBloque(libre);
   }
-  root.close();
+}
 
-  logEventoM("SD_BACKUP", "REINTENTO_SUMMARY", String("candidatos=") + String(candidatos));
+bool reenvioEnCurso() {
+  return g_enVuelo >= 0 || g_listo >= 0;
 }
@@ -1,6 +1,22 @@
 #ifndef REENVIARBACKUPSD_H
 #define REENVIARBACKUPSD_H
 
+#include "formato_muestra.h"   // API_LOTE_MAX
+
+// Registros por bloque leído de la SD (la tarea uplink lo sube en sub-lotes de loteMax())
+#ifndef REENVIO_BLOQUE
+#define REENVIO_BLOQUE API_LOTE_MAX
+#endif
+// Registros .bin leídos de la SD por cada read() (buffer estático de este tamaño)
+#ifndef REENVIO_LECTURA_REGS
+#define REENVIO_LECTURA_REGS 32
+#endif
+
+// Un paso del motor de reenvío (no bloquea): recoge el bloque confirmado,
+// entrega el siguiente a la tarea uplink y lee otro de la SD en paralelo.
 void reenviarDatosDesdeBackup();
 
+// true mientras haya un bloque leído o en vuelo por cerrar
+bool reenvioEnCurso();
+
 #endif
@@ -0,0 +1,535 @@
+// retencion.cpp - presupuestos de bytes/antigüedad por categoría y
+// compactación de los backups ya enviados en archivos mensuales.
+//
+// Ciclo cada RET_PERIODO_MS, avanzado a pasos desde retencionTick():
+//   ESCANEO   un archivo por paso: bytes por categoría y los RET_CANDIDATOS
+//             archivos más antiguos de cada una
+//   PLAN      siguiente acción: compactar el raw más antiguo que supere
+//             compactarDias, o borrar el más antiguo de una categoría fuera
+//             de presupuesto; si no queda nada, fin del ciclo (RET_SUMMARY)
+//   ACUSES    RET_REGS_PASO entradas de /sent/ack.jrn: las del raw (rango y
+//             ts_envio) → /sent/arch/pack.tmp
+//   COMPACTAR RET_REGS_PASO registros del raw, con su offset original → pack.tmp
+//   COPIAR    cabecera de segmento + pack.tmp al mensual; después borra el raw
+// El segmento lleva lo que ack_expand necesitaba del raw (offsets) y del
+// diario (ts_envio): la auditoría ENVIADO sale igual del mensual.
+// Un corte a mitad deja pack.tmp (se rehace en el siguiente ciclo) o un
+// segmento incompleto en el mensual (el lector lo salta, raw_pack.h).
+
+#include "retencion.h"
+#include "config.h"
+#include "sdlog.h"
+#include "ds3231_time.h"
+#include "raw_pack.h"
+#include "ack_journal.h"
+#include "sample.h"
+#include <SD.h>
+#include <stdlib.h>
+
+// Archivos más antiguos que se recuerdan por categoría en cada escaneo
+#ifndef RET_CANDIDATOS
+#define RET_CANDIDATOS 16
+#endif
+// Registros compactados por paso
+#ifndef RET_REGS_PASO
+#define RET_REGS_PASO 32
+#endif
+// Bytes copiados al mensual por paso
+#ifndef RET_COPIA_PASO
+#define RET_COPIA_PASO 1024
+#endif
+
+#define RET_DIR_ARCH  "/sent/arch"
+#define RET_TMP       RET_DIR_ARCH "/pack.tmp"
+
+enum Categoria : uint8_t { CAT_RAW = 0, CAT_AUDITORIA, CAT_EVENTLOG, CAT_N };
+static const char* const CAT_NOMBRE[CAT_N] = { "raw", "audit", "eventlog" };
+
+// Directorios de cada categoría (sin bajar a subdirectorios)
+struct DirCat { const char* dir; Categoria cat; };
+static const DirCat DIRS[] = {
+  { "/sent/raw",  CAT_RAW },
+  { RET_DIR_ARCH, CAT_RAW },
+  { "/sent",      CAT_AUDITORIA },
+  { "/",          CAT_EVENTLOG },
+};
+static const size_t DIRS_N = sizeof(DIRS) / sizeof(DIRS[0]);
+
+struct Candidato {
+  uint32_t fecha;     // YYYYMMDD (mensual: día 31 de su mes); 0 = sin fecha
+  uint32_t size;
+  bool compactable;   // backup de /sent/raw (no un mensual)
+  char path[44];
+};
+
+struct EstadoCat {
+  uint64_t bytes;
+  Candidato c[RET_CANDIDATOS];   // el más antiguo primero
+  uint8_t n;
+};
+
+enum Fase : uint8_t { ESPERA, ESCANEO, PLAN, ACUSES, COMPACTAR, COPIAR };
+
+static Fase g_fase = ESPERA;
+static bool g_primerCiclo = true;
+static unsigned long g_ultimoCicloMs = 0;
+static EstadoCat g_cat[CAT_N];
+static size_t g_dirIdx = 0;
+static File g_dir;
+
+// Compactación en curso
+static Candidato g_comp;
+static File g_src, g_tmp, g_arch, g_jrn;
+static uint8_t g_srcRecLen = 0;        // 0 = CSV
+static PackEstado g_pack;
+static PackSegmento g_seg;
+static char g_archPath[32];
+static uint32_t g_archInicial = 0;     // tamaño del mensual antes de añadir
+
+// Lectura (registros del raw o entradas del diario) y salida codificada de un paso
+static uint8_t g_lectura[RET_REGS_PASO * ACK_REC_LEN];
+static uint8_t g_salida[RET_REGS_PASO * PACK_REG_MAX];
+static_assert(ACK_REC_LEN >= BKP_REC_LEN, "g_lectura también guarda registros .bin");
+
+// Resumen del ciclo
+static uint16_t g_compactados = 0, g_borrados = 0;
+static uint64_t g_liberados = 0;
+static unsigned long g_msActivo = 0;
+
+// ====== Fechas ======
+// Días desde 1970-01-01 (un día fuera de rango se desborda al mes siguiente)
+static int32_t diasDesdeEpoch(uint32_t ymd) {
+  int32_t y = (int32_t)(ymd / 10000), m = (int32_t)((ymd / 100) % 100), d = (int32_t)(ymd % 100);
+  y -= (m <= 2);
+  const int32_t era = y / 400;
+  const int32_t yoe = y - era * 400;
+  const int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// Hoy en días desde epoch (UTC); -1 si el RTC no es fiable
+static int32_t hoyDias() {
+  uint32_t s = getUnixSeconds();
+  if (!rtcIsPresent() || !rtcIsTimeValid() || s < 1609459200UL) return -1;
+  return (int32_t)(s / 86400UL);
+}
+
+// Antigüedad en días; -1 si no se sabe (sin fecha o sin RTC)
+static int32_t edadDias(uint32_t fecha, int32_t hoy) {
+  if (!fecha || hoy < 0) return -1;
+  return hoy - diasDesdeEpoch(fecha);
+}
+
+// ====== Clasificación de archivos ======
+static const char* baseDe(const char* path) {
+  const char* s = strrchr(path, '/');
+  return s ? s + 1 : path;
+}
+
+static bool digitos(const char* p, int n, uint32_t& v) {
+  v = 0;
+  for (int i = 0; i < n; i++) {
+    if (p[i] < '0' || p[i] > '9') return false;
+    v = v * 10 + (uint32_t)(p[i] - '0');
+  }
+  return true;
+}
+
+// backup_YYYYMMDD.<ext> o backup_unsync.<ext> (fecha = 0)
+static bool nombreBackup(const char* base, const char* ext, uint32_t& fecha) {
+  if (strncmp(base, "backup_", 7) != 0) return false;
+  const char* p = base + 7;
+  if (strncmp(p, "unsync", 6) == 0 && strcmp(p + 6, ext) == 0) { fecha = 0; return true; }
+  return digitos(p, 8, fecha) && strcmp(p + 8, ext) == 0;
+}
+
+// false si el archivo no pertenece a la categoría de su directorio
+static bool clasificar(const DirCat& d, const char* base, Candidato& c) {
+  c.compactable = false;
+  uint32_t v;
+  switch (d.cat) {
+    case CAT_RAW:
+      if (strcmp(d.dir, RET_DIR_ARCH) == 0) {
+        // raw_YYYYMM.oxz: cuenta como del último día de su mes
+        if (strncmp(base, "raw_", 4) != 0 || !digitos(base + 4, 6, v) || strcmp(base + 10, ".oxz") != 0) return false;
+        c.fecha = v * 100 + 31;
+        return true;
+      }
+      if (!nombreBackup(base, ".csv", c.fecha) && !nombreBackup(base, ".bin", c.fecha)) return false;
+      c.compactable = c.fecha != 0;
+      return true;
+    case CAT_AUDITORIA:
+      return nombreBackup(base, ".csv", c.fecha);   // auditoría CSV anterior al diario
+    case CAT_EVENTLOG: {
+      // eventlog_YYYY.MM.DD.{csv,bin} o eventlog_unknown.{csv,bin}
+      if (strncmp(base, "eventlog_", 9) != 0) return false;
+      const char* p = base + 9;
+      if (strcmp(p, "unknown.csv") == 0 || strcmp(p, "unknown.bin") == 0) { c.fecha = 0; return true; }
+      uint32_t y, m, dd;
+      if (!digitos(p, 4, y) || p[4] != '.' || !digitos(p + 5, 2, m) || p[7] != '.' ||
+          !digitos(p + 8, 2, dd) || (strcmp(p + 10, ".csv") != 0 && strcmp(p + 10, ".bin") != 0)) return false;
+      c.fecha = y * 10000 + m * 100 + dd;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+// Inserta en la lista ordenada de más antiguos (se descarta el más reciente si está llena)
+static void anotar(EstadoCat& e, const Candidato& c) {
+  e.bytes += c.size;
+  uint8_t i = e.n;
+  if (i == RET_CANDIDATOS) {
+    if (c.fecha >= e.c[i - 1].fecha) return;
+    i--;
+  } else {
+    e.n++;
+  }
+  while (i > 0 && e.c[i - 1].fecha > c.fecha) { e.c[i] = e.c[i - 1]; i--; }
+  e.c[i] = c;
+}
+
+static void quitarCandidato(EstadoCat& e, uint8_t i) {
+  for (uint8_t j = i; j + 1 < e.n; j++) e.c[j] = e.c[j + 1];
+  e.n--;
+}
+
+static const RetencionCategoria& presupuesto(uint8_t cat) {
+  if (cat == CAT_RAW) return config.retencion.raw;
+  if (cat == CAT_AUDITORIA) return config.retencion.auditoria;
+  return config.retencion.eventlog;
+}
+
+// ====== Escaneo ======
+// true al terminar todos los directorios
+static bool pasoEscaneo() {
+  if (!g_dir) {
+    if (g_dirIdx >= DIRS_N) return true;
+    g_dir = SD.open(DIRS[g_dirIdx].dir);
+    if (!g_dir || !g_dir.isDirectory()) {
+      if (g_dir) g_dir.close();
+      g_dirIdx++;
+      return false;
+    }
+  }
+  File e = g_dir.openNextFile();
+  if (!e) {
+    g_dir.close();
+    g_dirIdx++;
+    return false;
+  }
+  if (!e.isDirectory()) {
+    const DirCat& d = DIRS[g_dirIdx];
+    const char* base = baseDe(e.name());
+    Candidato c;
+    if (clasificar(d, base, c)) {
+      c.size = (uint32_t)e.size();
+      snprintf(c.path, sizeof(c.path), "%s/%s", strcmp(d.dir, "/") == 0 ? "" : d.dir, base);
+      anotar(g_cat[d.cat], c);
+    }
+  }
+  e.close();
+  return false;
+}
+
+// ====== Compactación ======
+static void cerrarCompactacion() {
+  if (g_src) g_src.close();
+  if (g_tmp) g_tmp.close();
+  if (g_arch) g_arch.close();
+  if (g_jrn) g_jrn.close();
+}
+
+static void logErr(const char* op, const char* path) {
+  LOGE("RETENCION", "RET_ERR", "op=%s;path=%s", op, path);
+}
+
+static bool iniciarCompactacion(const Candidato& c) {
+  g_src = SD.open(c.path, FILE_READ);
+  if (!g_src) { logErr("open", c.path); return false; }
+
+  const char* ext = strrchr(c.path, '.');
+  const bool bin = ext && strcmp(ext, ".bin") == 0;
+  g_srcRecLen = 0;
+  if (bin) {
+    uint8_t hdr[BKP_HDR_LEN];
+    if (g_src.read(hdr, sizeof(hdr)) != sizeof(hdr) || (g_srcRecLen = bkpRecLen(hdr)) == 0) {
+      g_src.close();
+      logErr("header", c.path);
+      return false;
+    }
+  }
+
+  SD.mkdir(RET_DIR_ARCH);
+  if (SD.exists(RET_TMP)) SD.remove(RET_TMP);
+  g_tmp = SD.open(RET_TMP, FILE_WRITE);
+  if (!g_tmp) { g_src.close(); logErr("open", RET_TMP); return false; }
+
+  // Diario de confirmaciones: si existe pero no se abre, el raw se conserva
+  Fase siguiente = COMPACTAR;
+  if (SD.exists(ACK_JOURNAL_PATH)) {
+    g_jrn = SD.open(ACK_JOURNAL_PATH, FILE_READ);
+    if (!g_jrn) { cerrarCompactacion(); logErr("open", ACK_JOURNAL_PATH); return false; }
+    uint8_t hdr[ACK_HDR_LEN];
+    if (g_jrn.read(hdr, sizeof(hdr)) == sizeof(hdr) && ackCabeceraValida(hdr)) {
+      siguiente = ACUSES;
+    } else {
+      g_jrn.close();
+      logErr("header", ACK_JOURNAL_PATH);   // sin ts_envio en el segmento
+    }
+  }
+
+  g_comp = c;
+  packReiniciar(g_pack);
+  g_seg = PackSegmento{ 2, c.fecha, bin, 0, 0, 0, 0xFFFF };
+  g_fase = siguiente;
+  return true;
+}
+
+// Añade 'len' bytes codificados a pack.tmp. false (y compactación abortada) si falla.
+static bool escribirTmp(const uint8_t* p, size_t len) {
+  if (g_tmp.write(p, len) != len) {
+    logErr("write", RET_TMP);
+    cerrarCompactacion();
+    g_fase = PLAN;
+    return false;
+  }
+  g_seg.crc = bkpCrc16(p, len, g_seg.crc);
+  g_seg.len += (uint32_t)len;
+  return true;
+}
+
+// Copia al segmento las entradas del diario que son de este raw
+static void pasoAcuses() {
+  const size_t regs = g_jrn.read(g_lectura, sizeof(g_lectura)) / ACK_REC_LEN;
+  size_t len = 0;
+  for (size_t i = 0; i < regs; i++) {
+    AckEntrada a;
+    if (!ackDecodificar(g_lectura + i * ACK_REC_LEN, a)) continue;
+    if (a.fecha != g_seg.fecha || a.binario != g_seg.binario) continue;
+    len += packCodificarAck(g_pack, PackAck{ a.inicio, a.fin, a.tsEnvio }, g_salida + len);
+    g_seg.nAck++;
+  }
+  if (len && !escribirTmp(g_salida, len)) return;
+  if (regs < RET_REGS_PASO) {
+    g_jrn.close();
+    g_fase = COMPACTAR;
+  }
+}
+
+// Fila de backup CSV (timestamp,measurement,sensor,valor,source,status,ts_envio[,seq]).
+// false para la cabecera y filas de series desconocidas.
+static bool parseFilaCsv(char* linea, BackupRecord& r) {
+  char* c[8];
+  int n = 0;
+  for (char* p = linea; n < 8; ) {
+    c[n++] = p;
+    p = strchr(p, ',');
+    if (!p) break;
+    *p++ = '\0';
+  }
+  if (n < 5) return false;
+  char* fin;
+  r.timestamp = strtoull(c[0], &fin, 10);
+  if (fin == c[0]) return false;
+  r.sensor = sensorIdDesde(c[1], c[2]);
+  if (r.sensor == SENSOR_DESCONOCIDO) return false;
+  r.valor = strtof(c[3], nullptr);
+  r.flags = (origenDesde(c[4]) == ORIGEN_BACKUP) ? BKP_FLAG_ORIGEN_BACKUP : 0;
+  r.seq = (n == 8) ? (uint32_t)strtoul(c[7], nullptr, 10) : 0;
+  return true;
+}
+
+// Lee hasta RET_REGS_PASO registros válidos del raw y los codifica en 'out'.
+// Devuelve los bytes codificados; 'fin' indica que el raw se acabó.
+static size_t leerYCodificar(uint8_t* out, bool& fin) {
+  size_t len = 0;
+  BackupRecord r;
+  if (g_srcRecLen) {
+    const uint32_t base = (uint32_t)g_src.position();
+    size_t regs = g_src.read(g_lectura, RET_REGS_PASO * g_srcRecLen) / g_srcRecLen;
+    fin = regs < RET_REGS_PASO;
+    for (size_t i = 0; i < regs; i++) {
+      if (!bkpDecodificar(g_lectura + i * g_srcRecLen, r, g_srcRecLen) || !sensorDef(r.sensor)) continue;
+      len += packCodificar(g_pack, r, base + (uint32_t)(i * g_srcRecLen), out + len);
+      g_seg.n++;
+    }
+    return len;
+  }
+  fin = false;
+  for (int i = 0; i < RET_REGS_PASO; i++) {
+    if (!g_src.available()) { fin = true; break; }
+    const uint32_t offset = (uint32_t)g_src.position();
+    char linea[128];
+    size_t k = g_src.readBytesUntil('\n', linea, sizeof(linea) - 1);
+    linea[k] = '\0';
+    if (!parseFilaCsv(linea, r)) continue;
+    len += packCodificar(g_pack, r, offset, out + len);
+    g_seg.n++;
+  }
+  return len;
+}
+
+// Raw procesado: abre pack.tmp para copiarlo y el mensual para añadir
+static bool prepararCopia() {
+  g_src.close();
+  g_tmp.flush();
+  g_tmp.close();
+  if (g_seg.n == 0) return true;   // nada que archivar
+
+  g_tmp = SD.open(RET_TMP, FILE_READ);
+  snprintf(g_archPath, sizeof(g_archPath), RET_DIR_ARCH "/raw_%06lu.oxz", (unsigned long)(g_comp.fecha / 100));
+  g_arch = SD.open(g_archPath, FILE_APPEND);
+  if (!g_tmp || !g_arch) { logErr("open", g_archPath); return false; }
+
+  g_archInicial = (uint32_t)g_arch.size();
+  if (g_archInicial == 0) {
+    uint8_t hdr[PACK_HDR_LEN];
+    packCodificarCabecera(hdr, g_comp.fecha / 100);
+    g_arch.write(hdr, sizeof(hdr));
+  }
+  uint8_t seg[PACK_SEG_LEN];
+  packCodificarSegmento(g_seg, seg);
+  return g_arch.write(seg, sizeof(seg)) == sizeof(seg);
+}
+
+static void pasoCompactar() {
+  bool fin;
+  size_t len = leerYCodificar(g_salida, fin);
+  if (len && !escribirTmp(g_salida, len)) return;
+  if (!fin) return;
+  if (!prepararCopia()) {
+    cerrarCompactacion();
+    g_fase = PLAN;
+    return;
+  }
+  g_fase = COPIAR;
+}
+
+static void terminarCompactacion() {
+  uint32_t escritos = 0;
+  if (g_arch) {
+    g_arch.flush();
+    escritos = (uint32_t)g_arch.size() - g_archInicial;
+  }
+  cerrarCompactacion();
+  SD.remove(RET_TMP);
+  // El raw se borra solo con el segmento (registros, offsets y confirmaciones) ya en el mensual
+  if (!SD.remove(g_comp.path)) logErr("remove", g_comp.path);
+
+  EstadoCat& e = g_cat[CAT_RAW];
+  e.bytes = e.bytes - g_comp.size + escritos;
+  g_compactados++;
+  g_liberados += g_comp.size > escritos ? g_comp.size - escritos : 0;
+
+  LOGI("RETENCION", "RET_COMPACT", "n=%lu;acks=%lu;bytes_in=%lu;bytes_out=%lu;path=%s;arch=%s",
+       (unsigned long)g_seg.n, (unsigned long)g_seg.nAck, (unsigned long)g_comp.size, (unsigned long)escritos,
+       g_comp.path, g_seg.n ? g_archPath : "-");
+  g_fase = PLAN;
+}
+
+static void pasoCopiar() {
+  if (!g_arch) { terminarCompactacion(); return; }   // segmento vacío
+  static uint8_t buf[RET_COPIA_PASO];
+  size_t n = g_tmp.read(buf, sizeof(buf));
+  if (n && g_arch.write(buf, n) != n) {
+    logErr("append", g_archPath);
+    cerrarCompactacion();   // el segmento incompleto no pasa el CRC; el raw se conserva
+    g_fase = PLAN;
+    return;
+  }
+  if (n < sizeof(buf)) terminarCompactacion();
+}
+
+// ====== Plan / purga ======
+static void borrarMasAntiguo(uint8_t cat, const char* motivo) {
+  EstadoCat& e = g_cat[cat];
+  Candidato c = e.c[0];
+  quitarCandidato(e, 0);
+  if (!SD.remove(c.path)) { logErr("remove", c.path); return; }
+  e.bytes -= (e.bytes > c.size) ? c.size : e.bytes;
+  g_borrados++;
+  g_liberados += c.size;
+
+  LOGI("RETENCION", "RET_PURGE", "cat=%s;reason=%s;kb=%lu;path=%s", CAT_NOMBRE[cat], motivo,
+       (unsigned long)(c.size / 1024), c.path);
+}
+
+static void finCiclo() {
+  LOGI("RETENCION", "RET_SUMMARY", "raw_kb=%lu;audit_kb=%lu;eventlog_kb=%lu;compactados=%u;borrados=%u;liberados_kb=%lu;ms=%lu",
+       (unsigned long)(g_cat[CAT_RAW].bytes / 1024), (unsigned long)(g_cat[CAT_AUDITORIA].bytes / 1024),
+       (unsigned long)(g_cat[CAT_EVENTLOG].bytes / 1024), (unsigned)g_compactados, (unsigned)g_borrados,
+       (unsigned long)(g_liberados / 1024), g_msActivo);
+  g_fase = ESPERA;
+  g_ultimoCicloMs = millis();
+}
+
+static void pasoPlan() {
+  const int32_t hoy = hoyDias();
+
+  // 1) Compactar el raw más antiguo que ya tenga compactarDias
+  if (config.retencion.compactarDias) {
+    EstadoCat& e = g_cat[CAT_RAW];
+    for (uint8_t i = 0; i < e.n; i++) {
+      if (!e.c[i].compactable) continue;
+      if (edadDias(e.c[i].fecha, hoy) < (int32_t)config.retencion.compactarDias) break;   // los siguientes son más recientes
+      if (iniciarCompactacion(e.c[i])) { quitarCandidato(e, i); return; }
+      e.c[i].compactable = false;   // ilegible: queda solo para la purga
+      return;
+    }
+  }
+
+  // 2) Purga: el más antiguo de la primera categoría fuera de presupuesto.
+  //    Nunca lo de hoy (eventlog en curso) ni el mensual del mes actual.
+  for (uint8_t k = 0; k < CAT_N; k++) {
+    EstadoCat& e = g_cat[k];
+    if (!e.n) continue;
+    const RetencionCategoria& p = presupuesto(k);
+    const int32_t edad = edadDias(e.c[0].fecha, hoy);
+    if (e.c[0].fecha && (hoy < 0 || edad < 1)) continue;
+    const bool porBytes = p.maxKB && e.bytes > (uint64_t)p.maxKB * 1024ULL;
+    const bool porEdad = p.maxDias && edad > (int32_t)p.maxDias;
+    if (!porBytes && !porEdad) continue;
+    borrarMasAntiguo(k, porBytes ? "bytes" : "age");
+    return;
+  }
+  finCiclo();
+}
+
+// ====== API ======
+void retencionTick() {
+  if (g_fase == ESPERA) {
+    if (!g_primerCiclo && millis() - g_ultimoCicloMs < RET_PERIODO_MS) return;
+    g_primerCiclo = false;
+    memset(g_cat, 0, sizeof(g_cat));
+    g_dirIdx = 0;
+    g_compactados = g_borrados = 0;
+    g_liberados = 0;
+    g_msActivo = 0;
+    g_fase = ESCANEO;
+  }
+
+  const unsigned long t0 = millis();
+  do {
+    switch (g_fase) {
+      case ESCANEO:   if (pasoEscaneo()) g_fase = PLAN; break;
+      case PLAN:      pasoPlan(); break;
+      case ACUSES:    pasoAcuses(); break;
+      case COMPACTAR: pasoCompactar(); break;
+      case COPIAR:    pasoCopiar(); break;
+      default:        break;
+    }
+  } while (g_fase != ESPERA && millis() - t0 < RET_SLICE_MS);
+  g_msActivo += millis() - t0;
+}
+
+void retencionAbortar() {
+  if (g_dir) g_dir.close();
+  cerrarCompactacion();
+  if (g_fase != ESPERA) {
+    g_fase = ESPERA;
+    g_ultimoCicloMs = millis();
+  }
+}
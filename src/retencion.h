@@ -0,0 +1,30 @@
+#ifndef RETENCION_H
+#define RETENCION_H
+
+// Retención de la SD: presupuestos de bytes y de antigüedad por categoría
+// (config.retencion) y compactación de /sent/raw/ en archivos mensuales
+// /sent/arch/raw_YYYYMM.oxz (raw_pack.h).
+//
+// Trabaja por pasos cortos: cada llamada a retencionTick() hace como mucho
+// RET_SLICE_MS de trabajo (un paso de escaneo, un bloque de compactación o un
+// borrado) y devuelve. El FSM la llama solo en IDLE, fuera de las ventanas de
+// muestreo.
+
+#include <Arduino.h>
+
+// Tiempo entre ciclos (escaneo + compactación + purga)
+#ifndef RET_PERIODO_MS
+#define RET_PERIODO_MS 600000UL
+#endif
+// Presupuesto de cada llamada
+#ifndef RET_SLICE_MS
+#define RET_SLICE_MS 10
+#endif
+
+// Un paso de retención (solo desde loop())
+void retencionTick();
+
+// Cierra lo que esté abierto y reinicia el ciclo (antes de reinicializar la SD)
+void retencionAbortar();
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+// Registro compacto de una medición, compartido por el envío en lote,
+// el respaldo en SD y el reenvío. Sin dependencias de Arduino para que
+// las herramientas de host puedan reutilizarlo.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// === Series conocidas (measurement + sensor) ===
+enum SensorId : uint8_t {
+  SENSOR_DESCONOCIDO = 0,
+  SENSOR_CAUDAL      = 1,   // caudal / YF-S201
+  SENSOR_TEMPERATURA = 2,   // temperatura / MAX6675
+  SENSOR_VOLTAJE     = 3,   // voltaje / ZMPT101B
+  SENSOR_CAUDAL_TOTAL = 4,  // caudal_total / YF-S201 (L acumulados)
+  SENSOR_VOLTAJE_FRECUENCIA = 5,  // voltaje_frecuencia / ZMPT101B (Hz)
+  SENSOR_VOLTAJE_CRESTA = 6,      // voltaje_cresta / ZMPT101B (pico / eficaz)
+  SENSOR_VOLTAJE_THD  = 7,  // voltaje_thd / ZMPT101B (% del fundamental)
+  SENSOR_VOLTAJE_H3   = 8,  // voltaje_h3 / ZMPT101B (% del fundamental)
+  SENSOR_VOLTAJE_H5   = 9,  // voltaje_h5 / ZMPT101B (% del fundamental)
+  SENSOR_RELOJ_OFFSET = 10, // reloj_offset / DS3231 (ms, NTP − hora entregada)
+  SENSOR_RELOJ_DERIVA = 11, // reloj_deriva / DS3231 (ppm compensados)
+};
+
+// === Origen del dato (tag "source") ===
+enum OrigenMuestra : uint8_t {
+  ORIGEN_WIFI   = 0,
+  ORIGEN_BACKUP = 1,
+};
+
+struct SensorDef {
+  const char* measurement;
+  const char* sensor;
+};
+
+struct Sample {
+  unsigned long long timestamp;  // µs UNIX
+  float valor;
+  uint8_t sensor;                // SensorId
+  uint8_t origen;                // OrigenMuestra
+  uint32_t seq;                  // secuencia por dispositivo (secuencia.h); 0 = sin secuencia
+};
+
+static const SensorDef SENSOR_DEFS[] = {
+  { nullptr,       nullptr    },  // SENSOR_DESCONOCIDO
+  { "caudal",      "YF-S201"  },
+  { "temperatura", "MAX6675"  },
+  { "voltaje",     "ZMPT101B" },
+  { "caudal_total", "YF-S201" },
+  { "voltaje_frecuencia", "ZMPT101B" },
+  { "voltaje_cresta", "ZMPT101B" },
+  { "voltaje_thd",  "ZMPT101B" },
+  { "voltaje_h3",   "ZMPT101B" },
+  { "voltaje_h5",   "ZMPT101B" },
+  { "reloj_offset", "DS3231"   },
+  { "reloj_deriva", "DS3231"   },
+};
+static const uint8_t SENSOR_DEFS_N = sizeof(SENSOR_DEFS) / sizeof(SENSOR_DEFS[0]);
+
+// Devuelve la definición de la serie o nullptr si el id no es conocido.
+inline const SensorDef* sensorDef(uint8_t id) {
+  if (id == SENSOR_DESCONOCIDO || id >= SENSOR_DEFS_N) return nullptr;
+  return &SENSOR_DEFS[id];
+}
+
+// Busca el id a partir de measurement/sensor (p.ej. al parsear un CSV de backup).
+inline uint8_t sensorIdDesde(const char* measurement, const char* sensor) {
+  if (!measurement || !sensor) return SENSOR_DESCONOCIDO;
+  for (uint8_t i = 1; i < SENSOR_DEFS_N; i++) {
+    if (strcmp(SENSOR_DEFS[i].measurement, measurement) == 0 &&
+        strcmp(SENSOR_DEFS[i].sensor, sensor) == 0) return i;
+  }
+  return SENSOR_DESCONOCIDO;
+}
+
+inline const char* origenNombre(uint8_t origen) {
+  return (origen == ORIGEN_BACKUP) ? "backup" : "wifi";
+}
+
+inline uint8_t origenDesde(const char* source) {
+  return (source && strcmp(source, "backup") == 0) ? ORIGEN_BACKUP : ORIGEN_WIFI;
+}
+
+#endif
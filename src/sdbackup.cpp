@@ -2,84 +2,262 @@
 #include "sdlog.h"
 #include "ds3231_time.h"
 #include "config.h"
+#include "bufwriter.h"
+#include "formato_muestra.h"
+#include "backup_record.h"
+#include "sample.h"
+#include "backlog.h"
 #include <SD.h>
 #include <SPI.h>
 #include <time.h>
 
+// Commit agrupado: se vuelca al llegar a BACKUP_COMMIT_BYTES o cuando el
+// registro más antiguo del buffer cumple BACKUP_COMMIT_MS (lo que ocurra antes).
+#ifndef BACKUP_BUF_LEN
+#define BACKUP_BUF_LEN 2048
+#endif
+#ifndef BACKUP_COMMIT_BYTES
+#define BACKUP_COMMIT_BYTES 1536
+#endif
+#ifndef BACKUP_COMMIT_MS
+#define BACKUP_COMMIT_MS 1000
+#endif
+// Sin SD durante este tiempo, el buffer se descarta (BACKUP_DROP)
+#ifndef BACKUP_DESCARTE_MS
+#define BACKUP_DESCARTE_MS 60000
+#endif
+
 static bool g_sdbackup_announced_ok = false;
 static bool g_sdbackup_announced_fail = false;
 static unsigned long g_last_fail_log_ms = 0;
 
-static inline String ensureRootSlash(const String& p) {
-  if (p.length() == 0) return "/";
-  return (p[0] == '/') ? p : ("/" + p);
-}
+static inline bool backupBinario() { return config.backup.formato == BackupFormato::BINARIO; }
 
-String generarNombreArchivoBackup() {
+// Fecha UTC YYYYMMDD del backup; 0 si el RTC no es fiable.
+static uint32_t fechaBackupYmd() {
   uint32_t unixS = getUnixSeconds();
   bool rtc_ok = rtcIsPresent() && rtcIsTimeValid()
                 && (unixS >= 1609459200UL) && (unixS <= 4102444800UL);
-
-  if (!rtc_ok) return "/backup_unsync.csv";
+  if (!rtc_ok) return 0;
 
   time_t t = (time_t)unixS;
   struct tm tm_utc;
   gmtime_r(&t, &tm_utc);
+  return (uint32_t)((tm_utc.tm_year + 1900) * 10000 + (tm_utc.tm_mon + 1) * 100 + tm_utc.tm_mday);
+}
 
-  char nombre[32];
-  snprintf(nombre, sizeof(nombre), "/backup_%04d%02d%02d.csv",
-           tm_utc.tm_year + 1900, tm_utc.tm_mon + 1, tm_utc.tm_mday);
-  return String(nombre);
+// Ruta del backup del día (UTC) en 'out': /backup/YYYY/MM/backup_YYYYMMDD.<ext>,
+// o /backup/backup_unsync.<ext> si el RTC no es fiable.
+// La extensión (.csv / .bin) sigue config.backup.formato.
+void generarNombreArchivoBackup(char* out, size_t n) {
+  backlogRutaArchivo(fechaBackupYmd(), backupBinario(), out, n);
 }
 
-void guardarEnBackupSD(const String& measurement,
-                       const String& sensor,
-                       float valor,
-                       unsigned long long timestamp,
-                       const String& source) {
-  String nombreArchivo = ensureRootSlash(generarNombreArchivoBackup());
-
-  if (!SD.exists(nombreArchivo)) {
-    File f = SD.open(nombreArchivo, FILE_WRITE);
-    if (!f) {
-      if (!g_sdbackup_announced_fail || (millis() - g_last_fail_log_ms) > 10000) {
-        logEventoM("SD_BACKUP", "MOD_FAIL", "op=create;path=" + nombreArchivo + ";err=open_failed");
-        g_sdbackup_announced_fail = true;
-        g_last_fail_log_ms = millis();
+static void logFalloBackup(const char* op, const char* path) {
+  if (!g_sdbackup_announced_fail || (millis() - g_last_fail_log_ms) > 10000) {
+    LOGE("SD_BACKUP", "MOD_FAIL", "op=%s;path=%s;err=open_failed", op, path);
+    g_sdbackup_announced_fail = true;
+    g_last_fail_log_ms = millis();
+  }
+}
+
+// ====== Escritor con commit agrupado ======
+// Mantiene abierto el archivo del día y acumula registros en RAM; un commit
+// (write + flush) vuelca el buffer entero. Solo se usa desde loop(): la tarea
+// uplink devuelve sus fallos por g_retorno y el loop los respalda aquí.
+class BackupWriter {
+public:
+  // Añade un registro ya codificado al archivo de 'fecha' (rota si cambió)
+  void agregar(uint32_t fecha, bool binario, const uint8_t* p, size_t n) {
+    rotar(fecha, binario);
+    if (len_ + n > sizeof(buf_) && !commit()) descartar("buffer_full");
+    if (len_ + n > sizeof(buf_)) return;
+    if (len_ == 0) primeroMs_ = millis();
+    memcpy(buf_ + len_, p, n);
+    len_ += n;
+    regs_++;
+    if (len_ >= BACKUP_COMMIT_BYTES) commit();
+  }
+
+  // Registro binario: se codifica con el tamaño del archivo de destino
+  // (un .bin v1 del día de la actualización sigue recibiendo registros v1)
+  void agregarBin(uint32_t fecha, const BackupRecord& r) {
+    rotar(fecha, true);
+    uint8_t rec[BKP_REC_LEN];
+    bkpCodificar(r, rec, recLen_);
+    agregar(fecha, true, rec, recLen_);
+  }
+
+  // Vuelca el buffer al archivo abierto. false si no se pudo escribir.
+  bool commit() {
+    if (len_ == 0) return true;
+    if (!f_ && !abrir()) return false;
+    // abrir() pudo ver que parte (o todo) del intento anterior ya estaba escrito
+    if (len_) {
+      f_.flush();   // size() cuenta solo lo volcado (p.ej. la cabecera recién escrita)
+      const uint32_t antes = (uint32_t)f_.size();
+      size_t w = f_.write(buf_, len_);
+      f_.flush();
+      if (w != len_) {
+        logFalloBackup("commit", path_);
+        LOGE("SD_BACKUP", "SD_ERR", "reason=commit_failed;escritos=%lu;de=%lu", (unsigned long)w, (unsigned long)len_);
+        // Lo que llegó a la tarjeta se sabrá al reabrir (tamaño real del archivo)
+        pendienteDesde_ = antes;
+        f_.close();   // se reabre en el siguiente commit
+        return false;
       }
-      logEventoM("SD_BACKUP", "SD_ERR", "reason=create_failed");
-      return;
     }
-    f.println("timestamp,measurement,sensor,valor,source,status,ts_envio");
-    f.flush(); f.close();
+    backlogRegistrarEscritura(fecha_, binario_, (uint32_t)f_.size());
+    LOGI("SD_BACKUP", "BACKUP_OK", "n=%lu;bytes=%lu;path=%s", (unsigned long)regs_, (unsigned long)len_, path_);
+    len_ = 0;
+    regs_ = 0;
+    return true;
+  }
+
+  void tick() {
+    if (len_ && millis() - primeroMs_ >= BACKUP_COMMIT_MS) {
+      if (!commit() && millis() - primeroMs_ >= BACKUP_DESCARTE_MS) descartar("sd_down");
+    }
+    // Cambio de día UTC sin muestras nuevas: cerrar para que el reenvío pueda archivarlo
+    if (activo_ && millis() - ultimaRotacionMs_ >= 1000) {
+      ultimaRotacionMs_ = millis();
+      if (fechaBackupYmd() != fecha_ && commit()) { cerrar(); activo_ = false; }
+    }
+  }
+
+  void cerrar() { if (f_) f_.close(); }
+
+  bool esActivo(uint32_t fecha, bool binario) const {
+    return activo_ && fecha == fecha_ && binario == binario_;
+  }
+
+private:
+  File f_;
+  char path_[48] = {0};
+  uint32_t fecha_ = 0;
+  bool binario_ = false;
+  bool activo_ = false;
+  uint8_t recLen_ = BKP_REC_LEN;   // .bin: tamaño de registro del archivo abierto
+  uint8_t buf_[BACKUP_BUF_LEN];
+  size_t len_ = 0;
+  uint32_t regs_ = 0;
+  unsigned long primeroMs_ = 0;
+  unsigned long ultimaRotacionMs_ = 0;
+  // Tamaño del archivo antes de un commit fallido; SIN_PENDIENTE si no lo hubo
+  static const uint32_t SIN_PENDIENTE = 0xFFFFFFFFUL;
+  uint32_t pendienteDesde_ = SIN_PENDIENTE;
+
+  // Tras un commit fallido: quitar del buffer lo que sí llegó al archivo y
+  // seguir justo detrás, sin duplicar bytes ni dejar un registro partido a
+  // medio archivo. false si el tamaño no cuadra (se escribe el buffer entero).
+  bool reanudar(uint32_t sz) {
+    const uint32_t desde = pendienteDesde_;
+    pendienteDesde_ = SIN_PENDIENTE;
+    if (sz < desde || sz - desde > len_) {
+      LOGW("SD_BACKUP", "BACKUP_WARN", "reason=resume_mismatch;size=%lu;antes=%lu;buf=%lu", (unsigned long)sz,
+           (unsigned long)desde, (unsigned long)len_);
+      return false;
+    }
+    const size_t llegados = sz - desde;
+    memmove(buf_, buf_ + llegados, len_ - llegados);
+    len_ -= llegados;
+    LOGW("SD_BACKUP", "BACKUP_WARN", "reason=commit_resume;llegados=%lu;resto=%lu", (unsigned long)llegados,
+         (unsigned long)len_);
+    return true;
   }
 
-  File f = SD.open(nombreArchivo, FILE_APPEND);
-  if (!f) {
-    f = SD.open(nombreArchivo, FILE_WRITE);
-    if (f) f.seek(f.size());
+  void rotar(uint32_t fecha, bool binario) {
+    if (activo_ && fecha == fecha_ && binario == binario_) return;
+    if (!commit()) descartar("rotate");
+    cerrar();
+    fecha_ = fecha;
+    binario_ = binario;
+    activo_ = true;
+    backlogRutaArchivo(fecha_, binario_, path_, sizeof(path_));
+    recLen_ = binario_ ? recLenExistente() : BKP_REC_LEN;
   }
 
-  if (f) {
-    String fila = String(timestamp) + "," + measurement + "," + sensor + "," +
-                  String(valor, 2) + "," + source + ",PENDIENTE,";
-    f.println(fila);
-    f.flush(); f.close();
+  // Tamaño de registro del .bin existente (cabecera); BKP_REC_LEN si es nuevo
+  uint8_t recLenExistente() {
+    File f = SD.open(path_, FILE_READ);
+    if (!f) return BKP_REC_LEN;
+    uint8_t hdr[BKP_HDR_LEN];
+    uint8_t rl = (f.read(hdr, sizeof(hdr)) == sizeof(hdr)) ? bkpRecLen(hdr) : 0;
+    f.close();
+    return rl ? rl : BKP_REC_LEN;
+  }
+
+  bool abrir() {
+    backlogRutaArchivo(fecha_, binario_, path_, sizeof(path_), true);   // crea /backup/YYYY/MM
+    f_ = SD.open(path_, FILE_APPEND);
+    if (!f_) {
+      logFalloBackup("open", path_);
+      LOGE("SD_BACKUP", "SD_ERR", "reason=open_failed");
+      return false;
+    }
+    uint32_t sz = (uint32_t)f_.size();
+    if (pendienteDesde_ != SIN_PENDIENTE && sz > 0 && reanudar(sz)) {
+      // El buffer continúa exactamente donde se cortó la escritura
+    } else if (sz == 0) {
+      if (binario_) {
+        uint8_t hdr[BKP_HDR_LEN];
+        bkpCodificarCabecera(hdr, fecha_);
+        f_.write(hdr, sizeof(hdr));
+      } else {
+        f_.print("timestamp,measurement,sensor,valor,source,status,ts_envio,seq\r\n");
+      }
+    } else if (binario_ && sz >= BKP_HDR_LEN && (sz - BKP_HDR_LEN) % recLen_) {
+      // Si un corte dejó un registro a medias, rellenar hasta la frontera:
+      // ese hueco falla el CRC y el lector lo salta sin desalinear el resto.
+      static const uint8_t ceros[BKP_REC_LEN] = {0};
+      f_.write(ceros, recLen_ - (sz - BKP_HDR_LEN) % recLen_);
+    }
 
     if (!g_sdbackup_announced_ok) {
-      logEventoM("SD_BACKUP", "MOD_UP", "cs=" + String(config.pins.SD_CS) + ";fs=SD;mode=append");
+      LOGI("SD_BACKUP", "MOD_UP", "cs=%d;fs=SD;mode=group_commit;fmt=%s;commit_ms=%u",
+           config.pins.SD_CS, binario_ ? "bin" : "csv", (unsigned)BACKUP_COMMIT_MS);
       g_sdbackup_announced_ok = true;
-      g_sdbackup_announced_fail = false;
     }
+    g_sdbackup_announced_fail = false;
+    return true;
+  }
 
-    logEventoM("SD_BACKUP", "BACKUP_OK",
-               "sensor=" + sensor + ";valor=" + String(valor, 2) + ";src=" + source);
-  } else {
-    if (!g_sdbackup_announced_fail || (millis() - g_last_fail_log_ms) > 10000) {
-      logEventoM("SD_BACKUP", "MOD_FAIL", "op=append;path=" + nombreArchivo + ";err=open_failed");
-      g_sdbackup_announced_fail = true;
-      g_last_fail_log_ms = millis();
+  void descartar(const char* reason) {
+    LOGI("SD_BACKUP", "BACKUP_DROP", "reason=%s;n=%lu", reason, (unsigned long)regs_);
+    len_ = 0;
+    regs_ = 0;
+    pendienteDesde_ = SIN_PENDIENTE;
+  }
+};
+
+static BackupWriter g_writer;
+
+void guardarEnBackupSD(const char* measurement,
+                       const char* sensor,
+                       float valor,
+                       unsigned long long timestamp,
+                       const char* source,
+                       uint32_t seq) {
+  const bool binario = backupBinario();
+  const uint32_t fecha = fechaBackupYmd();
+
+  if (binario) {
+    uint8_t sensorId = sensorIdDesde(measurement, sensor);
+    if (sensorId == SENSOR_DESCONOCIDO) {
+      LOGE("SD_BACKUP", "SD_ERR", "reason=sensor_desconocido;fmt=bin");
+      return;
     }
-    logEventoM("SD_BACKUP", "SD_ERR", "reason=append_failed");
+    BackupRecord r{ timestamp, sensorId, valor,
+                    (uint8_t)(origenDesde(source) == ORIGEN_BACKUP ? BKP_FLAG_ORIGEN_BACKUP : 0), seq };
+    g_writer.agregarBin(fecha, r);
+  } else {
+    FixedBuf<112> fila;
+    formatoFilaCsv(fila, timestamp, measurement, sensor, valor, source, seq);
+    g_writer.agregar(fecha, false, (const uint8_t*)fila.c_str(), fila.length());
   }
-}
\ No newline at end of file
+}
+
+void backupTick()  { g_writer.tick(); }
+bool backupSync()  { return g_writer.commit(); }
+void backupCerrar() { g_writer.commit(); g_writer.cerrar(); }
+bool backupEsArchivoActivo(uint32_t fecha, bool binario) { return g_writer.esActivo(fecha, binario); }
@@ -3,7 +3,20 @@
 
 #include <Arduino.h>
 
-void guardarEnBackupSD(const String& measurement, const String& sensor, float valor, unsigned long long timestamp, const String& source);
+// Añade la muestra al buffer del archivo del día; el volcado a SD es agrupado.
+// 'seq' es la secuencia ya asignada a la muestra (se conserva en el reenvío).
+void guardarEnBackupSD(const char* measurement, const char* sensor, float valor, unsigned long long timestamp, const char* source, uint32_t seq);
+
+// Llamar en cada loop(): commit por tiempo y cierre al cambiar el día UTC.
+// Cada commit actualiza el tamaño del archivo en el manifiesto (backlog.h).
+void backupTick();
+// Commit explícito del buffer pendiente. false si la SD no aceptó la escritura.
+bool backupSync();
+// Commit y cierre del archivo (antes de reinicializar la SD)
+void backupCerrar();
+// true si el archivo de 'fecha' (YYYYMMDD, 0 = unsync) es el que el escritor mantiene abierto
+bool backupEsArchivoActivo(uint32_t fecha, bool binario);
+
 void testBackup();  // función de prueba opcional
 
 #endif
@@ -5,29 +5,81 @@
 #include <FS.h>
 #include <time.h>
 #include <string.h>
+#include <stdarg.h>
 #include "ntp.h"
 #include "ds3231_time.h"
+#include "log_bin.h"
+#include "ratelimit.h"
 
 #define LOG_LINE_MAX 240
-#define Q_SIZE 16
-static char q_buf[Q_SIZE][LOG_LINE_MAX];
-static volatile uint8_t q_head = 0, q_tail = 0;
+#define LOG_KV_MAX 120
 
-static bool sd_ready = false;
-static bool in_flush = false;
-static int curY = 0, curM = 0, curD = 0;
+// Doble buffer: logEventoF() solo escribe la línea al buffer activo; logTick()
+// (loop) lo intercambia al pasar LOG_FLUSH_BYTES o LOG_FLUSH_MS y vuelca el
+// otro al archivo del día, que queda abierto entre volcados. Con los dos
+// buffers ocupados (SD lenta o ausente) la línea se descarta y se cuenta.
+#ifndef LOG_BUF_LEN
+#define LOG_BUF_LEN 4096
+#endif
+#ifndef LOG_FLUSH_BYTES
+#define LOG_FLUSH_BYTES 3072
+#endif
+#ifndef LOG_FLUSH_MS
+#define LOG_FLUSH_MS 2000
+#endif
 
-struct Rate {
-  char key[40];
-  uint32_t last_ms;
-  uint16_t count;
+struct LogBuf {
+  char d[LOG_BUF_LEN];
+  size_t len;
 };
-static Rate rateTbl[8];
-static const uint32_t RATE_WIN_MS = 2000;
+static LogBuf g_buf[2];
+static uint8_t g_activo = 0;           // buffer donde escriben los productores
+static bool g_pendiente = false;       // el otro buffer espera volcado (g_activo no cambia)
+static unsigned long g_primeraMs = 0;  // primera línea del buffer activo
+static bool g_urgente = false;         // ERROR: volcar en el siguiente logTick()
+static unsigned long long g_binTs = 0;  // ts del último registro binario del buffer activo
+static LogStats g_stats = {};
+static uint32_t g_descartadasAvisadas = 0;
+
+static bool sd_ready = false;
+static File g_file;
+static char g_filePath[40] = {0};
 
 static uint32_t ms_now() { return millis(); }
 
-static unsigned long long ts_us_now() {
+// logEventoM() se llama desde loop() y desde la tarea uplink
+static SemaphoreHandle_t log_mutex() {
+  static SemaphoreHandle_t m = xSemaphoreCreateRecursiveMutex();
+  return m;
+}
+struct LogLock {
+  LogLock()  { xSemaphoreTakeRecursive(log_mutex(), portMAX_DELAY); }
+  ~LogLock() { xSemaphoreGiveRecursive(log_mutex()); }
+};
+
+// Reloj del logger: una lectura del reloj (I2C del DS3231) como mucho cada
+// LOG_RELOJ_US; entre lecturas el ts se extrapola con micros(). La fecha ISO,
+// la ruta del día y el offset local se recalculan solo al cambiar de segundo.
+// Así una línea de log no espera al bus I2C.
+#ifndef LOG_RELOJ_US
+#define LOG_RELOJ_US 1000000UL
+#endif
+
+static const unsigned long long US_2000 = 946684800ULL * 1000000ULL;   // antes: hora no válida
+
+struct RelojLog {
+  bool leido;
+  unsigned long long baseUs;   // ts de la última lectura
+  unsigned long snap;          // micros() de esa lectura
+  unsigned long long ultimoUs; // último ts entregado (monótono)
+  uint32_t seg;                // segundo de iso/ymd
+  char iso[20];                // "YYYY-MM-DD HH:MM:SS"
+  int y, m, d;                 // fecha local (0 = sin hora)
+  int16_t tzMin;
+};
+static RelojLog g_reloj = {};
+
+static unsigned long long leer_reloj_us() {
   unsigned long long ts = getTimestampMicros();
   if (ts != 0ULL && ts != 943920000000000ULL) return ts;
   time_t t = getTimestamp();
@@ -35,110 +87,175 @@ static unsigned long long ts_us_now() {
   return (unsigned long long)millis() * 1000ULL;
 }
 
-static void ts_iso_now(char* out, size_t n) {
-  uint32_t s = getUnixSeconds();
-  if (s == 0) { snprintf(out, n, "1970-01-01 00:00:00"); return; }
-  time_t t = (time_t)s;
-  struct tm* tmv = localtime(&t);
-  if (!tmv) { snprintf(out, n, "1970-01-01 00:00:00"); return; }
-  snprintf(out, n, "%04d-%02d-%02d %02d:%02d:%02d",
-           tmv->tm_year + 1900, tmv->tm_mon + 1, tmv->tm_mday,
-           tmv->tm_hour, tmv->tm_min, tmv->tm_sec);
-}
-
-static void current_ymd(int& y, int& m, int& d) {
-  uint32_t s = getUnixSeconds();
-  if (s == 0) { y = m = d = 0; return; }
-  time_t t = (time_t)s;
-  struct tm* tmv = localtime(&t);
-  if (!tmv) { y = m = d = 0; return; }
-  y = tmv->tm_year + 1900; m = tmv->tm_mon + 1; d = tmv->tm_mday;
-}
-
-static void ensure_header(const char* path) {
-  if (!SD.exists(path)) {
-    File f = SD.open(path, FILE_WRITE);
-    if (f) {
-      f.println("ts_iso,ts_us,level,mod,code,fsm,kv");
-      f.close();
-    }
-  }
+// Offset de la hora local respecto a UTC, en minutos
+static int16_t tz_min(time_t t) {
+  struct tm lt, gt;
+  if (!localtime_r(&t, &lt) || !gmtime_r(&t, &gt)) return 0;
+  int dias = lt.tm_yday - gt.tm_yday;
+  if (dias > 1) dias = -1;        // cambio de año
+  else if (dias < -1) dias = 1;
+  return (int16_t)(dias * 1440 + (lt.tm_hour - gt.tm_hour) * 60 + (lt.tm_min - gt.tm_min));
 }
 
-static void path_for_today(char* out, size_t n) {
-  int y, m, d; current_ymd(y, m, d);
-  if (y == 0) { snprintf(out, n, "/eventlog_unknown.csv"); return; }
-  snprintf(out, n, "/eventlog_%04d.%02d.%02d.csv", y, m, d);
+static void reloj_formatear(uint32_t seg, bool valido) {
+  g_reloj.seg = seg;
+  struct tm tmv;
+  time_t t = (time_t)seg;
+  if (!valido || !localtime_r(&t, &tmv)) {
+    strcpy(g_reloj.iso, "1970-01-01 00:00:00");
+    g_reloj.y = g_reloj.m = g_reloj.d = 0;
+    g_reloj.tzMin = 0;
+    return;
+  }
+  snprintf(g_reloj.iso, sizeof(g_reloj.iso), "%04d-%02d-%02d %02d:%02d:%02d",
+           tmv.tm_year + 1900, tmv.tm_mon + 1, tmv.tm_mday, tmv.tm_hour, tmv.tm_min, tmv.tm_sec);
+  g_reloj.y = tmv.tm_year + 1900; g_reloj.m = tmv.tm_mon + 1; g_reloj.d = tmv.tm_mday;
+  g_reloj.tzMin = tz_min(t);
 }
 
-static void rotate_if_changed() {
-  int y, m, d; current_ymd(y, m, d);
-  if (y == 0) return;
-  if (y != curY || m != curM || d != curD) {
-    curY = y; curM = m; curD = d;
+// ts del evento; deja g_reloj.iso/ymd/tzMin al día. Con LogLock tomado.
+static unsigned long long ts_us_now() {
+  unsigned long m = micros();
+  unsigned long long us;
+  if (g_reloj.leido && (unsigned long)(m - g_reloj.snap) < LOG_RELOJ_US) {
+    us = g_reloj.baseUs + (unsigned long)(m - g_reloj.snap);
+  } else {
+    us = leer_reloj_us();
+    g_reloj.leido = true;
+    g_reloj.baseUs = us;
+    g_reloj.snap = m;
   }
+  // Una relectura no retrocede por la extrapolación; un ajuste de hora (NTP) sí
+  if (us < g_reloj.ultimoUs && g_reloj.ultimoUs - us < LOG_RELOJ_US) us = g_reloj.ultimoUs;
+  g_reloj.ultimoUs = us;
+
+  const bool valido = us >= US_2000;
+  const uint32_t seg = valido ? (uint32_t)(us / 1000000ULL) : 0;
+  if (seg != g_reloj.seg || !seg) reloj_formatear(seg, valido);
+  return us;
 }
 
-static void q_push(const char* line) {
-  size_t L = strnlen(line, LOG_LINE_MAX - 1);
-  strncpy(q_buf[q_head], line, LOG_LINE_MAX - 1);
-  q_buf[q_head][ (L < LOG_LINE_MAX - 1) ? L : (LOG_LINE_MAX - 1) ] = '\0';
-  q_head = (q_head + 1) % Q_SIZE;
-  if (q_head == q_tail) {
-    q_tail = (q_tail + 1) % Q_SIZE;
-  }
+static bool binario() { return config.log.formato == LogFormato::BINARIO; }
+
+static void path_for_today(char* out, size_t n) {
+  const char* ext = binario() ? "bin" : "csv";
+  LogLock lock;
+  (void)ts_us_now();
+  if (g_reloj.y == 0) { snprintf(out, n, "/eventlog_unknown.%s", ext); return; }
+  snprintf(out, n, "/eventlog_%04d.%02d.%02d.%s", g_reloj.y, g_reloj.m, g_reloj.d, ext);
+}
+
+// Deja sitio para L bytes en el buffer activo; si no cabe, el lleno pasa a
+// pendiente de volcado. false = los dos ocupados (se descarta). Con LogLock tomado.
+static bool buf_sitio(size_t L) {
+  if (g_buf[g_activo].len + L <= LOG_BUF_LEN) return true;
+  if (g_pendiente) { g_stats.descartadas++; return false; }
+  g_activo ^= 1;
+  g_pendiente = true;
+  return true;
 }
 
-static void flush_queue() {
-  if (in_flush || !sd_ready || q_head == q_tail) return;
-  in_flush = true;
+// Donde escribir la siguiente línea (tras buf_sitio()); buf_confirmar() la cuenta
+static char* buf_libre() { return g_buf[g_activo].d + g_buf[g_activo].len; }
 
-  rotate_if_changed();
+static void buf_confirmar(size_t L) {
+  LogBuf& b = g_buf[g_activo];
+  if (b.len == 0) g_primeraMs = ms_now();
+  b.len += L;
+  g_stats.lineas++;
+}
 
+// Archivo del día abierto (rota al cambiar la fecha local); cabecera si es nuevo
+static bool abrir_archivo() {
   char path[40]; path_for_today(path, sizeof(path));
-  ensure_header(path);
+  if (g_file && strcmp(path, g_filePath) == 0) return true;
+  if (g_file) g_file.close();
+  g_file = SD.open(path, FILE_APPEND);
+  if (!g_file) return false;
+  strncpy(g_filePath, path, sizeof(g_filePath) - 1);
+  if (g_file.size() == 0) {
+    if (binario()) {
+      uint32_t fecha;
+      { LogLock lock; fecha = (uint32_t)(g_reloj.y * 10000 + g_reloj.m * 100 + g_reloj.d); }
+      uint8_t hdr[LOGBIN_HDR_LEN];
+      logbinCodificarCabecera(hdr, fecha);
+      g_file.write(hdr, sizeof(hdr));
+    } else {
+      g_file.print("ts_iso,ts_us,level,mod,code,fsm,kv\r\n");
+    }
+  }
+  return true;
+}
 
-  File f = SD.open(path, FILE_APPEND);
-  if (!f) { in_flush = false; sd_ready = false; return; }
+// Un volcado: intercambia el activo si toca (o si 'forzar') y escribe el pendiente.
+// false si no había nada que escribir o la SD falló.
+static bool volcar_una_vez(bool forzar) {
+  if (!sd_ready) return false;
+  {
+    LogLock lock;
+    const LogBuf& a = g_buf[g_activo];
+    if (!g_pendiente && a.len &&
+        (forzar || g_urgente || a.len >= LOG_FLUSH_BYTES || ms_now() - g_primeraMs >= LOG_FLUSH_MS)) {
+      g_activo ^= 1;
+      g_pendiente = true;
+      g_urgente = false;
+    }
+    if (!g_pendiente) return false;
+  }
 
-  while (q_tail != q_head) {
-    f.println(q_buf[q_tail]);
-    q_tail = (q_tail + 1) % Q_SIZE;
+  // Fuera del lock: los productores siguen escribiendo en el buffer activo
+  LogBuf& b = g_buf[g_activo ^ 1];
+  if (!abrir_archivo()) { sd_ready = false; return false; }
+  size_t w = g_file.write((const uint8_t*)b.d, b.len);
+  g_file.flush();
+  if (w != b.len) {
+    // Se conserva el buffer y se reintenta tras reintentarLogsPendientes()
+    g_file.close();
+    sd_ready = false;
+    return false;
   }
-  f.close();
-  in_flush = false;
-}
-
-static bool throttle_hold_and_accumulate(const char* key, uint16_t& out_count) {
-  for (size_t i = 0; i < sizeof(rateTbl)/sizeof(rateTbl[0]); ++i) {
-    Rate& r = rateTbl[i];
-    if (strncmp(r.key, key, sizeof(r.key)) == 0) {
-      uint32_t now = ms_now();
-      if (now - r.last_ms < RATE_WIN_MS) {
-        r.count++;
-        out_count = r.count;
-        return true;
-      }
-      out_count = r.count;
-      r.count = 0;
-      r.last_ms = now;
-      return false;
-    }
+  LogLock lock;
+  b.len = 0;
+  g_pendiente = false;
+  g_stats.volcados++;
+  g_stats.bytes += (uint32_t)w;
+  return true;
+}
+
+static void volcar(bool forzar) {
+  // Forzado: el pendiente (si lo hay) y después el activo
+  for (int i = 0; i < (forzar ? 2 : 1); i++) {
+    if (!volcar_una_vez(forzar)) break;
   }
-  strncpy(rateTbl[0].key, key, sizeof(rateTbl[0].key) - 1);
-  rateTbl[0].key[sizeof(rateTbl[0].key) - 1] = '\0';
-  rateTbl[0].last_ms = ms_now();
-  rateTbl[0].count = 0;
-  out_count = 0;
-  return false;
 }
 
-static const char* level_from_code_word(const char* code) {
-  if (!code) return "INFO";
-  if (strstr(code, "ERROR") || strstr(code, "ERR") || strstr(code, "FAIL")) return "ERROR";
-  if (strstr(code, "WARNING") || strstr(code, "WARN") || strstr(code, "RESPALDO") || strstr(code, "TS_INVALID_BACKUP")) return "WARN";
-  if (strstr(code, "DEBUG")) return "DEBUG";
-  return "INFO";
+static uint8_t sev_from_code_word(const char* code) {
+  if (!code) return LOG_SEV_INFO;
+  if (strstr(code, "ERROR") || strstr(code, "ERR") || strstr(code, "FAIL")) return LOG_SEV_ERROR;
+  if (strstr(code, "WARNING") || strstr(code, "WARN") || strstr(code, "RESPALDO") || strstr(code, "TS_INVALID_BACKUP")) return LOG_SEV_WARN;
+  if (strstr(code, "DEBUG")) return LOG_SEV_DEBUG;
+  return LOG_SEV_INFO;
+}
+
+// LOG_SEV_* → nivel guardado (LOG_NIVEL_*, log_bin.h)
+static const uint8_t NIVEL_DE_SEV[4] = { LOG_NIVEL_DEBUG, LOG_NIVEL_INFO, LOG_NIVEL_WARN, LOG_NIVEL_ERROR };
+
+// Registro binario (log_bin.h): el primero de cada buffer lleva ts absoluto
+static void bin_push(unsigned long long us, uint8_t nivel, const char* mod, const char* evento, const char* kv) {
+  LogBinEvento e = { us, 0, nivel, mod, evento, kv };
+  uint8_t rec[LOGBIN_REG_MAX];
+  bool abs = g_buf[g_activo].len == 0;
+  if (abs) e.tzMin = g_reloj.tzMin;
+  size_t L = logbinCodificar(e, abs, g_binTs, rec);
+  if (!abs && g_buf[g_activo].len + L > LOG_BUF_LEN) {
+    // Abrirá el otro buffer: va en absoluto
+    e.tzMin = g_reloj.tzMin;
+    L = logbinCodificar(e, true, 0, rec);
+  }
+  if (!buf_sitio(L)) return;
+  memcpy(buf_libre(), rec, L);
+  buf_confirmar(L);
+  g_binTs = us;
 }
 
 static void sanitize_kv(char* s) {
@@ -148,46 +265,91 @@ static void sanitize_kv(char* s) {
   }
 }
 
+// kv en 'out' (cap incluye el '\0'): printf, sanitizado y ";count=N" si hubo
+// retenidos; como mucho LOG_KV_MAX caracteres. Devuelve la longitud.
+static size_t formatear_kv(char* out, size_t cap, uint16_t count, const char* fmt, va_list ap) {
+  if (cap > LOG_KV_MAX + 1) cap = LOG_KV_MAX + 1;
+  int n = vsnprintf(out, cap, fmt, ap);
+  if (n < 0) { out[0] = '\0'; n = 0; }
+  size_t L = ((size_t)n < cap) ? (size_t)n : cap - 1;
+  sanitize_kv(out);
+  if (count > 0) {
+    n = snprintf(out + L, cap - L, "%scount=%u", L ? ";" : "", count);
+    if (n > 0) L = ((size_t)n < cap - L) ? L + n : cap - 1;
+  }
+  return L;
+}
+
 void inicializarSD() {
+  if (g_file) g_file.close();
   sd_ready = SD.begin(config.pins.SD_CS);
-  int y, m, d; current_ymd(y, m, d);
-  curY = y; curM = m; curD = d;
-  flush_queue();
+  volcar(true);
   Serial.println(sd_ready ? "SD inicializada correctamente (logger v2)" : "SD no detectada (logger v2 en RAM/Serial)");
 }
 
-void logEventoM(const String& mod, const String& evento, const String& detalle) {
-  char key[40];
-  snprintf(key, sizeof(key), "%.18s|%.18s", mod.c_str(), evento.c_str());
-  uint16_t count = 0;
-  if (throttle_hold_and_accumulate(key, count)) return;
-
-  char iso[24]; ts_iso_now(iso, sizeof(iso));
+// Escribe el evento en el buffer (ya pasado el limitador). Con LogLock tomado.
+// En CSV la línea se formatea directamente en el buffer activo.
+static void registrarV(uint8_t sev, const char* mod, const char* evento, uint16_t count, const char* fmt, va_list ap) {
   unsigned long long us = ts_us_now();
-  const char* lvl = level_from_code_word(evento.c_str());
-
-  char kv[128];
-  strncpy(kv, detalle.c_str(), sizeof(kv)-1);
-  kv[sizeof(kv)-1] = '\0';
-  sanitize_kv(kv);
+  const uint8_t nivel = NIVEL_DE_SEV[sev & 3];
+  const char* lvl = LOG_NIVELES[nivel];
+  const char* kv;
+  size_t kvLen;
+  char kvBin[LOG_KV_MAX + 1];
 
-  char kv2[160];
-  if (count > 0) {
-    snprintf(kv2, sizeof(kv2), "%s%scount=%u", kv, (kv[0] ? ";" : ""), count);
+  if (binario()) {
+    kvLen = formatear_kv(kvBin, sizeof(kvBin), count, fmt, ap);
+    kv = kvBin;
+    bin_push(us, nivel, mod, evento, kvBin);
   } else {
-    snprintf(kv2, sizeof(kv2), "%s", kv);
+    if (!buf_sitio(LOG_LINE_MAX + 2)) return;   // peor caso; se confirma lo usado
+    char* line = buf_libre();
+    const char* fsm = "-";
+    int L = snprintf(line, LOG_LINE_MAX, "%s,%llu,%s,%s,%s,%s,", g_reloj.iso, us, lvl, mod, evento, fsm);
+    if (L < 0) return;
+    if (L >= LOG_LINE_MAX) L = LOG_LINE_MAX - 1;
+    kvLen = formatear_kv(line + L, LOG_LINE_MAX - L, count, fmt, ap);
+    kv = line + L;
+    L += kvLen;
+    line[L++] = '\r';
+    line[L++] = '\n';
+    buf_confirmar((size_t)L);
   }
+  if (sev == LOG_SEV_ERROR) g_urgente = true;
 
-  const char* fsm = "-";
-  char line[LOG_LINE_MAX];
-  snprintf(line, sizeof(line), "%s,%llu,%s,%s,%s,%s,%.120s", iso, us, lvl, mod.c_str(), evento.c_str(), fsm, kv2);
+  if (sev >= LOG_SEV_WARN) {
+    Serial.printf("LOG %s [%s] %s -> %.*s\n", lvl, mod, evento, (int)kvLen, kv);
+  }
+}
 
-  q_push(line);
-  flush_queue();
+static void registrarF(uint8_t sev, const char* mod, const char* evento, const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  registrarV(sev, mod, evento, 0, fmt, ap);
+  va_end(ap);
+}
 
-  if (strcmp(lvl, "ERROR") == 0 || strcmp(lvl, "WARN") == 0) {
-    Serial.printf("LOG %s [%s] %s -> %s\n", lvl, mod.c_str(), evento.c_str(), kv2);
-  }
+void logEventoF(uint8_t sev, const char* mod, const char* evento, const char* fmt, ...) {
+  if (!mod) mod = "";
+  if (!evento) evento = "";
+  if (!fmt) fmt = "";
+  LogLock lock;
+  char key[RL_CLAVE_LEN];
+  snprintf(key, sizeof(key), "%.18s|%.18s", mod, evento);
+  uint16_t count = 0;
+  if (!rlPermitir(key, ms_now(), count)) return;   // retenido: ni se formatea
+  va_list ap;
+  va_start(ap, fmt);
+  registrarV(sev, mod, evento, count, fmt, ap);
+  va_end(ap);
+}
+
+void logEventoM(const char* mod, const char* evento, const char* detalle) {
+  const uint8_t sev = sev_from_code_word(evento);
+#if LOG_NIVEL_MIN > LOG_SEV_DEBUG
+  if (sev < LOG_NIVEL_MIN) return;
+#endif
+  logEventoF(sev, mod, evento, "%s", detalle ? detalle : "");
 }
 
 void reintentarLogsPendientes() {
@@ -196,9 +358,43 @@ void reintentarLogsPendientes() {
     return;
   }
   sd_ready = true;
-  char path[40]; path_for_today(path, sizeof(path));
-  ensure_header(path);
-  flush_queue();
+  volcar(true);
   Serial.print("reintentarLogsPendientes(): listo: ");
-  Serial.println(path);
+  Serial.println(g_filePath);
+}
+
+void logTick() {
+  volcar(false);
+
+  // Aviso de descartes (fuera del lock: logEventoM lo toma)
+  uint32_t desc;
+  { LogLock lock; desc = g_stats.descartadas; }
+  if (desc != g_descartadasAvisadas && sd_ready) {
+    LOGW("LOG", "LOG_DROP", "n=%lu;total=%lu", (unsigned long)(desc - g_descartadasAvisadas), (unsigned long)desc);
+    g_descartadasAvisadas = desc;
+  }
+
+  // Primer desalojo del limitador: hay más claves de las que caben en
+  // RL_SLOTS y el límite por clave deja de ser exacto
+  static bool rlLlenoAvisado = false;
+  RlStats rl;
+  { LogLock lock; rl = rlStats(); }
+  if (!rlLlenoAvisado && rl.desalojos && sd_ready) {
+    LOGW("LOG", "MOD_WARN", "err=rl_lleno;claves=%u;slots=%u;desalojos=%lu", (unsigned)rl.claves, (unsigned)RL_SLOTS,
+         (unsigned long)rl.desalojos);
+    rlLlenoAvisado = true;
+  }
+
+  // Claves que se callaron con eventos retenidos (sin pasar por el limitador)
+  LogLock lock;
+  char clave[RL_CLAVE_LEN];
+  uint16_t n;
+  if (rlResumen(ms_now(), clave, sizeof(clave), n)) {
+    registrarF(LOG_SEV_INFO, "LOG", "LOG_SUPPRESSED", "key=%s;n=%u", clave, (unsigned)n);
+  }
+}
+
+LogStats logStats() {
+  LogLock lock;
+  return g_stats;
 }
\ No newline at end of file
@@ -7,8 +7,43 @@
 // Idempotente: puedes llamarla varias veces.
 void inicializarSD();
 
-// NUEVO: logger con módulo explícito (queda en el campo 'mod' del CSV)
-void logEventoM(const String& mod, const String& codigo, const String& mensaje);
+// Niveles de LOGx() y LOG_NIVEL_MIN, de menor a mayor severidad
+#define LOG_SEV_DEBUG 0
+#define LOG_SEV_INFO  1
+#define LOG_SEV_WARN  2
+#define LOG_SEV_ERROR 3
+
+// Nivel mínimo que se compila: las llamadas LOGx() por debajo desaparecen
+// (ni se evalúan sus argumentos). Por defecto se registra todo, DEBUG
+// incluido, como antes de las macros; -DLOG_NIVEL_MIN=LOG_SEV_INFO en
+// platformio.ini para quitar los DEBUG del firmware.
+#ifndef LOG_NIVEL_MIN
+#define LOG_NIVEL_MIN LOG_SEV_DEBUG
+#endif
+
+// Registra un evento con nivel explícito. El kv se formatea con printf
+// directamente en el buffer del logger, y solo si el limitador deja pasar
+// el evento; sin String ni memoria dinámica.
+void logEventoF(uint8_t sev, const char* mod, const char* codigo, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#define LOG_SEV_(sev, mod, codigo, ...) \
+  do { if ((sev) >= LOG_NIVEL_MIN) logEventoF((sev), (mod), (codigo), __VA_ARGS__); } while (0)
+
+// LOGI("SD_BACKUP", "REINTENTO_OK", "enviados=%u;path=%s", n, ruta);
+#define LOGD(mod, codigo, ...) LOG_SEV_(LOG_SEV_DEBUG, mod, codigo, __VA_ARGS__)
+#define LOGI(mod, codigo, ...) LOG_SEV_(LOG_SEV_INFO,  mod, codigo, __VA_ARGS__)
+#define LOGW(mod, codigo, ...) LOG_SEV_(LOG_SEV_WARN,  mod, codigo, __VA_ARGS__)
+#define LOGE(mod, codigo, ...) LOG_SEV_(LOG_SEV_ERROR, mod, codigo, __VA_ARGS__)
+
+// Compatibilidad: el nivel se deduce del código (ERR/FAIL → ERROR,
+// WARN/RESPALDO → WARN, DEBUG → DEBUG, resto INFO) y 'mensaje' va tal cual
+void logEventoM(const char* mod, const char* codigo, const char* mensaje);
+
+// Variante String (compatibilidad): reenvía a la versión const char*
+inline void logEventoM(const String& mod, const String& codigo, const String& mensaje) {
+  logEventoM(mod.c_str(), codigo.c_str(), mensaje.c_str());
+}
 
 
 // LEGACY: compatibilidad con código antiguo -> deja mod="LEG"
@@ -20,4 +55,16 @@ inline void logEvento(const String& code, const String& kv) {
 // Reintenta montar SD si no está lista.
 void reintentarLogsPendientes();
 
+// Llamar en cada loop(): vuelca el buffer de logs al pasar la marca de bytes,
+// el tiempo máximo o tras un ERROR. El archivo del día queda abierto.
+void logTick();
+
+struct LogStats {
+  uint32_t lineas;        // líneas aceptadas en el buffer
+  uint32_t descartadas;   // perdidas con los dos buffers ocupados (LOG_DROP)
+  uint32_t volcados;      // escrituras a SD
+  uint32_t bytes;         // bytes escritos
+};
+LogStats logStats();
+
 #endif
@@ -0,0 +1,47 @@
+// secuencia.cpp - secuencia por dispositivo persistida en NVS por bloques
+// En NVS se guarda el techo reservado ("techo"): todo número < techo puede
+// haberse usado ya. Al arrancar se continúa desde el techo y se reserva el
+// bloque siguiente; un corte pierde como mucho SEQ_BLOQUE números.
+
+#include "secuencia.h"
+#include "sdlog.h"
+#include <Preferences.h>
+
+#define SEQ_NVS_NS   "seq"
+#define SEQ_NVS_KEY  "techo"
+
+static Preferences g_prefs;
+static bool g_ok = false;
+static uint32_t g_siguiente = 0;
+static uint32_t g_techo = 0;
+
+static bool reservar(uint32_t techo) {
+  if (g_prefs.putUInt(SEQ_NVS_KEY, techo) != sizeof(uint32_t)) {
+    LOGE("SEQ", "MOD_FAIL", "err=nvs_write");
+    return false;
+  }
+  g_techo = techo;
+  return true;
+}
+
+void secuenciaIniciar() {
+  if (!g_prefs.begin(SEQ_NVS_NS, false)) {
+    LOGE("SEQ", "MOD_FAIL", "err=nvs_begin");
+    return;
+  }
+  uint32_t techo = g_prefs.getUInt(SEQ_NVS_KEY, 0);
+  g_siguiente = techo ? techo : 1;
+  g_ok = reservar(g_siguiente + SEQ_BLOQUE);
+
+  LOGI("SEQ", "MOD_UP", "desde=%lu;bloque=%u", (unsigned long)g_siguiente, (unsigned)SEQ_BLOQUE);
+}
+
+uint32_t secuenciaSiguiente() {
+  if (!g_ok) return 0;
+  if (g_siguiente >= g_techo && !reservar(g_techo + SEQ_BLOQUE)) {
+    // Sin reserva persistida no se puede garantizar que no se repita tras un reinicio
+    g_ok = false;
+    return 0;
+  }
+  return g_siguiente++;
+}
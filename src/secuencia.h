@@ -0,0 +1,24 @@
+#ifndef SECUENCIA_H
+#define SECUENCIA_H
+
+#include <Arduino.h>
+
+// Número de secuencia por dispositivo, monótono entre reinicios. Cada muestra
+// lleva el suyo en el backup (CSV/BIN) y en el envío (&seq= / campo seq), de
+// modo que el ingest puede deduplicar por (mac, seq) y los reintentos son
+// idempotentes. Se reserva en NVS por bloques: tras un reinicio puede haber
+// huecos, nunca repeticiones.
+
+// Bloque reservado en NVS por escritura
+#ifndef SEQ_BLOQUE
+#define SEQ_BLOQUE 1000
+#endif
+
+// Lee el techo reservado en NVS y reserva el primer bloque. Llamar en setup().
+void secuenciaIniciar();
+
+// Siguiente número (>= 1). 0 si NVS no está disponible: sin deduplicación.
+// Solo desde loop().
+uint32_t secuenciaSiguiente();
+
+#endif
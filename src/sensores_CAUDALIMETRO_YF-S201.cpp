@@ -1,46 +1,209 @@
 #include "sensores_CAUDALIMETRO_YF-S201.h"
+#include "caudal_calc.h"
 #include "config.h"
 #include "sdlog.h"
+#include <driver/pcnt.h>
+#include <driver/mcpwm.h>
+#include <esp_timer.h>
+#include <Preferences.h>
+
+// Pulsos por PCNT (filtro de glitches, sin CPU por pulso) y marca de tiempo de
+// cada flanco por captura MCPWM para la frecuencia recíproca. El cálculo está
+// en caudal_calc.h; aquí solo se leen registros.
+#ifndef CAUDAL_FILTRO_CICLOS
+#define CAUDAL_FILTRO_CICLOS 800     // ciclos APB (80 MHz): pulsos < 10 µs se ignoran
+#endif
+
+#ifndef CAUDAL_NVS_MIN_MS
+#define CAUDAL_NVS_MIN_MS 600000UL    // checkpoint del totalizador como mucho cada 10 min...
+#endif
+#ifndef CAUDAL_NVS_MIN_PULSOS
+#define CAUDAL_NVS_MIN_PULSOS 450UL   // ...y solo si avanzó al menos 1 L
+#endif
+
+#define CAUDAL_PCNT_UNIDAD PCNT_UNIT_0
+#define CAUDAL_NVS_NS  "caudal"
+#define CAUDAL_NVS_KEY "pulsos"
 
-volatile unsigned long pulsos = 0;
 float caudalLPM = 0.0;
 
-void IRAM_ATTR contarPulso() {
-  pulsos++;
+// Escrito por el callback de captura (ISR), leído en el loop
+static portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t g_nCap = 0;
+static volatile uint32_t g_capTicks = 0;
+static volatile uint32_t g_capPrevTicks = 0;
+static volatile int64_t g_flancoUs = 0;
+static uint32_t g_ring[CAUDAL_RING];   // captura (ticks APB) de los últimos flancos
+
+static CaudalAcum g_acum = {};
+static CaudalLectura g_ultima = {};
+static bool g_hwOk = false;
+
+// Totalizador: pulsos desde la puesta en marcha del contador, persistidos en NVS
+static Preferences g_prefs;
+static bool g_nvsOk = false;
+static uint64_t g_totalPulsos = 0;
+static uint64_t g_totalGuardado = 0;
+static unsigned long g_guardadoMs = 0;
+static int16_t g_pcntTotal = 0;
+static unsigned long g_simMs = 0;
+static double g_simResto = 0.0;      // fracción de pulso simulado pendiente
+
+static bool IRAM_ATTR alCapturar(mcpwm_unit_t, mcpwm_capture_channel_id_t, const cap_event_data_t* e, void*) {
+  int64_t t = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&g_mux);
+  g_capPrevTicks = g_capTicks;
+  g_capTicks = e->cap_value;
+  g_ring[g_nCap & (CAUDAL_RING - 1)] = e->cap_value;
+  g_flancoUs = t;
+  g_nCap++;
+  portEXIT_CRITICAL_ISR(&g_mux);
+  return false;
+}
+
+static bool iniciarHardware(int pin) {
+  pcnt_config_t pc = {};
+  pc.pulse_gpio_num = pin;
+  pc.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  pc.lctrl_mode = PCNT_MODE_KEEP;
+  pc.hctrl_mode = PCNT_MODE_KEEP;
+  pc.pos_mode = PCNT_COUNT_INC;      // flanco de subida, como la interrupción RISING anterior
+  pc.neg_mode = PCNT_COUNT_DIS;
+  pc.counter_h_lim = CAUDAL_PCNT_LIM;
+  pc.counter_l_lim = 0;
+  pc.unit = CAUDAL_PCNT_UNIDAD;
+  pc.channel = PCNT_CHANNEL_0;
+  if (pcnt_unit_config(&pc) != ESP_OK) return false;
+  pcnt_set_filter_value(CAUDAL_PCNT_UNIDAD, CAUDAL_FILTRO_CICLOS);
+  pcnt_filter_enable(CAUDAL_PCNT_UNIDAD);
+  pcnt_counter_pause(CAUDAL_PCNT_UNIDAD);
+  pcnt_counter_clear(CAUDAL_PCNT_UNIDAD);
+  pcnt_counter_resume(CAUDAL_PCNT_UNIDAD);
+
+  // El mismo GPIO entra también a la captura (matriz GPIO)
+  if (mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_0, pin) != ESP_OK) return false;
+  mcpwm_capture_config_t cc = {};
+  cc.cap_edge = MCPWM_POS_EDGE;
+  cc.cap_prescale = 1;
+  cc.capture_cb = alCapturar;
+  cc.user_data = nullptr;
+  return mcpwm_capture_enable_channel(MCPWM_UNIT_0, MCPWM_SELECT_CAP0, &cc) == ESP_OK;
+}
+
+static CaudalCrudo leerCrudo() {
+  CaudalCrudo c = {};
+  pcnt_get_counter_value(CAUDAL_PCNT_UNIDAD, &c.pcnt);
+  portENTER_CRITICAL(&g_mux);
+  c.nCap = g_nCap;
+  c.capTicks = g_capTicks;
+  c.capPrevTicks = g_capPrevTicks;
+  c.flancoUs = g_flancoUs;
+  portEXIT_CRITICAL(&g_mux);
+  c.ahoraUs = esp_timer_get_time();
+  return c;
+}
+
+static void guardarTotal() {
+  if (!g_nvsOk) return;
+  if (g_prefs.putULong64(CAUDAL_NVS_KEY, g_totalPulsos) != sizeof(uint64_t)) {
+    LOGE("YF-S201", "MOD_FAIL", "err=nvs_write");
+    return;
+  }
+  g_totalGuardado = g_totalPulsos;
+  g_guardadoMs = millis();
 }
 
 void inicializarSensorCaudal() {
+  g_nvsOk = g_prefs.begin(CAUDAL_NVS_NS, false);
+  if (g_nvsOk) {
+    g_totalPulsos = g_totalGuardado = g_prefs.getULong64(CAUDAL_NVS_KEY, 0);
+  } else {
+    LOGE("YF-S201", "MOD_FAIL", "err=nvs_begin");
+  }
+  g_guardadoMs = millis();
+
   if (config.caudal.mode == Mode::REAL) {
     pinMode(config.caudal.pin1, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(config.caudal.pin1), contarPulso, RISING);
-    Serial.println("Sensor de caudal YF-S201 inicializado (modo real)");
+    g_hwOk = iniciarHardware(config.caudal.pin1);
+    if (!g_hwOk) {
+      LOGE("YF-S201", "MOD_FAIL", "err=pcnt_mcpwm;pin=%d", config.caudal.pin1);
+      return;
+    }
+    caudalReiniciar(g_acum, leerCrudo());
+    g_pcntTotal = g_acum.base.pcnt;
+    Serial.println("Sensor de caudal YF-S201 inicializado (modo real, PCNT)");
   } else {
     Serial.println("Sensor de caudal en modo SIMULACIÓN");
   }
 
-  char kv[24];
-  snprintf(kv, sizeof(kv), "sim=%d", config.caudal.mode == Mode::SIMULATION ? 1 : 0);
-  logEventoM("YF-S201", "MOD_UP", kv);
+  LOGI("YF-S201", "MOD_UP", "sim=%d;filtro_ciclos=%d;total_l=%.3f", config.caudal.mode == Mode::SIMULATION ? 1 : 0,
+       CAUDAL_FILTRO_CICLOS, caudalTotalLitros());
+}
+
+void caudalTick() {
+  if (config.caudal.mode == Mode::SIMULATION) {
+    // Integra el último caudal simulado
+    unsigned long ahora = millis();
+    g_simResto += caudalLPM * CAUDAL_HZ_POR_LPM * (ahora - g_simMs) / 1000.0;
+    g_simMs = ahora;
+    uint64_t enteros = (uint64_t)g_simResto;
+    g_totalPulsos += enteros;
+    g_simResto -= (double)enteros;
+  } else if (g_hwOk) {
+    // El PCNT da la vuelta a los 32767 pulsos (> 2 min a caudal máximo)
+    int16_t pcnt = 0;
+    pcnt_get_counter_value(CAUDAL_PCNT_UNIDAD, &pcnt);
+    g_totalPulsos += caudalDeltaPcnt(g_pcntTotal, pcnt);
+    g_pcntTotal = pcnt;
+  }
+
+  // Cada escritura NVS gasta flash: solo con avance real y espaciadas
+  if (g_totalPulsos - g_totalGuardado >= CAUDAL_NVS_MIN_PULSOS && millis() - g_guardadoMs >= CAUDAL_NVS_MIN_MS) {
+    guardarTotal();
+  }
+}
+
+double caudalTotalLitros() {
+  return (double)g_totalPulsos / CAUDAL_PULSOS_POR_LITRO;
+}
+
+uint32_t caudalTotalLitrosEnteros() {
+  return (uint32_t)floor(caudalTotalLitros());   // CAUDAL_PULSOS_POR_LITRO puede no ser entero
+}
+
+size_t caudalFlancosRecientes(int64_t* tUs, size_t max) {
+  uint32_t ticks[CAUDAL_RING];
+  portENTER_CRITICAL(&g_mux);
+  const uint32_t n = g_nCap;
+  const int64_t ultimoUs = g_flancoUs;
+  size_t k = n < CAUDAL_RING ? n : CAUDAL_RING;
+  if (k > max) k = max;
+  for (size_t i = 0; i < k; i++) ticks[i] = g_ring[(n - k + i) & (CAUDAL_RING - 1)];
+  portEXIT_CRITICAL(&g_mux);
+
+  // Referencia: el último flanco, del que se conoce la hora esp_timer
+  for (size_t i = 0; i < k; i++) {
+    tUs[i] = ultimoUs - (int64_t)((uint32_t)(ticks[k - 1] - ticks[i]) / CAUDAL_TICKS_US);
+  }
+  return k;
 }
 
 void actualizarCaudal() {
   if (config.caudal.mode == Mode::SIMULATION) {
     caudalLPM = random(200, 800) / 100.0;
     Serial.printf("[SIM] Caudal simulado: %.2f L/min\n", caudalLPM);
-  } else {
-    noInterrupts();
-    unsigned long pulsosLeidos = pulsos;
-    pulsos = 0;
-    interrupts();
-    caudalLPM = pulsosLeidos / 7.5;
-    Serial.printf("Caudal leído: %.2f L/min (%lu pulsos)\n", caudalLPM, pulsosLeidos);
+  } else if (g_hwOk) {
+    g_ultima = caudalVentana(g_acum, leerCrudo());
+    caudalLPM = caudalLpm(g_ultima);
+    Serial.printf("Caudal leído: %.3f L/min (%lu pulsos, %lu flancos, %.1f ms)\n", caudalLPM,
+                  (unsigned long)g_ultima.pulsos, (unsigned long)g_ultima.flancos, g_ultima.ventanaUs / 1000.0);
   }
 }
 
 void comenzarLecturaCaudal() {
   if (config.caudal.mode == Mode::REAL) {
-    pulsos = 0;
-    attachInterrupt(digitalPinToInterrupt(config.caudal.pin1), contarPulso, RISING);
+    // El PCNT cuenta siempre; la primera ventana empieza ahora
+    if (g_hwOk) caudalReiniciar(g_acum, leerCrudo());
     Serial.println("Sensor caudal habilitado (modo real)");
   } else {
     Serial.println("[SIM] Inicio lectura continua del caudalímetro");
@@ -49,7 +212,6 @@ void comenzarLecturaCaudal() {
 
 void detenerLecturaCaudal() {
   if (config.caudal.mode == Mode::REAL) {
-    detachInterrupt(digitalPinToInterrupt(config.caudal.pin1));
     Serial.println("Sensor caudal deshabilitado (modo real)");
   } else {
     Serial.println("[SIM] Fin lectura continua del caudalímetro");
@@ -59,3 +221,7 @@ void detenerLecturaCaudal() {
 float obtenerCaudalLPM() {
   return caudalLPM;
 }
+
+CaudalLectura obtenerLecturaCaudal() {
+  return g_ultima;
+}
@@ -2,11 +2,35 @@
 #define SENSORES_CAUDALIMETRO_YF_S201_H
 
 #include <Arduino.h>
+#include "caudal_calc.h"
 
 void inicializarSensorCaudal();
 void actualizarCaudal();
 float obtenerCaudalLPM();
 void comenzarLecturaCaudal();
 void detenerLecturaCaudal();
+// Detalle de la última ventana (pulsos, flancos, duración medida)
+CaudalLectura obtenerLecturaCaudal();
+
+#ifndef CAUDAL_RING
+#define CAUDAL_RING 64   // flancos recientes guardados (potencia de 2)
+#endif
+
+// Acumula los pulsos en el totalizador y lo guarda en NVS cuando toca.
+// Llamar en cada vuelta del loop: cuenta también fuera de la ventana de envío.
+void caudalTick();
+
+// Volumen acumulado (L) desde la puesta en marcha, persistido en NVS
+double caudalTotalLitros();
+
+// El mismo volumen en litros enteros (truncado, no decrece), para la serie
+// caudal_total. El valor viaja como float (Sample, respaldo .bin): los enteros
+// son exactos hasta 2^24 L (16 777 m³), mientras que con decimales la
+// resolución empeoraría al crecer el total (~0.06 L pasados 1000 m³).
+uint32_t caudalTotalLitrosEnteros();
+
+// Copia en tUs los últimos flancos (≤ max, ≤ CAUDAL_RING) en µs esp_timer, del
+// más antiguo al más reciente. Devuelve cuántos. Ver caudalHzDeFlancos().
+size_t caudalFlancosRecientes(int64_t* tUs, size_t max);
 
 #endif
@@ -17,9 +17,7 @@ void inicializarSensorTermocupla() {
   }
 
   // Log de inicio del módulo
-  char kv[24];
-  snprintf(kv, sizeof(kv), "sim=%d", config.termocupla.mode == Mode::SIMULATION ? 1 : 0);
-  logEventoM("MAX6675", "MOD_UP", kv);
+  LOGI("MAX6675", "MOD_UP", "sim=%d", config.termocupla.mode == Mode::SIMULATION ? 1 : 0);
 }
 
 void actualizarTermocupla() {
@@ -42,14 +40,14 @@ void actualizarTermocupla() {
   if (raw == 0x0000) {
     temperaturaC = -127.0;
     Serial.println("MAX6675 sin respuesta (raw = 0x0000)");
-    logEventoM("MAX6675", "READ_ERR", "raw=0x0000");
+    LOGE("MAX6675", "READ_ERR", "raw=0x0000");
     return;
   }
 
   if (raw & 0x0004) {
     temperaturaC = -127.0;
     Serial.println("MAX6675 desconectado o error");
-    logEventoM("MAX6675", "READ_ERR", "desconectado");
+    LOGE("MAX6675", "READ_ERR", "desconectado");
     return;
   }
 
@@ -57,9 +55,7 @@ void actualizarTermocupla() {
   Serial.printf("Temp real: %.2f °C (raw=0x%04X)\n", temperaturaC, raw);
 
   // Log de lectura válida
-  char kv[32];
-  snprintf(kv, sizeof(kv), "t=%.2f;raw=0x%04X", temperaturaC, raw);
-  logEventoM("MAX6675", "LECTURA_OK", kv);
+  LOGI("MAX6675", "LECTURA_OK", "t=%.2f;raw=0x%04X", temperaturaC, raw);
 }
 
 float obtenerTemperatura() {
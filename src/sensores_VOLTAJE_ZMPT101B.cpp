@@ -1,58 +1,105 @@
 // sensores_VOLTAJE_ZMPT101B.cpp - lectura real desde ADC (ZMPT101B)
+// Las muestras llegan por I2S/DMA (adc_continuo): aquí solo se procesa la
+// última ventana completa. El análisis (RMS, frecuencia, armónicos) está en
+// ac_calc.h.
 
 #include "sensores_VOLTAJE_ZMPT101B.h"
 #include "config.h"
 #include "sdlog.h"
+#include "adc_continuo.h"
+
+// Calibración sobre el eficaz: el factor p-p anterior (1142 p-p ≈ 230 V,
+// 0.2014) expresado en cuentas RMS de una senoidal, 0.2014 · 2√2
+#ifndef VOLT_FACTOR_RMS
+#define VOLT_FACTOR_RMS 0.5697f
+#endif
 
 float voltajeAC = 0.0;
+static uint16_t g_ventana[ADC_VENTANA];
+static float g_trabajo[ADC_VENTANA];
+static AcResultado g_analisis = {};
+static bool g_adcOk = false;
 
 void inicializarSensorVoltaje() {
   if (config.voltaje.mode == Mode::SIMULATION) {
     Serial.println("Sensor ZMPT101B inicializado (modo simulacion)");
   } else {
-    Serial.println("Sensor ZMPT101B inicializado (modo REAL - entrada analógica)");
+    g_adcOk = adcContinuoIniciar(config.voltaje.pin1);
+    Serial.println("Sensor ZMPT101B inicializado (modo REAL - ADC continuo I2S/DMA)");
   }
 
-  char kv[24];
-  snprintf(kv, sizeof(kv), "sim=%d", config.voltaje.mode == Mode::SIMULATION ? 1 : 0);
-  logEventoM("ZMPT101B", "MOD_UP", kv);
+  LOGI("ZMPT101B", "MOD_UP", "sim=%d", config.voltaje.mode == Mode::SIMULATION ? 1 : 0);
 }
 
-void actualizarVoltaje() {
+// Muestras/s reales de adc_continuo (ADC_FS_HZ hasta la primera medida). Se
+// registra la primera medida y, con WARN, las que se desvían más de
+// ADC_FS_TOL_PCT: frecuencia y armónicos escalan con este valor.
+static float fsVentana() {
+  static bool registrada = false;
+  static float ultimaWarn = 0;
+  const float fs = adcContinuoStats().fsMedidaHz;
+  if (fs <= 0) return (float)ADC_FS_HZ;
+  const float desvio = (fs - (float)ADC_FS_HZ) * 100.0f / (float)ADC_FS_HZ;
+  if (fabsf(desvio) > ADC_FS_TOL_PCT) {
+    if (fs != ultimaWarn) {
+      LOGW("ZMPT101B", "ADC_RATE", "fs_hz=%.1f;nominal=%d;desvio_pct=%.2f", fs, ADC_FS_HZ, desvio);
+      ultimaWarn = fs;
+    }
+  } else if (!registrada) {
+    LOGI("ZMPT101B", "ADC_RATE", "fs_hz=%.1f;nominal=%d;desvio_pct=%.2f", fs, ADC_FS_HZ, desvio);
+  }
+  registrada = true;
+  return fs;
+}
+
+bool actualizarVoltaje() {
   if (config.voltaje.mode == Mode::SIMULATION) {
     voltajeAC = random(2100, 2500) / 100.0;
-    Serial.printf("[SIM] Voltaje simulado: %.2f V\n", voltajeAC);
-    return;
+    g_analisis = {};
+    g_analisis.valido = true;
+    g_analisis.frecuenciaHz = random(4980, 5020) / 100.0;
+    g_analisis.armonicos[1] = 1.0f;
+    g_analisis.armonicos[3] = random(5, 40) / 1000.0;
+    g_analisis.armonicos[5] = random(5, 30) / 1000.0;
+    g_analisis.thd = sqrtf(g_analisis.armonicos[3] * g_analisis.armonicos[3] +
+                           g_analisis.armonicos[5] * g_analisis.armonicos[5]);
+    g_analisis.cresta = 1.414f - g_analisis.armonicos[3];
+    Serial.printf("[SIM] Voltaje simulado: %.2f V (%.2f Hz)\n", voltajeAC, g_analisis.frecuenciaHz);
+    return true;
   }
 
   // === Modo REAL ===
-  int maxValor = 0;
-  int minValor = 4095;
-
-  // Medir durante ~100 ms (500 muestras cada 200 us)
-  for (int i = 0; i < 500; i++) {
-    int lectura = analogRead(config.voltaje.pin1);
-    if (lectura > maxValor) maxValor = lectura;
-    if (lectura < minValor) minValor = lectura;
-    delayMicroseconds(200);
+  // Última ventana de ADC_VENTANA muestras, analizada al ritmo medido
+  if (!g_adcOk || !adcContinuoVentana(g_ventana)) {
+    LOGW("ZMPT101B", "READ_ERR", "err=no_window;adc=%d", g_adcOk ? 1 : 0);
+    g_analisis.valido = false;
+    return false;
+  }
+  g_analisis = acAnalizar(g_ventana, ADC_VENTANA, fsVentana(), g_trabajo);
+  if (!g_analisis.valido) {
+    // Sin cruces por cero: red ausente o sensor desconectado. El eficaz sigue
+    // siendo válido (≈ 0 V con la entrada en reposo)
+    voltajeAC = g_analisis.rms * VOLT_FACTOR_RMS;
+    LOGW("ZMPT101B", "READ_ERR", "err=no_ac;v=%.2f;media=%.0f", voltajeAC, g_analisis.media);
+    return true;
   }
 
-  int picoPico = maxValor - minValor;
-
-  // Factor calibrado: si 1142 p-p ≈ 230 V => factor ≈ 0.2014
-  const float FACTOR_CALIBRADO = 0.2014;
-  float voltajeEstimado = picoPico * FACTOR_CALIBRADO;
-
-  voltajeAC = voltajeEstimado;  // Valor final para obtenerVoltajeAC()
+  voltajeAC = g_analisis.rms * VOLT_FACTOR_RMS;  // Valor final para obtenerVoltajeAC()
 
-  Serial.printf("Voltaje estimado: %.2f V (pico a pico: %d)\n", voltajeAC, picoPico);
+  Serial.printf("Voltaje eficaz: %.2f V, %.2f Hz, cresta %.3f, THD %.1f%%\n", voltajeAC, g_analisis.frecuenciaHz,
+                g_analisis.cresta, g_analisis.thd * 100.0f);
 
   // Log de medición real
-  char kv[64];
-  snprintf(kv, sizeof(kv), "v=%.2f;pico=%d", voltajeAC, picoPico);
-  logEventoM("ZMPT101B", "READ_OK", kv);
+  LOGI("ZMPT101B", "READ_OK", "v=%.2f;f=%.2f;cresta=%.3f;thd=%.2f;h3=%.2f;h5=%.2f;ciclos=%u", voltajeAC,
+       g_analisis.frecuenciaHz, g_analisis.cresta, g_analisis.thd * 100.0f, g_analisis.armonicos[3] * 100.0f,
+       g_analisis.armonicos[5] * 100.0f, (unsigned)g_analisis.ciclos);
+  return true;
 }
 
 float obtenerVoltajeAC() {
   return voltajeAC;
 }
+
+AcResultado obtenerAnalisisVoltaje() {
+  return g_analisis;
+}
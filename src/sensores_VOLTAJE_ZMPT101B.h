@@ -1,8 +1,15 @@
 #ifndef SENSOR_ZMPT101B_H
 #define SENSOR_ZMPT101B_H
 
+#include "ac_calc.h"
+
 void inicializarSensorVoltaje();
-void actualizarVoltaje();
+// Analiza una ventana nueva. false si no la hubo (ADC sin datos): el eficaz y
+// el análisis siguen siendo los de la anterior y no deben publicarse.
+bool actualizarVoltaje();
 float obtenerVoltajeAC();
+// Análisis de la última ventana (frecuencia, cresta, armónicos); valido=false
+// si no se detectó alterna
+AcResultado obtenerAnalisisVoltaje();
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+// Cola circular lock-free de un solo productor y un solo consumidor.
+// Capacidad fija N (potencia de 2). push() solo desde el productor,
+// pop() solo desde el consumidor; ambos O(1) y sin bloqueos.
+
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing: N debe ser potencia de 2");
+
+public:
+  bool push(const T& v) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    if (head - tail >= N) return false;           // llena
+    buf_[head & (N - 1)] = v;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& out) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) return false;               // vacía
+    out = buf_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T buf_[N];
+  std::atomic<size_t> head_{0};   // escrito solo por el productor
+  std::atomic<size_t> tail_{0};   // escrito solo por el consumidor
+};
+
+#endif
@@ -0,0 +1,166 @@
+// uplink.cpp - separa el muestreo (loop, core 1) del envío por red (tarea, core 0)
+// loop() ──push──> [g_cola SPSC] ──> tareaUplink ──> uplinkTransporte().enviar()
+//    ^                                    │ (fallo / sin WiFi)
+//    └──── guardarEnBackupSD() <──pop── [g_retorno SPSC]
+// reenvío SD (loop) ──bloque──> [g_reenvio, 1 en vuelo] ──> misma tarea ──> resultado
+
+#include "uplink.h"
+#include "api.h"
+#include "sdlog.h"
+#include "sdbackup.h"
+#include "wifi_mgr.h"
+#include "spsc_ring.h"
+#include "uplink_transport.h"
+#include <atomic>
+
+#ifndef UPLINK_CORE
+#define UPLINK_CORE 0
+#endif
+#ifndef UPLINK_STACK
+#define UPLINK_STACK 8192
+#endif
+#ifndef UPLINK_PRIORIDAD
+#define UPLINK_PRIORIDAD 1
+#endif
+// Espera máxima de una muestra en la tarea antes de enviar un lote incompleto
+#ifndef UPLINK_LOTE_ESPERA_MS
+#define UPLINK_LOTE_ESPERA_MS 30000
+#endif
+#ifndef UPLINK_POLL_MS
+#define UPLINK_POLL_MS 100
+#endif
+
+static SpscRing<Sample, UPLINK_RING_CAP> g_cola;      // loop → tarea
+static SpscRing<Sample, UPLINK_RING_CAP> g_retorno;   // tarea → loop (respaldo)
+
+static TaskHandle_t g_tarea = nullptr;
+static std::atomic<bool> g_flush{false};
+static std::atomic<uint32_t> st_encoladas{0}, st_llena{0}, st_enviadas{0}, st_devueltas{0}, st_reenviadas{0};
+
+// Canal de reenvío: LIBRE → (loop) PENDIENTE → (tarea) HECHO → (loop) LIBRE
+enum : uint8_t { REENVIO_LIBRE, REENVIO_PENDIENTE, REENVIO_HECHO };
+static std::atomic<uint8_t> g_reenvioEstado{REENVIO_LIBRE};
+static const Sample* g_reenvioMuestras = nullptr;
+static size_t g_reenvioN = 0;
+static size_t g_reenvioOk = 0;
+
+static void devolverLote(const Sample* lote, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    // El loop drena g_retorno en cada iteración; si está llena, esperar
+    while (!g_retorno.push(lote[i])) vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  st_devueltas += n;
+}
+
+// Envía el bloque de reenvío en sub-lotes; se corta en el primer fallo
+static void atenderReenvio(UplinkTransport& tr, size_t loteMax) {
+  const Sample* m = g_reenvioMuestras;
+  const size_t n = g_reenvioN;
+  size_t ok = 0;
+  while (ok < n && wifiReady() && tr.disponible()) {
+    size_t k = (n - ok < loteMax) ? (n - ok) : loteMax;
+    size_t r = tr.enviar(m + ok, k);
+    ok += r;
+    if (r < k) break;
+  }
+  st_reenviadas += ok;
+  g_reenvioOk = ok;
+  g_reenvioEstado.store(REENVIO_HECHO, std::memory_order_release);
+}
+
+static void tareaUplink(void*) {
+  static Sample lote[API_LOTE_MAX];
+  UplinkTransport& tr = uplinkTransporte();
+  tr.iniciar();
+  const size_t loteMax = (tr.loteMax() < API_LOTE_MAX) ? tr.loteMax() : API_LOTE_MAX;
+  size_t n = 0;
+  unsigned long primeroMs = 0;
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UPLINK_POLL_MS));
+    tr.tick();
+
+    if (g_reenvioEstado.load(std::memory_order_acquire) == REENVIO_PENDIENTE) atenderReenvio(tr, loteMax);
+
+    while (n < loteMax && g_cola.pop(lote[n])) {
+      if (n == 0) primeroMs = millis();
+      n++;
+    }
+    if (n == 0) { g_flush = false; continue; }
+
+    bool toca = (n >= loteMax) || g_flush.load() ||
+                (millis() - primeroMs >= UPLINK_LOTE_ESPERA_MS);
+    if (!toca) continue;
+    if (g_cola.empty()) g_flush = false;
+
+    size_t ok = (wifiReady() && tr.disponible()) ? tr.enviar(lote, n) : 0;
+    if (ok) {
+      st_enviadas += ok;
+      LOGI("API", "API_OK", "lote=%u;via=%s", (unsigned)ok, tr.nombre());
+    }
+    if (ok < n) devolverLote(lote + ok, n - ok);
+    n = 0;
+  }
+}
+
+void uplinkIniciar() {
+  if (g_tarea) return;
+  BaseType_t ok = xTaskCreatePinnedToCore(tareaUplink, "uplink", UPLINK_STACK, nullptr,
+                                          UPLINK_PRIORIDAD, &g_tarea, UPLINK_CORE);
+  if (ok == pdPASS) {
+    LOGI("UPLINK", "MOD_UP", "core=%d;cap=%u;via=%s", UPLINK_CORE, (unsigned)UPLINK_RING_CAP, uplinkTransporte().nombre());
+  } else {
+    g_tarea = nullptr;
+    LOGE("UPLINK", "MOD_FAIL", "err=task_create");
+  }
+}
+
+bool uplinkEncolar(const Sample& s) {
+  if (!g_tarea || !g_cola.push(s)) { st_llena++; return false; }
+  st_encoladas++;
+  return true;
+}
+
+void uplinkFlush() {
+  g_flush = true;
+  if (g_tarea) xTaskNotifyGive(g_tarea);
+}
+
+void uplinkDrenarRespaldo() {
+  Sample s;
+  uint16_t n = 0;
+  while (g_retorno.pop(s)) {
+    const SensorDef* def = sensorDef(s.sensor);
+    if (!def) continue;
+    guardarEnBackupSD(def->measurement, def->sensor, s.valor, s.timestamp, "backup", s.seq);
+    n++;
+  }
+  if (n) {
+    LOGW("SD_BACKUP", "RESPALDO", "reason=uplink_fail;n=%u", (unsigned)n);
+  }
+}
+
+bool uplinkReenvioEnviar(const Sample* muestras, size_t n) {
+  if (!g_tarea || g_reenvioEstado.load(std::memory_order_acquire) != REENVIO_LIBRE) return false;
+  g_reenvioMuestras = muestras;
+  g_reenvioN = n;
+  g_reenvioEstado.store(REENVIO_PENDIENTE, std::memory_order_release);
+  xTaskNotifyGive(g_tarea);
+  return true;
+}
+
+bool uplinkReenvioResultado(size_t& ok) {
+  if (g_reenvioEstado.load(std::memory_order_acquire) != REENVIO_HECHO) return false;
+  ok = g_reenvioOk;
+  g_reenvioEstado.store(REENVIO_LIBRE, std::memory_order_release);
+  return true;
+}
+
+bool uplinkReenvioEnVuelo() {
+  return g_reenvioEstado.load(std::memory_order_acquire) != REENVIO_LIBRE;
+}
+
+UplinkStats uplinkStats() {
+  return UplinkStats{ st_encoladas.load(), st_llena.load(), st_enviadas.load(), st_devueltas.load(),
+                      st_reenviadas.load() };
+}
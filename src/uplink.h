@@ -0,0 +1,51 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <Arduino.h>
+#include "sample.h"
+
+// Capacidad de la cola muestreo → red (potencia de 2)
+#ifndef UPLINK_RING_CAP
+#define UPLINK_RING_CAP 128
+#endif
+
+struct UplinkStats {
+  uint32_t encoladas;     // muestras aceptadas en la cola
+  uint32_t llena;         // rechazadas por cola llena (respaldadas por el llamador)
+  uint32_t enviadas;      // confirmadas por la API
+  uint32_t devueltas;     // devueltas al loop para respaldo en SD
+  uint32_t reenviadas;    // muestras de backup confirmadas por el canal de reenvío
+};
+
+// Crea la tarea de envío (fijada al core 0; loop() corre en el core 1).
+void uplinkIniciar();
+
+// Productor (loop): encola una muestra para envío. false si la cola está llena
+// y el llamador debe respaldarla en SD.
+bool uplinkEncolar(const Sample& s);
+
+// Pide enviar ya lo acumulado (p.ej. al cerrar la ventana de caudal).
+void uplinkFlush();
+
+// Consumidor (loop): respalda en SD las muestras que la tarea no pudo enviar.
+// Mantiene todo el acceso a SD en el loop.
+void uplinkDrenarRespaldo();
+
+// ====== Reenvío desde SD ======
+// Canal aparte de la cola en vivo con un único bloque en vuelo: el loop
+// entrega un bloque ya leído de la SD y lee el siguiente mientras la tarea
+// lo envía (en sub-lotes de loteMax() del transporte).
+// 'muestras' debe seguir válido hasta recoger el resultado.
+
+// false si ya hay un bloque en vuelo
+bool uplinkReenvioEnviar(const Sample* muestras, size_t n);
+
+// true cuando el bloque terminó; 'ok' = prefijo confirmado [0, ok).
+// Libera el canal para el siguiente bloque.
+bool uplinkReenvioResultado(size_t& ok);
+
+bool uplinkReenvioEnVuelo();
+
+UplinkStats uplinkStats();
+
+#endif
@@ -0,0 +1,174 @@
+// uplink_transport.cpp - backends de subida: HTTP GET, HTTP POST en lote y MQTT
+
+#include "uplink_transport.h"
+#include "api.h"
+#include "bufwriter.h"
+#include "config.h"
+#include "sdlog.h"
+#include <WiFi.h>
+#include <MQTT.h>
+
+#ifndef MQTT_LOTE_MAX
+#define MQTT_LOTE_MAX 16
+#endif
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S 30
+#endif
+#ifndef MQTT_TIMEOUT_MS
+#define MQTT_TIMEOUT_MS 5000
+#endif
+#ifndef MQTT_BACKOFF_MIN_MS
+#define MQTT_BACKOFF_MIN_MS 2000
+#endif
+#ifndef MQTT_BACKOFF_MAX_MS
+#define MQTT_BACKOFF_MAX_MS 60000
+#endif
+#define MQTT_BUF_LEN (MQTT_LOTE_MAX * 112 + 128)
+
+// ====== HTTP GET: una petición por muestra (compatibilidad) ======
+class HttpGetTransport : public UplinkTransport {
+public:
+  const char* nombre() const override { return "http_get"; }
+  size_t loteMax() const override { return API_LOTE_MAX; }
+  bool disponible() override { return apiDisponible(); }
+
+  size_t enviar(const Sample* m, size_t n) override {
+    for (size_t i = 0; i < n; i++) {
+      const SensorDef* def = sensorDef(m[i].sensor);
+      if (!def) continue;
+      if (!enviarDatoAPI(def->measurement, def->sensor, m[i].valor, m[i].timestamp, origenNombre(m[i].origen), m[i].seq)) {
+        return i;
+      }
+    }
+    return n;
+  }
+};
+
+// ====== HTTP POST: lote en line protocol ======
+class HttpPostLoteTransport : public UplinkTransport {
+public:
+  const char* nombre() const override { return "http_post"; }
+  size_t loteMax() const override { return API_LOTE_MAX; }
+  bool disponible() override { return apiDisponible(); }
+
+  size_t enviar(const Sample* m, size_t n) override { return enviarLoteAPI(m, n); }
+};
+
+// ====== MQTT: QoS1 sobre conexión persistente ======
+// Un mensaje por lote (payload en line protocol) en <topicBase>/<mac>/lp.
+// Sesión persistente (clean session = false): el broker conserva el estado
+// entre reconexiones. publish() con QoS1 bloquea hasta el PUBACK, que es la
+// confirmación del lote. Probar en local con mosquitto y tools/mqtt_check.py
+// (autoprueba del broker; escuchar para ver la reentrega con el equipo) y
+// config.uplink.mqtt.host = IP del PC en la misma red.
+class MqttTransport : public UplinkTransport {
+public:
+  MqttTransport() : cli_(MQTT_BUF_LEN), mtx_(xSemaphoreCreateMutex()) {}
+
+  const char* nombre() const override { return "mqtt"; }
+  size_t loteMax() const override { return MQTT_LOTE_MAX; }
+
+  void iniciar() override {
+    Lock l(mtx_);
+    if (iniciado_) return;
+    snprintf(clientId_, sizeof(clientId_), "oxigeno-%s", apiMacHex());
+    snprintf(topic_, sizeof(topic_), "%s/%s/lp", config.uplink.mqtt.topicBase.c_str(), apiMacHex());
+    cli_.begin(config.uplink.mqtt.host.c_str(), config.uplink.mqtt.port, net_);
+    cli_.setKeepAlive(MQTT_KEEPALIVE_S);
+    cli_.setCleanSession(false);
+    cli_.setTimeout(MQTT_TIMEOUT_MS);
+    iniciado_ = true;
+  }
+
+  void tick() override {
+    Lock l(mtx_);
+    if (iniciado_ && cli_.connected()) cli_.loop();   // PINGREQ / PUBACK pendientes
+    conectado_ = iniciado_ && cli_.connected();
+  }
+
+  // Sin el mutex: publish() puede tenerlo hasta MQTT_TIMEOUT_MS. Se usa el
+  // estado que dejaron tick()/enviar() con el mutex tomado.
+  bool disponible() override {
+    if (!WiFi.isConnected()) return false;
+    return conectado_ || (long)(millis() - proximoIntentoMs_) >= 0;
+  }
+
+  size_t enviar(const Sample* m, size_t n) override {
+    if (n > MQTT_LOTE_MAX) n = MQTT_LOTE_MAX;
+    iniciar();
+    Lock l(mtx_);
+    const bool ok = conectar();
+    conectado_ = ok;
+    if (!ok) return 0;
+
+    BufWriter body(payload_, sizeof(payload_));
+    if (!construirLoteLP(body, m, n)) return 0;
+    if (body.length() == 0) return n;
+
+    if (cli_.publish(topic_, body.c_str(), (int)body.length(), false, 1)) {
+      publicados_ += n;
+      return n;
+    }
+    LOGE("MQTT", "MQTT_ERR", "err=publish;lwmqtt=%d", (int)cli_.lastError());
+    cli_.disconnect();
+    conectado_ = false;
+    programarReintento();
+    return 0;
+  }
+
+private:
+  struct Lock {
+    SemaphoreHandle_t m;
+    explicit Lock(SemaphoreHandle_t mm) : m(mm) { xSemaphoreTake(m, portMAX_DELAY); }
+    ~Lock() { xSemaphoreGive(m); }
+  };
+
+  WiFiClient net_;
+  MQTTClient cli_;
+  SemaphoreHandle_t mtx_;
+  bool iniciado_ = false;
+  bool upLogged_ = false;
+  volatile bool conectado_ = false;          // cli_.connected() visto con el mutex
+  char clientId_[24] = {0};
+  char topic_[64] = {0};
+  char payload_[MQTT_BUF_LEN];
+  volatile unsigned long proximoIntentoMs_ = 0;
+  uint32_t backoffMs_ = MQTT_BACKOFF_MIN_MS;
+  uint32_t publicados_ = 0;
+
+  void programarReintento() {
+    proximoIntentoMs_ = millis() + backoffMs_;
+    backoffMs_ = (backoffMs_ >= MQTT_BACKOFF_MAX_MS / 2) ? MQTT_BACKOFF_MAX_MS : backoffMs_ * 2;
+  }
+
+  // Con el mutex tomado
+  bool conectar() {
+    if (cli_.connected()) return true;
+    if (!WiFi.isConnected()) return false;
+    if ((long)(millis() - proximoIntentoMs_) < 0) return false;
+
+    const char* user = config.uplink.mqtt.usuario.length() ? config.uplink.mqtt.usuario.c_str() : nullptr;
+    const char* pass = config.uplink.mqtt.clave.length() ? config.uplink.mqtt.clave.c_str() : nullptr;
+    if (!cli_.connect(clientId_, user, pass)) {
+      LOGE("MQTT", "MQTT_CONN_ERR", "host=%s;rc=%d;backoff_ms=%lu",
+           config.uplink.mqtt.host.c_str(), (int)cli_.returnCode(), (unsigned long)backoffMs_);
+      programarReintento();
+      return false;
+    }
+    backoffMs_ = MQTT_BACKOFF_MIN_MS;
+    if (!upLogged_) {
+      LOGI("MQTT", "MOD_UP", "host=%s;topic=%s;qos=1", config.uplink.mqtt.host.c_str(), topic_);
+      upLogged_ = true;
+    }
+    return true;
+  }
+};
+
+UplinkTransport& uplinkTransporte() {
+  switch (config.uplink.tipo) {
+    case UplinkTipo::HTTP_GET:  { static HttpGetTransport t; return t; }
+    case UplinkTipo::MQTT:      { static MqttTransport t;    return t; }
+    case UplinkTipo::HTTP_POST_LOTE:
+    default:                    { static HttpPostLoteTransport t; return t; }
+  }
+}
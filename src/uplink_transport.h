@@ -0,0 +1,37 @@
+#ifndef UPLINK_TRANSPORT_H
+#define UPLINK_TRANSPORT_H
+
+// Interfaz de transporte de subida. La tarea uplink (envío en vivo) y el
+// reenvío desde SD solo hablan con esta interfaz; el backend concreto se
+// elige con config.uplink.tipo.
+
+#include <Arduino.h>
+#include "sample.h"
+
+class UplinkTransport {
+public:
+  virtual ~UplinkTransport() {}
+
+  virtual const char* nombre() const = 0;
+
+  // Máximo de muestras que acepta enviar() en una llamada
+  virtual size_t loteMax() const = 0;
+
+  // Preparación única (conexión persistente, etc.). Idempotente.
+  virtual void iniciar() {}
+
+  // Mantenimiento periódico (keep-alive); se llama desde la tarea uplink.
+  virtual void tick() {}
+
+  // true si merece la pena intentar enviar ahora. Nunca bloquea.
+  virtual bool disponible() = 0;
+
+  // Envía hasta loteMax() muestras. Devuelve cuántas quedaron confirmadas,
+  // siempre un prefijo: [0, ok) enviadas, [ok, n) pendientes.
+  virtual size_t enviar(const Sample* muestras, size_t n) = 0;
+};
+
+// Backend seleccionado por config.uplink.tipo (instancia estática)
+UplinkTransport& uplinkTransporte();
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+// Enteros de longitud variable (LEB128 sin signo, 7 bits por byte) y zigzag
+// para deltas con signo. Lo usan el empaquetado de backups (raw_pack.h) y las
+// herramientas de host. Sin dependencias de Arduino.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VARINT_MAX_LEN 10   // u64
+
+inline uint64_t zigzagCodificar(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t zigzagDecodificar(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+// Escribe v en out; devuelve los bytes usados (1..10)
+inline size_t varintPut(uint8_t* out, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) { out[n++] = (uint8_t)(v | 0x80); v >>= 7; }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+// Lee un varint de [p, fin); devuelve los bytes consumidos o 0 si está truncado/mal formado
+inline size_t varintGet(const uint8_t* p, const uint8_t* fin, uint64_t& v) {
+  v = 0;
+  for (size_t n = 0; n < VARINT_MAX_LEN && p + n < fin; n++) {
+    v |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+    if (!(p[n] & 0x80)) return n + 1;
+  }
+  return 0;
+}
+
+#endif
@@ -19,20 +19,16 @@ static void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
         case ARDUINO_EVENT_WIFI_STA_GOT_IP:
             g_ready = true;
             g_lastChangeMs = millis();
-            {
-                char kv[128];
-                snprintf(kv, sizeof(kv), "ip=%s;mac=%s;rssi=%d",
-                         WiFi.localIP().toString().c_str(),
-                         WiFi.macAddress().c_str(),
-                         WiFi.RSSI());
-                logEventoM("WIFI", "MOD_UP", kv);
-            }
+            LOGI("WIFI", "MOD_UP", "ip=%s;mac=%s;rssi=%d",
+                 WiFi.localIP().toString().c_str(),
+                 WiFi.macAddress().c_str(),
+                 WiFi.RSSI());
             break;
         case ARDUINO_EVENT_WIFI_STA_LOST_IP:
         case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
             g_ready = false;
             g_lastChangeMs = millis();
-            logEventoM("WIFI", "MOD_FAIL", "event=disconnect");
+            LOGE("WIFI", "MOD_FAIL", "event=disconnect");
             break;
         default: break;
     }
@@ -0,0 +1,175 @@
+// ac_calc_test.cpp - prueba en el PC de ac_calc.h (acAnalizar) con formas de
+// onda sintéticas del ZMPT101B, y tiempo por ventana.
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o ac_calc_test tools/ac_calc_test.cpp
+// Uso:
+//   ac_calc_test [ventanas para medir tiempo, 20000 por defecto]
+//   (código de salida 0 = todo bien)
+//
+// Cada caso genera ventanas de ADC_VENTANA muestras a ADC_FS_HZ, como las de
+// adc_continuo.h: continua + fundamental + 3.º y 5.º armónico con fases al
+// azar + ruido gaussiano, cuantizadas a 12 bits. El resultado se compara con
+// lo esperado de la forma de onda ideal:
+//   eficaz      √(ΣA²/2 + σ²)                          ±1 %
+//   frecuencia  la generada                            ±0.1 % + jitter de los cruces por el ruido
+//   h3, h5, THD A3/A1, A5/A1, √(h3² + h5²)             ±0.005 (0.5 % del fundamental)
+//   cresta      pico / eficaz de la onda ideal          ±3 % (el muestreo no cae en el pico) + 3σ / pico
+// y sin alterna (continua + ruido) debe salir valido=false.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "ac_calc.h"
+
+// Los de adc_continuo.h (que incluye Arduino.h)
+#define ADC_FS_HZ 5000
+#define ADC_VENTANA 500
+
+static int g_fallos = 0;
+
+#define COMPROBAR(cond, ...)                                      \
+  do {                                                            \
+    if (!(cond)) {                                                \
+      fprintf(stderr, "FALLO %s:%d: ", __FILE__, __LINE__);       \
+      fprintf(stderr, __VA_ARGS__);                               \
+      fprintf(stderr, "\n");                                      \
+      g_fallos++;                                                 \
+    }                                                             \
+  } while (0)
+
+struct Onda {
+  const char* nombre;
+  double hz;
+  double a1;           // amplitud del fundamental (cuentas ADC)
+  double h3, h5;       // amplitud relativa al fundamental
+  double ruido;        // σ del ruido (cuentas ADC)
+};
+
+static const double MEDIA = 1900.0;   // punto medio del módulo (cuentas)
+
+static double ideal(const Onda& o, double t, double f3, double f5) {
+  const double w = 2.0 * M_PI * o.hz * t;
+  return o.a1 * (sin(w) + o.h3 * sin(3.0 * w + f3) + o.h5 * sin(5.0 * w + f5));
+}
+
+static void generar(const Onda& o, double f0, double f3, double f5, std::mt19937& rng, uint16_t* x) {
+  std::normal_distribution<double> ruido(0.0, o.ruido > 0 ? o.ruido : 1e-9);
+  for (size_t i = 0; i < ADC_VENTANA; i++) {
+    const double t = (double)i / ADC_FS_HZ + f0 / (2.0 * M_PI * o.hz);
+    double v = MEDIA + ideal(o, t, f3, f5) + ruido(rng);
+    v = v < 0 ? 0 : v > 4095 ? 4095 : v;
+    x[i] = (uint16_t)lround(v);
+  }
+}
+
+// Cresta de la onda ideal: pico sobre un periodo muestreado fino / eficaz
+static double crestaIdeal(const Onda& o, double f3, double f5) {
+  double pico = 0, suma = 0;
+  const int N = 20000;
+  for (int i = 0; i < N; i++) {
+    const double v = ideal(o, (double)i / N / o.hz, f3, f5);
+    pico = fabs(v) > pico ? fabs(v) : pico;
+    suma += v * v;
+  }
+  return pico / sqrt(suma / N);
+}
+
+static void pruebaOnda(const Onda& o, int ensayos) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> fase(0.0, 2.0 * M_PI);
+  static uint16_t x[ADC_VENTANA];
+  static float y[ADC_VENTANA];
+  const double rmsEsp = sqrt(o.a1 * o.a1 * (1.0 + o.h3 * o.h3 + o.h5 * o.h5) / 2.0 + o.ruido * o.ruido);
+  const double thdEsp = sqrt(o.h3 * o.h3 + o.h5 * o.h5);
+  double peorRms = 0, peorF = 0, peorH = 0, peorCresta = 0;
+
+  for (int e = 0; e < ensayos; e++) {
+    const double f0 = fase(rng), f3 = fase(rng), f5 = fase(rng);
+    generar(o, f0, f3, f5, rng, x);
+    const AcResultado r = acAnalizar(x, ADC_VENTANA, (float)ADC_FS_HZ, y);
+    COMPROBAR(r.valido, "%s: sin alterna detectada", o.nombre);
+    if (!r.valido) continue;
+
+    const double eRms = fabs(r.rms - rmsEsp) / rmsEsp;
+    const double eF = fabs(r.frecuenciaHz - o.hz) / o.hz;
+    const double eH = fmax(fabs(r.armonicos[3] - o.h3), fmax(fabs(r.armonicos[5] - o.h5), fabs(r.thd - thdEsp)));
+    const double crestaEsp = crestaIdeal(o, f3, f5);
+    const double eCresta = fabs(r.cresta - crestaEsp) / crestaEsp;
+    // Ruido: desplaza cada cruce ~σ / pendiente (3σ, dos extremos, r.ciclos
+    // ciclos) y suma hasta ~3σ al pico
+    const double tolF = 0.001 + 2.0 * 3.0 * o.ruido / (2.0 * M_PI * o.a1) / r.ciclos;
+    const double tolCresta = 0.03 + 3.0 * o.ruido / (crestaEsp * rmsEsp);
+    peorRms = fmax(peorRms, eRms);
+    peorF = fmax(peorF, eF);
+    peorH = fmax(peorH, eH);
+    peorCresta = fmax(peorCresta, eCresta);
+
+    COMPROBAR(eRms <= 0.01, "%s: eficaz %.2f, esperado %.2f", o.nombre, r.rms, rmsEsp);
+    COMPROBAR(eF <= tolF, "%s: %.4f Hz, esperado %.4f", o.nombre, r.frecuenciaHz, o.hz);
+    COMPROBAR(fabs(r.armonicos[3] - o.h3) <= 0.005, "%s: h3 %.4f, esperado %.4f", o.nombre, r.armonicos[3], o.h3);
+    COMPROBAR(fabs(r.armonicos[5] - o.h5) <= 0.005, "%s: h5 %.4f, esperado %.4f", o.nombre, r.armonicos[5], o.h5);
+    COMPROBAR(fabs(r.thd - thdEsp) <= 0.005, "%s: THD %.4f, esperado %.4f", o.nombre, r.thd, thdEsp);
+    COMPROBAR(eCresta <= tolCresta, "%s: cresta %.3f, esperada %.3f", o.nombre, r.cresta, crestaEsp);
+    COMPROBAR(fabs(r.armonicos[1] - 1.0f) < 1e-6f, "%s: armonicos[1] = %.4f", o.nombre, r.armonicos[1]);
+  }
+  printf("%-26s error máx: eficaz %.3f %%, frec %.4f %%, armónicos %.4f, cresta %.2f %%\n",
+         o.nombre, peorRms * 100, peorF * 100, peorH, peorCresta * 100);
+}
+
+// Entrada en reposo (red ausente): continua + ruido, sin cruces válidos
+static void pruebaSinAlterna() {
+  std::mt19937 rng(8);
+  std::normal_distribution<double> ruido(0.0, 2.0);
+  static uint16_t x[ADC_VENTANA];
+  static float y[ADC_VENTANA];
+  for (int e = 0; e < 50; e++) {
+    for (size_t i = 0; i < ADC_VENTANA; i++) x[i] = (uint16_t)lround(MEDIA + ruido(rng));
+    const AcResultado r = acAnalizar(x, ADC_VENTANA, (float)ADC_FS_HZ, y);
+    COMPROBAR(!r.valido, "sin alterna: valido con %.2f Hz, eficaz %.2f", r.frecuenciaHz, r.rms);
+    COMPROBAR(r.rms < 3.0f, "sin alterna: eficaz %.2f", r.rms);
+    COMPROBAR(fabs(r.media - MEDIA) < 1.0f, "sin alterna: media %.2f", r.media);
+  }
+  printf("%-26s valido=false, eficaz ≈ ruido\n", "sin alterna");
+}
+
+// Tiempo de acAnalizar() por ventana en el PC
+static void medirTiempo(int ventanas) {
+  const Onda o = { "", 50.0, 570.0, 0.05, 0.03, 3.0 };
+  std::mt19937 rng(9);
+  static uint16_t x[ADC_VENTANA];
+  static float y[ADC_VENTANA];
+  generar(o, 0.3, 1.0, 2.0, rng, x);
+  volatile float sumidero = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ventanas; i++) sumidero = sumidero + acAnalizar(x, ADC_VENTANA, (float)ADC_FS_HZ, y).rms;
+  auto t1 = std::chrono::steady_clock::now();
+  const double us = std::chrono::duration<double, std::micro>(t1 - t0).count() / ventanas;
+  printf("tiempo: %.2f µs por ventana de %d muestras (%d ventanas, %d armónicos)\n",
+         us, ADC_VENTANA, ventanas, AC_ARMONICOS);
+}
+
+int main(int argc, char** argv) {
+  const int ventanas = (argc > 1) ? atoi(argv[1]) : 20000;
+  // ~230 V eficaces con VOLT_FACTOR_RMS: A1 ≈ 570 cuentas
+  static const Onda ONDAS[] = {
+    { "50 Hz senoidal",            50.0, 570.0, 0.00, 0.00, 0.0 },
+    { "50 Hz h3 5 % h5 3 % ruido", 50.0, 570.0, 0.05, 0.03, 3.0 },
+    { "60 Hz h3 4 % h5 2 % ruido", 60.0, 570.0, 0.04, 0.02, 3.0 },
+    { "49.5 Hz h3 8 % ruido",      49.5, 570.0, 0.08, 0.00, 3.0 },
+    { "60.5 Hz baja, ruido",       60.5, 150.0, 0.03, 0.03, 2.0 },
+  };
+  for (const Onda& o : ONDAS) pruebaOnda(o, 200);
+  pruebaSinAlterna();
+  medirTiempo(ventanas);
+
+  if (g_fallos) {
+    fprintf(stderr, "%d fallos\n", g_fallos);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,242 @@
+// ack_expand.cpp - reconstruye la auditoría ENVIADO a partir del diario de
+// confirmaciones (/sent/ack.jrn) y de los backups originales (/sent/raw/) o
+// ya compactados (/sent/arch/raw_YYYYMM.oxz).
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o ack_expand tools/ack_expand.cpp
+// Uso (con la SD copiada en ./sd):
+//   ack_expand sd/sent/ack.jrn auditoria/ sd/sent/raw sd/backup sd/sent/arch
+//
+// Genera auditoria/backup_YYYYMMDD.csv con el formato de siempre:
+//   timestamp,measurement,sensor,valor,source,ENVIADO,ts_envio,seq
+// Los backups se buscan en cada carpeta como backup_<fecha>.<ext> o
+// YYYY/MM/backup_<fecha>.<ext>; si no están, en raw_<YYYYMM>.oxz, cuyos
+// segmentos v2 guardan el offset original de cada registro (raw_pack.h).
+// Un rango repetido (corte entre el diario y el manifiesto) se emite una
+// sola vez.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "ack_journal.h"
+#include "raw_pack.h"
+#include "sample.h"
+
+static std::string nombreBase(uint32_t fecha, bool bin) {
+  char s[40];
+  if (fecha) snprintf(s, sizeof(s), "backup_%08lu.%s", (unsigned long)fecha, bin ? "bin" : "csv");
+  else       snprintf(s, sizeof(s), "backup_unsync.%s", bin ? "bin" : "csv");
+  return s;
+}
+
+static FILE* abrirBackup(const std::vector<std::string>& dirs, uint32_t fecha, bool bin) {
+  std::string base = nombreBase(fecha, bin);
+  char part[16];
+  snprintf(part, sizeof(part), "%04lu/%02lu/", (unsigned long)(fecha / 10000), (unsigned long)((fecha / 100) % 100));
+  for (const std::string& d : dirs) {
+    for (const std::string& ruta : { d + "/" + base, d + "/" + part + base }) {
+      if (FILE* f = fopen(ruta.c_str(), "rb")) return f;
+    }
+  }
+  return nullptr;
+}
+
+static void emitirRegistro(FILE* out, const BackupRecord& r, unsigned long long ts) {
+  const SensorDef* def = sensorDef(r.sensor);
+  fprintf(out, "%llu,%s,%s,%.2f,%s,ENVIADO,%llu,%lu\r\n", r.timestamp, def->measurement, def->sensor, r.valor,
+          origenNombre((r.flags & BKP_FLAG_ORIGEN_BACKUP) ? ORIGEN_BACKUP : ORIGEN_WIFI), ts, (unsigned long)r.seq);
+}
+
+// ====== Backups compactados ======
+struct RegPack {
+  uint32_t off;        // offset del registro en el backup original
+  BackupRecord r;
+};
+struct BackupPack {
+  bool conOffsets;     // segmento v2
+  std::vector<RegPack> regs;
+};
+static std::map<std::pair<uint32_t, bool>, BackupPack> g_packs;   // (fecha, fmt) → último segmento válido
+static std::map<std::string, bool> g_packsLeidos;
+
+// Carga los raw_<YYYYMM>.oxz del mes de 'fecha' que haya en las carpetas
+static void cargarPacks(const std::vector<std::string>& dirs, uint32_t fecha) {
+  char base[24];
+  snprintf(base, sizeof(base), "raw_%06lu.oxz", (unsigned long)(fecha / 100));
+  for (const std::string& d : dirs) {
+    const std::string ruta = d + "/" + base;
+    if (g_packsLeidos.count(ruta)) continue;
+    g_packsLeidos[ruta] = true;
+    FILE* f = fopen(ruta.c_str(), "rb");
+    if (!f) continue;
+    std::vector<uint8_t> buf;
+    uint8_t tmp[4096];
+    size_t n;
+    while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) buf.insert(buf.end(), tmp, tmp + n);
+    fclose(f);
+    if (buf.size() < PACK_HDR_LEN || !packCabeceraValida(buf.data())) {
+      fprintf(stderr, "%s: cabecera no válida\n", ruta.c_str());
+      continue;
+    }
+    size_t pos = PACK_HDR_LEN, malos = 0;
+    PackSegmento s;
+    while (const uint8_t* p = packSiguienteSegmento(buf.data(), buf.size(), pos, s, malos)) {
+      const uint8_t* fin = p + s.len;
+      PackEstado e;
+      packReiniciar(e);
+      bool ok = true;
+      for (uint32_t i = 0; i < s.nAck && ok; i++) {
+        PackAck a;
+        size_t k = packDecodificarAck(e, p, fin, a);
+        ok = k != 0;
+        p += k;
+      }
+      BackupPack bp{ s.version >= 2, {} };
+      for (uint32_t i = 0; i < s.n && ok; i++) {
+        RegPack rp;
+        size_t k = packDecodificar(e, s.version, p, fin, rp.r, rp.off);
+        ok = k != 0;
+        p += k;
+        if (ok && sensorDef(rp.r.sensor)) bp.regs.push_back(rp);
+      }
+      if (ok) g_packs[{ s.fecha, s.binario }] = std::move(bp);
+    }
+    if (malos) fprintf(stderr, "%s: %zu segmentos dañados\n", ruta.c_str(), malos);
+  }
+}
+
+// Emite los registros del pack con offset en [inicio, fin); devuelve cuántos
+static size_t expandirRangoPack(const BackupPack& bp, uint32_t inicio, uint32_t fin,
+                                unsigned long long ts, FILE* out) {
+  auto it = std::lower_bound(bp.regs.begin(), bp.regs.end(), inicio,
+                             [](const RegPack& rp, uint32_t off) { return rp.off < off; });
+  size_t n = 0;
+  for (; it != bp.regs.end() && it->off < fin; ++it, n++) emitirRegistro(out, it->r, ts);
+  return n;
+}
+
+// Emite las filas válidas del rango [inicio, fin) del backup; devuelve cuántas
+static size_t expandirRango(FILE* in, bool bin, uint32_t inicio, uint32_t fin,
+                            unsigned long long ts, FILE* out) {
+  std::vector<char> buf(fin - inicio);
+  if (fseek(in, (long)inicio, SEEK_SET) != 0 || fread(buf.data(), 1, buf.size(), in) != buf.size()) return 0;
+  size_t n = 0;
+
+  if (bin) {
+    uint8_t hdr[BKP_HDR_LEN];
+    if (fseek(in, 0, SEEK_SET) != 0 || fread(hdr, 1, sizeof(hdr), in) != sizeof(hdr)) return 0;
+    const uint8_t recLen = bkpRecLen(hdr);   // v1 (sin seq) o v2
+    if (!recLen) return 0;
+    for (size_t off = 0; off + recLen <= buf.size(); off += recLen) {
+      BackupRecord r;
+      if (!bkpDecodificar((const uint8_t*)buf.data() + off, r, recLen)) continue;
+      if (!sensorDef(r.sensor)) continue;
+      emitirRegistro(out, r, ts);
+      n++;
+    }
+    return n;
+  }
+
+  // CSV: mismo filtro que el reenvío (status=PENDIENTE y serie conocida)
+  size_t p = 0;
+  while (p < buf.size()) {
+    size_t e = p;
+    while (e < buf.size() && buf[e] != '\n') e++;
+    std::string linea(buf.data() + p, e - p);
+    p = e + 1;
+    while (!linea.empty() && (linea.back() == '\r' || linea.back() == ' ')) linea.pop_back();
+
+    std::vector<std::string> c;
+    size_t a = 0;
+    for (int i = 0; i < 8; i++) {   // CSV sin columna seq: c[7] vacío
+      size_t coma = linea.find(',', a);
+      if (coma == std::string::npos) coma = linea.size();
+      c.push_back(linea.substr(a, coma - a));
+      a = (coma < linea.size()) ? coma + 1 : linea.size();
+    }
+    if (c[5] != "PENDIENTE") continue;
+    if (sensorIdDesde(c[1].c_str(), c[2].c_str()) == SENSOR_DESCONOCIDO) continue;
+    fprintf(out, "%s,%s,%s,%s,%s,ENVIADO,%llu,%s\r\n", c[0].c_str(), c[1].c_str(), c[2].c_str(), c[3].c_str(), c[4].c_str(), ts,
+            c[7].empty() ? "0" : c[7].c_str());
+    n++;
+  }
+  return n;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    fprintf(stderr, "uso: %s <ack.jrn> <dir_salida> <dir_backups>...\n", argv[0]);
+    return 2;
+  }
+  FILE* jrn = fopen(argv[1], "rb");
+  if (!jrn) { perror(argv[1]); return 1; }
+  uint8_t hdr[ACK_HDR_LEN];
+  if (fread(hdr, 1, sizeof(hdr), jrn) != sizeof(hdr) || !ackCabeceraValida(hdr)) {
+    fprintf(stderr, "%s: cabecera no válida\n", argv[1]);
+    fclose(jrn);
+    return 1;
+  }
+  const std::string dirSalida = argv[2];
+  std::vector<std::string> dirs(argv + 3, argv + argc);
+
+  std::map<uint32_t, FILE*> salidas;                    // fecha → CSV de auditoría (CSV y BIN del día juntos)
+  std::map<std::pair<uint32_t, bool>, uint32_t> finMax; // mayor offset ya emitido de cada backup
+  size_t entradas = 0, corruptas = 0, sinBackup = 0, repetidas = 0, filas = 0, avisosN = 0, dePack = 0;
+  uint8_t rec[ACK_REC_LEN];
+
+  while (fread(rec, 1, sizeof(rec), jrn) == sizeof(rec)) {
+    AckEntrada a;
+    if (!ackDecodificar(rec, a)) { corruptas++; continue; }
+    entradas++;
+
+    uint32_t& hecho = finMax[{ a.fecha, a.binario }];
+    uint32_t inicio = a.inicio;
+    if (hecho >= a.fin) { repetidas++; continue; }
+    if (hecho > inicio) { inicio = hecho; repetidas++; }
+
+    FILE* in = abrirBackup(dirs, a.fecha, a.binario);
+    const BackupPack* bp = nullptr;
+    if (!in) {
+      cargarPacks(dirs, a.fecha);
+      auto it = g_packs.find({ a.fecha, a.binario });
+      if (it != g_packs.end() && it->second.conOffsets) bp = &it->second;
+      if (!bp) {
+        fprintf(stderr, "%s: no encontrado%s\n", nombreBase(a.fecha, a.binario).c_str(),
+                it != g_packs.end() ? " (compactado sin offsets, pack v1)" : "");
+        sinBackup++;
+        continue;
+      }
+    }
+    FILE*& out = salidas[a.fecha];
+    if (!out) {
+      std::string ruta = dirSalida + "/" + nombreBase(a.fecha, false);
+      out = fopen(ruta.c_str(), "wb");
+      if (!out) { perror(ruta.c_str()); if (in) fclose(in); return 1; }
+      fprintf(out, "timestamp,measurement,sensor,valor,source,status,ts_envio,seq\r\n");
+    }
+    size_t n;
+    if (in) {
+      n = expandirRango(in, a.binario, inicio, a.fin, a.tsEnvio, out);
+      fclose(in);
+    } else {
+      n = expandirRangoPack(*bp, inicio, a.fin, a.tsEnvio, out);
+      dePack += n;
+    }
+    if (inicio == a.inicio && n != a.n && avisosN++ < 10) {
+      fprintf(stderr, "%s [%u,%u): %zu filas, el diario dice %u\n", nombreBase(a.fecha, a.binario).c_str(),
+              (unsigned)a.inicio, (unsigned)a.fin, n, (unsigned)a.n);
+    }
+    filas += n;
+    hecho = a.fin;
+  }
+  fclose(jrn);
+
+  for (auto& kv : salidas) fclose(kv.second);
+
+  fprintf(stderr, "entradas=%zu filas=%zu de_pack=%zu repetidas=%zu corruptas=%zu sin_backup=%zu\n",
+          entradas, filas, dePack, repetidas, corruptas, sinBackup);
+  return (corruptas || sinBackup) ? 3 : 0;
+}
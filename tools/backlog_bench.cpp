@@ -0,0 +1,198 @@
+// backlog_bench.cpp - ritmo de vaciado del reenvío (reenviarBackupSD.cpp) con
+// un backlog simulado de 7 días en .bin.
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o backlog_bench tools/backlog_bench.cpp
+// Uso:
+//   backlog_bench [--dias 7] [--rtt-ms 80] [--kbps 1000] [--sd-kbs 400] [--cpu-factor 25]
+//
+// Genera los archivos del día en memoria al ritmo de muestreo del firmware
+// (caudal y total cada 1 s, voltaje + 5 series cada 10 s, temperatura cada
+// 60 s) y los recorre como el motor: bloques de REENVIO_BLOQUE leídos de
+// REENVIO_LECTURA_REGS en REENVIO_LECTURA_REGS, decodificados y enviados como
+// un POST en line protocol por bloque, medido y formateado por tramos de
+// API_TRAMO_LEN. Constantes y formato son los del firmware
+// (formato_muestra.h, reenviarBackupSD.h). Mide el tiempo de CPU real en el
+// PC y lo combina con un modelo de la SD y la red:
+//   lectura = bytes / sd-kbs + cpu_decodificar * cpu-factor
+//   envío   = rtt + bytes_cuerpo * 8 / kbps + cpu_formatear * cpu-factor
+// En tubería cada bloque cuesta max(envío, lectura del siguiente); en serie,
+// la suma. El motor antiguo (6 registros, una petición GET cada uno, cada
+// 500 ms) no se ejecuta: es solo la fórmula registros / 6 * max(0,5 s, 6 * rtt).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "backup_record.h"
+#include "bufwriter.h"
+#include "formato_muestra.h"     // API_LOTE_MAX, API_TRAMO_LEN, formato del lote
+#include "reenviarBackupSD.h"    // REENVIO_BLOQUE, REENVIO_LECTURA_REGS
+#include "sample.h"
+
+static const char* MAC = "246F28AABBCC";
+
+// CuerpoLoteLP (api.cpp): medir + escribir por tramos con las mismas
+// funciones. El "socket" solo suma bytes.
+static size_t g_socketBytes = 0;
+static size_t g_socketWrites = 0;
+static char g_tramoBuf[API_TRAMO_LEN];
+
+static size_t medirLote(const Sample* m, size_t n) {
+  size_t len = 0;
+  if (!formatoLoteLPLongitud(m, n, MAC, len)) {
+    fprintf(stderr, "FALLO: línea mayor que API_LINEA_MAX\n");
+    exit(1);
+  }
+  return len;
+}
+
+static void escribirLote(const Sample* m, size_t n) {
+  formatoLoteLPPorTramos(m, n, MAC, g_tramoBuf, sizeof(g_tramoBuf), [](const char*, size_t len) {
+    g_socketBytes += len;
+    g_socketWrites++;
+    return true;
+  });
+}
+
+// Archivo de un día al ritmo de muestreo de main.cpp
+static void generarDia(uint32_t dia, uint32_t& seq, std::vector<uint8_t>& out) {
+  out.resize(BKP_HDR_LEN);
+  bkpCodificarCabecera(out.data(), 20250901 + dia);
+  const unsigned long long t0 = (1756684800ULL + dia * 86400ULL) * 1000000ULL;
+  uint8_t rec[BKP_REC_LEN];
+  auto poner = [&](unsigned long long ts, uint8_t sensor, float v) {
+    BackupRecord r{ ts, sensor, v, BKP_FLAG_ORIGEN_BACKUP, ++seq };
+    bkpCodificar(r, rec);
+    out.insert(out.end(), rec, rec + BKP_REC_LEN);
+  };
+  double total = 0;
+  for (uint32_t s = 0; s < 86400; s++) {
+    const unsigned long long ts = t0 + s * 1000000ULL;
+    const float q = 12.0f + (float)((s * 7u) % 300) / 100.0f;
+    total += q / 60.0;
+    poner(ts, SENSOR_CAUDAL, q);
+    poner(ts, SENSOR_CAUDAL_TOTAL, (float)floor(total));   // L enteros, como main.cpp
+    if (s % 10 == 0) {
+      poner(ts, SENSOR_VOLTAJE, 229.0f + (float)(s % 37) / 10.0f);
+      poner(ts, SENSOR_VOLTAJE_FRECUENCIA, 50.0f);
+      poner(ts, SENSOR_VOLTAJE_CRESTA, 1.41f);
+      poner(ts, SENSOR_VOLTAJE_THD, 2.3f);
+      poner(ts, SENSOR_VOLTAJE_H3, 1.8f);
+      poner(ts, SENSOR_VOLTAJE_H5, 0.9f);
+    }
+    if (s % 60 == 0) poner(ts, SENSOR_TEMPERATURA, 24.5f);
+  }
+}
+
+struct BloqueMedido {
+  size_t regs;          // registros leídos (bytes SD = regs * BKP_REC_LEN)
+  size_t cuerpo;        // bytes del POST
+  double cpuLeerS;      // decodificar en el PC
+  double cpuEnviarS;    // medir + formatear en el PC
+};
+
+static double ahoraS() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Recorre un día como leerBloqueBin() + enviarLoteAPI()
+static void recorrerDia(const std::vector<uint8_t>& archivo, std::vector<BloqueMedido>& bloques, size_t& corruptos) {
+  static Sample m[REENVIO_BLOQUE];
+  static uint8_t buf[REENVIO_LECTURA_REGS * BKP_REC_LEN];
+  const uint8_t rl = bkpRecLen(archivo.data());
+  size_t off = BKP_HDR_LEN;
+  while (off + rl <= archivo.size()) {
+    double t0 = ahoraS();
+    size_t regs = (archivo.size() - off) / rl;
+    if (regs > REENVIO_BLOQUE) regs = REENVIO_BLOQUE;
+    size_t n = 0, leidosTotal = 0;
+    while (leidosTotal < regs) {
+      size_t pedir = regs - leidosTotal;
+      if (pedir > REENVIO_LECTURA_REGS) pedir = REENVIO_LECTURA_REGS;
+      memcpy(buf, archivo.data() + off + leidosTotal * rl, pedir * rl);   // f.read()
+      for (size_t i = 0; i < pedir; i++) {
+        BackupRecord r;
+        if (!bkpDecodificar(buf + i * rl, r, rl)) { corruptos++; continue; }
+        if (!sensorDef(r.sensor)) continue;
+        m[n++] = Sample{ r.timestamp, r.valor, r.sensor, ORIGEN_BACKUP, r.seq };
+      }
+      leidosTotal += pedir;
+    }
+    double t1 = ahoraS();
+    size_t len = medirLote(m, n);
+    const size_t antes = g_socketBytes;
+    escribirLote(m, n);
+    double t2 = ahoraS();
+    if (g_socketBytes - antes != len) {
+      fprintf(stderr, "FALLO: cuerpo escrito %zu != medido %zu\n", g_socketBytes - antes, len);
+      exit(1);
+    }
+    bloques.push_back(BloqueMedido{ regs, len, t1 - t0, t2 - t1 });
+    off += regs * rl;
+  }
+}
+
+int main(int argc, char** argv) {
+  int dias = 7;
+  double rttMs = 80, kbps = 1000, sdKbs = 400, cpuFactor = 25;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--dias")) dias = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--rtt-ms")) rttMs = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--kbps")) kbps = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--sd-kbs")) sdKbs = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--cpu-factor")) cpuFactor = atof(argv[i + 1]);
+    else { fprintf(stderr, "opción desconocida: %s\n", argv[i]); return 2; }
+  }
+
+  std::vector<BloqueMedido> bloques;
+  std::vector<uint8_t> archivo;
+  size_t registros = 0, corruptos = 0, bytesSd = 0;
+  uint32_t seq = 0;
+  for (int d = 0; d < dias; d++) {
+    generarDia((uint32_t)d, seq, archivo);
+    registros += (archivo.size() - BKP_HDR_LEN) / BKP_REC_LEN;
+    bytesSd += archivo.size();
+    recorrerDia(archivo, bloques, corruptos);
+  }
+
+  double cpuLeer = 0, cpuEnviar = 0;
+  size_t cuerpo = 0;
+  for (const BloqueMedido& b : bloques) { cpuLeer += b.cpuLeerS; cpuEnviar += b.cpuEnviarS; cuerpo += b.cuerpo; }
+
+  printf("backlog: %d días, %zu registros, %.1f MB en SD, %zu bloques de %d, cuerpo LP %.1f MB (%zu writes de <= %d B)\n",
+         dias, registros, bytesSd / 1e6, bloques.size(), REENVIO_BLOQUE, cuerpo / 1e6, g_socketWrites, API_TRAMO_LEN);
+  printf("CPU en el PC: decodificar %.0f reg/s, medir+formatear %.0f reg/s\n",
+         registros / cpuLeer, registros / cpuEnviar);
+  printf("modelo: rtt=%.0f ms, enlace=%.0f kbit/s, SD=%.0f KB/s, CPU ESP32 = PC x %.0f\n",
+         rttMs, kbps, sdKbs, cpuFactor);
+
+  // Modelo por bloque: tubería = lectura[0] + suma de max(envío[i], lectura[i+1])
+  std::vector<double> lectura(bloques.size() + 1, 0.0), envio(bloques.size(), 0.0);
+  for (size_t i = 0; i < bloques.size(); i++) {
+    const BloqueMedido& b = bloques[i];
+    lectura[i] = b.regs * BKP_REC_LEN / (sdKbs * 1024.0) + b.cpuLeerS * cpuFactor;
+    envio[i] = rttMs / 1000.0 + b.cuerpo * 8.0 / (kbps * 1000.0) + b.cpuEnviarS * cpuFactor;
+  }
+  double serie = 0, tuberia = lectura[0];
+  for (size_t i = 0; i < bloques.size(); i++) {
+    serie += lectura[i] + envio[i];
+    tuberia += (envio[i] > lectura[i + 1]) ? envio[i] : lectura[i + 1];
+  }
+  // Motor antiguo: 6 GET cada 500 ms (o lo que tarden 6 RTT si es más)
+  const double tandaS = (6 * rttMs / 1000.0 > 0.5) ? 6 * rttMs / 1000.0 : 0.5;
+  const double antiguo = registros / 6.0 * tandaS;
+
+  printf("%-28s %12s %14s\n", "motor", "reg/s", "vaciado");
+  auto fila = [&](const char* nombre, double s) {
+    printf("%-28s %12.0f %11.1f h\n", nombre, registros / s, s / 3600.0);
+  };
+  fila("tubería (actual)", tuberia);
+  fila("en serie (sin solape)", serie);
+  fila("antiguo (fórmula, no medido)", antiguo);
+  if (corruptos) { fprintf(stderr, "FALLO: %zu registros corruptos\n", corruptos); return 1; }
+  return 0;
+}
@@ -0,0 +1,58 @@
+// backup_bin2csv.cpp - convierte un backup binario (backup_YYYYMMDD.bin) al
+// CSV de siempre: timestamp,measurement,sensor,valor,source,status,ts_envio,seq
+// (v1 sin secuencia: seq=0)
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o backup_bin2csv tools/backup_bin2csv.cpp
+// Uso:
+//   backup_bin2csv backup_20250909.bin > backup_20250909.csv
+//
+// Los registros con CRC inválido se saltan y se informan por stderr
+// (índice y offset); un registro final incompleto se ignora.
+
+#include <stdio.h>
+#include "backup_record.h"
+#include "sample.h"
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "uso: %s <backup.bin>\n", argv[0]);
+    return 2;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) { perror(argv[1]); return 1; }
+
+  uint8_t hdr[BKP_HDR_LEN];
+  uint8_t recLen = 0;
+  if (fread(hdr, 1, sizeof(hdr), in) != sizeof(hdr) || (recLen = bkpRecLen(hdr)) == 0) {
+    fprintf(stderr, "%s: cabecera no válida\n", argv[1]);
+    fclose(in);
+    return 1;
+  }
+
+  printf("timestamp,measurement,sensor,valor,source,status,ts_envio,seq\r\n");
+
+  uint8_t rec[BKP_REC_LEN];
+  size_t idx = 0, ok = 0, corruptos = 0, desconocidos = 0, leidos;
+  while ((leidos = fread(rec, 1, recLen, in)) == recLen) {
+    BackupRecord r;
+    if (!bkpDecodificar(rec, r, recLen)) {
+      fprintf(stderr, "registro %zu (offset %zu): CRC inválido\n", idx, bkpOffsetRegistro(idx, recLen));
+      corruptos++;
+    } else if (const SensorDef* def = sensorDef(r.sensor)) {
+      printf("%llu,%s,%s,%.2f,%s,PENDIENTE,,%lu\r\n", r.timestamp, def->measurement, def->sensor, r.valor,
+             origenNombre((r.flags & BKP_FLAG_ORIGEN_BACKUP) ? ORIGEN_BACKUP : ORIGEN_WIFI), (unsigned long)r.seq);
+      ok++;
+    } else {
+      fprintf(stderr, "registro %zu: sensor desconocido (%u)\n", idx, (unsigned)r.sensor);
+      desconocidos++;
+    }
+    idx++;
+  }
+  if (leidos > 0) fprintf(stderr, "registro final incompleto (%zu bytes) ignorado\n", leidos);
+  fclose(in);
+
+  fprintf(stderr, "fecha=%lu version=%u registros=%zu convertidos=%zu corruptos=%zu desconocidos=%zu\n",
+          (unsigned long)bkpGetU32(hdr + 8), (unsigned)hdr[4], idx, ok, corruptos, desconocidos);
+  return corruptos ? 3 : 0;
+}
@@ -0,0 +1,193 @@
+// bufwriter_test.cpp - prueba en el PC de bufwriter.h y formato_muestra.h: los
+// constructores de petición, fila de backup y auditoría no tocan el heap, dan
+// el texto esperado, y appendFixed da lo mismo que printf("%.*f").
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o bufwriter_test tools/bufwriter_test.cpp
+// Uso:
+//   bufwriter_test        (código de salida 0 = todo bien)
+//
+// Las asignaciones se cuentan sustituyendo operator new/delete y, con glibc,
+// malloc/calloc/realloc. Los constructores son los del firmware:
+// formato_muestra.h (api.cpp, sdbackup.cpp) y ack_journal.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include "bufwriter.h"
+#include "formato_muestra.h"
+#include "sample.h"
+#include "ack_journal.h"
+
+static volatile unsigned long g_asignaciones = 0;
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void* malloc(size_t n) { g_asignaciones++; return __libc_malloc(n); }
+extern "C" void* calloc(size_t n, size_t m) { g_asignaciones++; return __libc_calloc(n, m); }
+extern "C" void* realloc(void* p, size_t n) { g_asignaciones++; return __libc_realloc(p, n); }
+#endif
+
+// GCC avisa de new/free "desemparejados" al ver malloc dentro de operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t n) {
+  g_asignaciones++;
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static int g_fallos = 0;
+
+static void comprobar(bool ok, const char* que) {
+  if (!ok) {
+    fprintf(stderr, "FALLO: %s\n", que);
+    g_fallos++;
+  }
+}
+
+// === Pruebas ===
+
+static void pruebaSinHeap() {
+  const unsigned long long ts0 = 1757400000000000ULL;
+  unsigned long sumaLong = 0;   // que el optimizador no elimine nada
+
+  const unsigned long antes = g_asignaciones;
+  for (uint32_t i = 0; i < 10000; i++) {
+    const float v = (float)((int)(i % 5000) - 2500) / 37.0f;
+    const unsigned long long ts = ts0 + (unsigned long long)i * 1000000ULL;
+
+    FixedBuf<256> query;
+    comprobar(formatoQueryGet(query, "clave con espacios&=", "voltaje", "ZMPT101B", v, ts, "24:6F:28:AA:BB:CC",
+                             "wifi", i), "query cabe en 256");
+    sumaLong += query.length();
+
+    Sample s{ ts, v, (uint8_t)(1 + i % (SENSOR_DEFS_N - 1)), (uint8_t)(i & 1), i };
+    char lote[112];
+    BufWriter body(lote, sizeof(lote));
+    formatoLineaLP(body, s, "246F28AABBCC");
+    comprobar(!body.overflow(), "línea LP cabe en 112");
+    sumaLong += body.length();
+
+    FixedBuf<112> fila;
+    formatoFilaCsv(fila, ts, "temperatura", "MAX6675", v, "backup", i);
+    comprobar(!fila.overflow(), "fila CSV cabe en 112");
+    sumaLong += fila.length();
+
+    AckEntrada a{ 20250909, (i & 1) != 0, (uint16_t)i, i * 48, i * 48 + 480, ts };
+    uint8_t rec[ACK_REC_LEN];
+    ackCodificar(a, rec);
+    sumaLong += rec[0];
+  }
+  const unsigned long n = g_asignaciones - antes;
+
+  printf("asignaciones en 10000 iteraciones (query + LP + fila + ack): %lu (suma %lu)\n", n, sumaLong);
+  comprobar(n == 0, "el camino caliente no asigna memoria");
+
+  // El contador funciona (si no, la prueba anterior no prueba nada)
+  const unsigned long antesPrueba = g_asignaciones;
+  std::vector<char> v(16);
+  v[0] = 0;
+  comprobar(g_asignaciones > antesPrueba, "el contador detecta new");
+}
+
+static void pruebaFormato() {
+  FixedBuf<64> b;
+  b.appendUrlEncoded("a b&c=d/é~");
+  comprobar(strcmp(b.c_str(), "a%20b%26c%3Dd%2F%C3%A9~") == 0, "appendUrlEncoded");
+
+  b.clear();
+  b.appendI64(-1234567890123LL).append(' ').appendU64(18446744073709551615ULL);
+  comprobar(strcmp(b.c_str(), "-1234567890123 18446744073709551615") == 0, "appendI64/appendU64");
+
+  FixedBuf<8> corto;
+  corto.append("123456789");
+  comprobar(corto.overflow() && strcmp(corto.c_str(), "1234567") == 0, "trunca y marca overflow");
+}
+
+// Texto exacto que reciben el servidor y la SD
+static void pruebaTextoMuestra() {
+  FixedBuf<256> q;
+  comprobar(formatoQueryGet(q, "k y", "voltaje", "ZMPT101B", 229.456f, 1757400000123456ULL, "246F28AABBCC", "wifi", 42) &&
+            strcmp(q.c_str(), "?api_key=k%20y&measurement=voltaje&sensor=ZMPT101B&valor=229.46"
+                              "&ts=1757400000123456&mac=246F28AABBCC&source=wifi&seq=42") == 0,
+            "query GET");
+  q.clear();
+  formatoQueryGet(q, "k", "caudal", "YF-S201", -0.5f, 1ULL, "246F28AABBCC", "backup", 0);
+  comprobar(strcmp(q.c_str(), "?api_key=k&measurement=caudal&sensor=YF-S201&valor=-0.50&ts=1"
+                              "&mac=246F28AABBCC&source=backup") == 0, "query GET sin seq");
+
+  FixedBuf<API_LINEA_MAX> l;
+  formatoLineaLP(l, Sample{ 1757400000123456ULL, 12.5f, SENSOR_CAUDAL, ORIGEN_BACKUP, 7 }, "246F28AABBCC");
+  comprobar(strcmp(l.c_str(), "caudal,sensor=YF-S201,mac=246F28AABBCC,source=backup valor=12.50,seq=7i "
+                              "1757400000123456\n") == 0, "línea LP");
+  l.clear();
+  formatoLineaLP(l, Sample{ 1ULL, 1.0f, SENSOR_DESCONOCIDO, ORIGEN_WIFI, 0 }, "246F28AABBCC");
+  comprobar(l.length() == 0, "línea LP de sensor desconocido vacía");
+
+  FixedBuf<112> f;
+  formatoFilaCsv(f, 1757400000123456ULL, "temperatura", "MAX6675", 24.5f, "wifi", 9);
+  comprobar(strcmp(f.c_str(), "1757400000123456,temperatura,MAX6675,24.50,wifi,PENDIENTE,,9\r\n") == 0, "fila CSV");
+}
+
+static void pruebaFijoConSigno() {
+  struct Caso { float v; uint8_t dec; const char* esperado; };
+  static const Caso casos[] = {
+    { -0.05f, 2, "-0.05" },  { -0.5f, 1, "-0.5" },     { -0.004f, 2, "0.00" },
+    { -0.0f, 2, "0.00" },    { -0.006f, 2, "-0.01" },  { -1.25f, 1, "-1.2" },
+    { 0.125f, 2, "0.12" },   { 2.5f, 0, "2" },         { -999.999f, 2, "-1000.00" },
+    { -0.0000004f, 6, "0.000000" }, { -0.0000006f, 6, "-0.000001" },
+  };
+  for (const Caso& c : casos) {
+    FixedBuf<32> b;
+    b.appendFixed(c.v, c.dec);
+    if (strcmp(b.c_str(), c.esperado) != 0) {
+      fprintf(stderr, "appendFixed(%g, %u) = \"%s\", esperado \"%s\"\n", c.v, c.dec, b.c_str(), c.esperado);
+      g_fallos++;
+    }
+  }
+
+  // Barrido contra printf. Diferencia aceptada: printf escribe "-0.00" para
+  // negativos que redondean a cero; aquí sale sin signo.
+  unsigned long distintos = 0;
+  srand(1);
+  for (int i = 0; i < 200000; i++) {
+    const float v = (float)((rand() % 2000001) - 1000000) / (float)(1 + rand() % 10000);
+    const uint8_t dec = (uint8_t)(rand() % 7);
+    char ref[48];
+    snprintf(ref, sizeof(ref), "%.*f", dec, (double)v);
+    const char* esperado = ref;
+    if (ref[0] == '-' && strspn(ref + 1, "0.") == strlen(ref + 1)) esperado = ref + 1;
+    FixedBuf<48> b;
+    b.appendFixed(v, dec);
+    if (strcmp(b.c_str(), esperado) != 0) {
+      if (distintos++ < 5) fprintf(stderr, "appendFixed(%.9g, %u) = \"%s\", printf \"%s\"\n", v, dec, b.c_str(), ref);
+    }
+  }
+  comprobar(distintos == 0, "appendFixed igual que printf");
+}
+
+int main() {
+  pruebaSinHeap();
+  pruebaFormato();
+  pruebaTextoMuestra();
+  pruebaFijoConSigno();
+  if (g_fallos) {
+    fprintf(stderr, "%d fallos\n", g_fallos);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,262 @@
+// caudal_calc_test.cpp - prueba en el PC de caudal_calc.h con trenes de pulsos
+// sintéticos del YF-S201.
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o caudal_calc_test tools/caudal_calc_test.cpp
+// Uso:
+//   caudal_calc_test      (código de salida 0 = todo bien)
+//
+// Genera los flancos (µs, con jitter) y construye cada CaudalCrudo como lo
+// leería el driver al cerrar la ventana: PCNT módulo CAUDAL_PCNT_LIM (solo
+// flancos reales), captura de 32 bits a CAUDAL_TICKS_US con un origen que la
+// hace dar la vuelta durante la prueba, y esp_timer del último flanco. Las
+// ventanas duran ~1 s con jitter, como la del loop. Casos: caudal estable,
+// caudal bajo, sensor parado (y arranque tras una parada más larga que la
+// vuelta de la captura), vueltas del PCNT y de la captura, y una ráfaga de
+// glitches que la captura ve y el filtro del PCNT no.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "caudal_calc.h"
+
+static int g_fallos = 0;
+
+#define COMPROBAR(cond, ...)                                      \
+  do {                                                            \
+    if (!(cond)) {                                                \
+      fprintf(stderr, "FALLO %s:%d: ", __FILE__, __LINE__);       \
+      fprintf(stderr, __VA_ARGS__);                               \
+      fprintf(stderr, "\n");                                      \
+      g_fallos++;                                                 \
+    }                                                             \
+  } while (0)
+
+struct Flanco {
+  double us;
+  bool real;             // false = glitch que el filtro del PCNT quita
+};
+
+// Tren de pulsos y su lectura como registros del hardware
+struct Sensor {
+  std::vector<Flanco> flancos;
+  std::vector<uint32_t> reales;   // reales hasta flancos[i] incluido
+  int16_t pcnt0;
+  uint32_t capOrigen;             // captura en t = 0 (elige cuándo da la vuelta)
+
+  void tren(double desdeUs, double hastaUs, double hz, double jitterUs, std::mt19937& rng) {
+    std::uniform_real_distribution<double> j(-jitterUs, jitterUs);
+    for (double t = desdeUs + 1e6 / hz; t < hastaUs; t += 1e6 / hz) flancos.push_back({ t + j(rng), true });
+  }
+  void glitch(double us) { flancos.push_back({ us, false }); }
+
+  void cerrar() {
+    std::sort(flancos.begin(), flancos.end(), [](const Flanco& a, const Flanco& b) { return a.us < b.us; });
+    reales.resize(flancos.size());
+    uint32_t n = 0;
+    for (size_t i = 0; i < flancos.size(); i++) reales[i] = n += flancos[i].real;
+  }
+
+  uint32_t ticks(double us) const { return capOrigen + (uint32_t)(uint64_t)llround(us * CAUDAL_TICKS_US); }
+
+  uint32_t realesHasta(double us) const {
+    size_t n = std::upper_bound(flancos.begin(), flancos.end(), us,
+                                [](double t, const Flanco& f) { return t < f.us; }) - flancos.begin();
+    return n ? reales[n - 1] : 0;
+  }
+
+  CaudalCrudo leer(double ahoraUs) const {
+    size_t n = std::upper_bound(flancos.begin(), flancos.end(), ahoraUs,
+                                [](double t, const Flanco& f) { return t < f.us; }) - flancos.begin();
+    CaudalCrudo c = {};
+    c.pcnt = (int16_t)((pcnt0 + (n ? reales[n - 1] : 0)) % CAUDAL_PCNT_LIM);
+    c.nCap = (uint32_t)n;
+    if (n >= 1) {
+      c.capTicks = ticks(flancos[n - 1].us);
+      c.flancoUs = (int64_t)flancos[n - 1].us;
+    }
+    if (n >= 2) c.capPrevTicks = ticks(flancos[n - 2].us);
+    c.ahoraUs = (int64_t)ahoraUs;
+    return c;
+  }
+};
+
+// Cierres de ventana cada ~1 s desde t0 hasta t1
+static std::vector<double> cierres(double t0, double t1, std::mt19937& rng) {
+  std::uniform_real_distribution<double> j(-3000.0, 3000.0);
+  std::vector<double> v;
+  for (double t = t0; t <= t1; t += 1e6) v.push_back(t + j(rng));
+  return v;
+}
+
+static bool cerca(float f, double esperado, double relTol) {
+  return fabs(f - esperado) <= relTol * esperado;
+}
+
+// Tolerancia de la recíproca: 0.1 % más el jitter de un periodo, que puede
+// recortar la lectura por la cota de 1 / tiempo desde el último flanco
+static double tolerancia(double hz, double jitterUs) {
+  return 0.001 + 2.0 * jitterUs * hz / 1e6;
+}
+
+// Caudal estable: recíproca a la tolerancia, sin perder pulsos en las vueltas
+// del PCNT (arranca a 60 pulsos del límite) ni de la captura (cada ~53.7 s)
+static void pruebaEstable() {
+  std::mt19937 rng(1);
+  const double hz = 10.0 * CAUDAL_HZ_POR_LPM;   // 10 L/min
+  Sensor s;
+  s.pcnt0 = CAUDAL_PCNT_LIM - 60;
+  s.capOrigen = 0xFFFFFFFFu - 5u * 80000000u;  // vuelta a los ~5 s
+  s.tren(1e6, 125e6, hz, 20.0, rng);
+  s.cerrar();
+
+  CaudalAcum a = {};
+  uint32_t pulsos = 0, vueltasPcnt = 0, vueltasCap = 0;
+  int16_t pcntPrev = s.leer(1e6).pcnt;
+  uint32_t capPrev = s.leer(1e6).capTicks;
+  size_t ventanas = 0;
+  const std::vector<double> ts = cierres(1e6, 121e6, rng);
+  for (double t : ts) {
+    const CaudalCrudo c = s.leer(t);
+    if (c.pcnt < pcntPrev) vueltasPcnt++;
+    pcntPrev = c.pcnt;
+    if (c.capTicks < capPrev) vueltasCap++;
+    capPrev = c.capTicks;
+    const bool primera = !a.iniciado;
+    const CaudalLectura l = caudalVentana(a, c);
+    if (primera) continue;
+    pulsos += l.pulsos;
+    ventanas++;
+    if (ventanas < 2) continue;   // la primera no tiene flanco de referencia
+    const float f = caudalFrecuenciaHz(l);
+    COMPROBAR(cerca(f, hz, tolerancia(hz, 20.0)), "estable t=%.1f s: %.4f Hz, esperado %.4f", t / 1e6, f, hz);
+    COMPROBAR(cerca(caudalLpm(l), 10.0, tolerancia(hz, 20.0)), "estable: %.4f L/min", caudalLpm(l));
+  }
+  const uint32_t esperados = s.realesHasta(ts.back()) - s.realesHasta(ts.front());
+  COMPROBAR(vueltasPcnt >= 1, "el PCNT no dio la vuelta");
+  COMPROBAR(vueltasCap >= 2, "la captura dio %u vueltas", vueltasCap);
+  COMPROBAR(pulsos == esperados, "pulsos %u, esperados %u", pulsos, esperados);
+  printf("estable:   %zu ventanas a %.1f Hz, %u pulsos, vueltas: %u del PCNT, %u de la captura\n",
+         ventanas, hz, pulsos, vueltasPcnt, vueltasCap);
+}
+
+// Caudal bajo: 1-4 pulsos por ventana; contarlos daría ±25 % o más, la recíproca < 0.5 %
+static void pruebaBaja() {
+  const double caudales[] = { 0.5, 0.2 };   // L/min
+  for (double lpm : caudales) {
+    std::mt19937 rng(2);
+    const double hz = lpm * CAUDAL_HZ_POR_LPM;
+    Sensor s;
+    s.pcnt0 = 0;
+    s.capOrigen = 0x80000000u;
+    s.tren(0.5e6, 70e6, hz, 50.0, rng);
+    s.cerrar();
+    CaudalAcum a = {};
+    size_t ventanas = 0;
+    float peor = 0;
+    for (double t : cierres(1e6, 65e6, rng)) {
+      const CaudalLectura l = caudalVentana(a, s.leer(t));
+      if (++ventanas < 4) continue;   // hasta tener flanco de referencia
+      const float f = caudalFrecuenciaHz(l);
+      const float err = (float)(fabs(f - hz) / hz);
+      if (err > peor) peor = err;
+      COMPROBAR(f > 0.0f && err <= 0.005f, "bajo %.1f L/min t=%.1f s: %.4f Hz, esperado %.4f",
+                lpm, t / 1e6, f, hz);
+    }
+    printf("bajo:      %.1f L/min (%.2f Hz), error máx %.3f %%\n", lpm, hz, peor * 100.0f);
+  }
+}
+
+// Parada: la frecuencia baja hacia 0 (nunca sube) y es 0 pasado
+// CAUDAL_PARADO_US. Tras 70 s parado (> vuelta de la captura) vuelve bien.
+static void pruebaParada() {
+  std::mt19937 rng(3);
+  const double hz = 5.0 * CAUDAL_HZ_POR_LPM;
+  Sensor s;
+  s.pcnt0 = 100;
+  s.capOrigen = 0;
+  s.tren(0, 10e6, hz, 20.0, rng);
+  s.tren(80e6, 100e6, hz, 20.0, rng);
+  s.cerrar();
+
+  CaudalAcum a = {};
+  float prev = 1e9f;
+  bool cero = false, primeraTrasParada = true;
+  for (double t : cierres(1e6, 99e6, rng)) {
+    const CaudalLectura l = caudalVentana(a, s.leer(t));
+    const float f = caudalFrecuenciaHz(l);
+    if (t < 2e6) continue;
+    if (t < 10e6) {
+      COMPROBAR(cerca(f, hz, tolerancia(hz, 20.0)), "antes de parar t=%.1f s: %.4f Hz", t / 1e6, f);
+    } else if (t < 80e6) {
+      COMPROBAR(f <= prev + 1e-3f, "parado t=%.1f s: sube a %.4f Hz desde %.4f", t / 1e6, f, prev);
+      if (t >= 10e6 + CAUDAL_PARADO_US + 1e6) COMPROBAR(f == 0.0f, "parado t=%.1f s: %.4f Hz", t / 1e6, f);
+      cero |= (f == 0.0f);
+      prev = f;
+    } else if (t > 80.5e6) {
+      // La primera ventana tras la parada no tiene flanco de referencia
+      // (la captura ya dio la vuelta): sale del conteo, ±1 pulso. Ninguna
+      // mezcla capturas de antes de la vuelta.
+      const double tol = primeraTrasParada ? 1e6 / (double)l.ventanaUs / hz + 0.002 : tolerancia(hz, 20.0);
+      COMPROBAR(cerca(f, hz, tol), "tras parada t=%.1f s: %.4f Hz, esperado %.4f", t / 1e6, f, hz);
+      primeraTrasParada = false;
+    }
+  }
+  COMPROBAR(cero, "nunca llegó a 0");
+  printf("parada:    %.1f Hz → 0 en <= %.1f s; recupera tras 70 s parado\n", hz, CAUDAL_PARADO_US / 1e6 + 1.0);
+}
+
+// Ráfaga de glitches en la captura que el filtro del PCNT quita: captura y
+// PCNT discrepan en más de 1 y se usa el conteo (±1 pulso por ventana)
+static void pruebaGlitch() {
+  std::mt19937 rng(4);
+  const double hz = 8.0 * CAUDAL_HZ_POR_LPM;
+  Sensor s;
+  s.pcnt0 = 0;
+  s.capOrigen = 12345;
+  s.tren(0, 20e6, hz, 20.0, rng);
+  for (int i = 0; i < 6; i++) s.glitch(10.3e6 + i * 7.0);   // rebote en mitad de la ventana 10-11 s
+  s.cerrar();
+
+  CaudalAcum a = {};
+  for (double t : cierres(1e6, 19e6, rng)) {
+    const CaudalLectura l = caudalVentana(a, s.leer(t));
+    const float f = caudalFrecuenciaHz(l);
+    if (t < 2.5e6) continue;
+    if (t > 10.5e6 && t < 11.5e6) {
+      COMPROBAR(l.flancos >= l.pulsos + 2, "sin discrepancia: %u flancos, %u pulsos", l.flancos, l.pulsos);
+      const double tol = (1.0 * 1e6 / (double)l.ventanaUs) / hz + 0.002;
+      COMPROBAR(cerca(f, hz, tol), "glitch: %.4f Hz, esperado %.4f ±%.2f %%", f, hz, tol * 100);
+      printf("glitch:    %u capturas / %u pulsos → conteo %.3f Hz (real %.3f)\n", l.flancos, l.pulsos, f, hz);
+    } else {
+      COMPROBAR(cerca(f, hz, tolerancia(hz, 20.0)), "glitch t=%.1f s: %.4f Hz, esperado %.4f", t / 1e6, f, hz);
+    }
+  }
+}
+
+// caudalDeltaPcnt alrededor del límite y caudalHzDeFlancos
+static void pruebaAuxiliares() {
+  COMPROBAR(caudalDeltaPcnt(32760, 5) == 12, "delta PCNT con vuelta: %u", caudalDeltaPcnt(32760, 5));
+  COMPROBAR(caudalDeltaPcnt(5, 5) == 0, "delta PCNT nulo");
+  COMPROBAR(caudalDeltaPcnt(0, 32766) == 32766, "delta PCNT máximo");
+  const int64_t t[] = { 1000000, 1013333, 1026667, 1040000 };
+  COMPROBAR(cerca(caudalHzDeFlancos(t, 4), 75.0, 0.001), "caudalHzDeFlancos: %.4f", caudalHzDeFlancos(t, 4));
+  COMPROBAR(caudalHzDeFlancos(t, 1) == 0.0f, "caudalHzDeFlancos con un flanco");
+}
+
+int main() {
+  pruebaAuxiliares();
+  pruebaEstable();
+  pruebaBaja();
+  pruebaParada();
+  pruebaGlitch();
+  if (g_fallos) {
+    fprintf(stderr, "%d fallos\n", g_fallos);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,85 @@
+// eventlog_bin2csv.cpp - convierte un eventlog binario (eventlog_YYYY.MM.DD.bin,
+// log_bin.h) al CSV de siempre: ts_iso,ts_us,level,mod,code,fsm,kv
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o eventlog_bin2csv tools/eventlog_bin2csv.cpp
+// Uso:
+//   eventlog_bin2csv eventlog_2025.09.19.bin > eventlog_2025.09.19.csv
+//
+// ts_iso se reconstruye con el offset de hora local guardado en el archivo;
+// sin hora válida (ts anterior a 2000) sale 1970-01-01 00:00:00 como en el
+// firmware. Los ids que no están en las tablas de esta versión (archivo
+// escrito por un firmware más nuevo) salen como #<id>. Un registro final
+// incompleto se ignora y se informa por stderr.
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include "log_bin.h"
+
+static const unsigned long long US_2000 = 946684800ULL * 1000000ULL;
+
+static void imprimirTexto(const LogBinTexto& t) {
+  if (t.p) fwrite(t.p, 1, t.len, stdout);
+  else printf("#%u", (unsigned)t.id);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "uso: %s <eventlog.bin>\n", argv[0]);
+    return 2;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) { perror(argv[1]); return 1; }
+  std::vector<uint8_t> buf;
+  uint8_t tmp[4096];
+  size_t n;
+  while ((n = fread(tmp, 1, sizeof(tmp), in)) > 0) buf.insert(buf.end(), tmp, tmp + n);
+  fclose(in);
+
+  if (buf.size() < LOGBIN_HDR_LEN || !logbinCabeceraValida(buf.data())) {
+    fprintf(stderr, "%s: cabecera no válida\n", argv[1]);
+    return 1;
+  }
+  const uint16_t nMod = bkpGetU16(buf.data() + 12), nCod = bkpGetU16(buf.data() + 14);
+  if (nMod > LOGBIN_N_MOD || nCod > LOGBIN_N_COD) {
+    fprintf(stderr, "aviso: tablas del archivo más grandes (mod=%u cod=%u) que las de esta versión (mod=%u cod=%u)\n",
+            nMod, nCod, LOGBIN_N_MOD, LOGBIN_N_COD);
+  }
+
+  printf("ts_iso,ts_us,level,mod,code,fsm,kv\r\n");
+
+  const uint8_t* p = buf.data() + LOGBIN_HDR_LEN;
+  const uint8_t* fin = buf.data() + buf.size();
+  LogBinRegistro r = {};
+  size_t filas = 0;
+  bool base = false;
+  while (p < fin) {
+    size_t k = logbinDecodificar(p, fin, r);
+    if (!k) {
+      fprintf(stderr, "offset %zu: registro incompleto o dañado, se ignoran %zu B\n",
+              (size_t)(p - buf.data()), (size_t)(fin - p));
+      break;
+    }
+    p += k;
+    if (r.abs) base = true;
+    if (!base) continue;   // delta sin registro absoluto previo
+
+    char iso[24] = "1970-01-01 00:00:00";
+    if (r.ts >= US_2000) {
+      time_t t = (time_t)(r.ts / 1000000ULL) + (time_t)r.tzMin * 60;
+      struct tm tmv;
+      if (gmtime_r(&t, &tmv)) strftime(iso, sizeof(iso), "%Y-%m-%d %H:%M:%S", &tmv);
+    }
+    printf("%s,%llu,%s,", iso, r.ts, LOG_NIVELES[r.nivel]);
+    imprimirTexto(r.mod);
+    putchar(',');
+    imprimirTexto(r.code);
+    printf(",-,");
+    fwrite(r.kv.p, 1, r.kv.len, stdout);
+    printf("\r\n");
+    filas++;
+  }
+  fprintf(stderr, "filas=%zu\n", filas);
+  return p < fin ? 3 : 0;
+}
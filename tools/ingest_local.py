@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+# ingest_local.py - sustituto local de api.php para pruebas en la red del taller.
+#
+# Acepta lo mismo que el firmware envía:
+#   GET  /IoT/api.php?api_key=..&measurement=..&sensor=..&valor=..&ts=..&mac=..&source=..[&seq=N]
+#   POST /IoT/api.php?api_key=..&format=lp&precision=us   (line protocol, campo seq=Ni opcional)
+# y responde "OK". Las muestras con (mac, seq) ya vistas se cuentan como
+# duplicadas y no se vuelven a escribir; seq ausente o 0 no se deduplica.
+#
+# Uso (config.api.endpoint = http://<ip-del-pc>:8080/IoT/api.php):
+#   python3 tools/ingest_local.py --puerto 8080 --salida ingest.csv
+#
+# Solo biblioteca estándar. El estado de deduplicación se reconstruye al
+# arrancar leyendo el CSV de salida.
+
+import argparse
+import csv
+import os
+import sys
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from threading import Lock
+from urllib.parse import parse_qs, urlsplit
+
+CAMPOS = ["timestamp", "measurement", "sensor", "valor", "mac", "source", "seq"]
+
+
+class Almacen:
+    def __init__(self, ruta):
+        self.ruta = ruta
+        self.vistos = set()
+        self.lock = Lock()
+        self.aceptadas = 0
+        self.duplicadas = 0
+        nuevo = not os.path.exists(ruta)
+        if not nuevo:
+            with open(ruta, newline="") as f:
+                for fila in csv.DictReader(f):
+                    if fila.get("seq", "0") not in ("", "0"):
+                        self.vistos.add((fila["mac"].upper(), int(fila["seq"])))
+        self.f = open(ruta, "a", newline="")
+        self.w = csv.DictWriter(self.f, fieldnames=CAMPOS)
+        if nuevo:
+            self.w.writeheader()
+
+    # Devuelve (aceptadas, duplicadas) de esta petición
+    def guardar(self, filas):
+        aceptadas = duplicadas = 0
+        with self.lock:
+            for fila in filas:
+                seq = int(fila.get("seq") or 0)
+                clave = (fila["mac"].upper(), seq)
+                if seq and clave in self.vistos:
+                    duplicadas += 1
+                    continue
+                if seq:
+                    self.vistos.add(clave)
+                self.w.writerow(fila)
+                aceptadas += 1
+            self.f.flush()
+            self.aceptadas += aceptadas
+            self.duplicadas += duplicadas
+        return aceptadas, duplicadas
+
+
+def parse_lp(linea):
+    # <measurement>,sensor=..,mac=..,source=.. valor=X[,seq=Ni] <ts>
+    cabeza, campos, ts = linea.split(" ")
+    measurement, *tags = cabeza.split(",")
+    fila = {"measurement": measurement, "timestamp": ts, "seq": "0"}
+    for kv in tags:
+        k, v = kv.split("=", 1)
+        fila[k] = v
+    for kv in campos.split(","):
+        k, v = kv.split("=", 1)
+        fila[k] = v.rstrip("i")
+    return {c: fila.get(c, "") for c in CAMPOS}
+
+
+class Handler(BaseHTTPRequestHandler):
+    almacen = None
+    api_key = None
+
+    def _responder(self, codigo, texto):
+        cuerpo = texto.encode()
+        self.send_response(codigo)
+        self.send_header("Content-Type", "text/plain")
+        self.send_header("Content-Length", str(len(cuerpo)))
+        self.end_headers()
+        self.wfile.write(cuerpo)
+
+    def _query(self):
+        q = parse_qs(urlsplit(self.path).query)
+        if self.api_key and q.get("api_key", [""])[0] != self.api_key:
+            self._responder(403, "ERR api_key")
+            return None
+        return {k: v[0] for k, v in q.items()}
+
+    def do_GET(self):
+        q = self._query()
+        if q is None:
+            return
+        try:
+            fila = {c: q.get(c, "") for c in CAMPOS}
+            fila["timestamp"] = q["ts"]
+            fila["seq"] = q.get("seq", "0")
+        except KeyError as e:
+            self._responder(400, "ERR falta %s" % e)
+            return
+        self._fin(1, *self.almacen.guardar([fila]))
+
+    def do_POST(self):
+        q = self._query()
+        if q is None:
+            return
+        if q.get("format") != "lp":
+            self._responder(400, "ERR format")
+            return
+        cuerpo = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode()
+        try:
+            filas = [parse_lp(l) for l in cuerpo.splitlines() if l.strip()]
+        except ValueError:
+            self._responder(400, "ERR lp")
+            return
+        self._fin(len(filas), *self.almacen.guardar(filas))
+
+    def _fin(self, n, aceptadas, duplicadas):
+        # El firmware solo comprueba 200 + "OK": un duplicado también es OK
+        self._responder(200, "OK n=%d aceptadas=%d duplicadas=%d" % (n, aceptadas, duplicadas))
+
+    def log_message(self, fmt, *args):
+        sys.stderr.write("%s %s\n" % (self.address_string(), fmt % args))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Ingest local con deduplicación por (mac, seq)")
+    ap.add_argument("--puerto", type=int, default=8080)
+    ap.add_argument("--salida", default="ingest.csv")
+    ap.add_argument("--api-key", default=None, help="si se indica, se exige")
+    a = ap.parse_args()
+
+    Handler.almacen = Almacen(a.salida)
+    Handler.api_key = a.api_key
+    srv = ThreadingHTTPServer(("0.0.0.0", a.puerto), Handler)
+    print("escuchando en :%d, salida=%s, vistos=%d" % (a.puerto, a.salida, len(Handler.almacen.vistos)))
+    srv.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
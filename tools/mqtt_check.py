@@ -0,0 +1,327 @@
+#!/usr/bin/env python3
+# mqtt_check.py - comprobación contra un broker local (mosquitto) de lo que el
+# backend MQTT del firmware da por hecho: QoS1 con PUBACK y sesión persistente
+# (clean session = false) que guarda los mensajes mientras el suscriptor no
+# está y los entrega al volver.
+#
+# Dos modos:
+#
+#   python3 tools/mqtt_check.py --host localhost autoprueba
+#     Sin el equipo. Un suscriptor con sesión persistente se suscribe y se
+#     desconecta; un publicador con el mismo papel que el firmware (clientId
+#     fijo, clean session = false, QoS1) publica N lotes esperando cada PUBACK;
+#     el suscriptor vuelve: el broker debe indicar sesión presente y entregar
+#     los N sin nueva suscripción, y una tercera conexión no debe recibir nada
+#     (lo confirmado con PUBACK no se repite). Código de salida 0 = todo bien.
+#
+#   python3 tools/mqtt_check.py --host localhost escuchar --salida mqtt.csv
+#     Con el equipo (config.uplink.tipo = MQTT, config.uplink.mqtt.host = IP
+#     del PC). Suscriptor persistente a <base>/+/lp que escribe cada línea del
+#     line protocol en CSV (mismas columnas que ingest_local.py) y cuenta
+#     duplicados por (mac, seq) y huecos de seq. Para ver la reentrega: parar
+#     el script, dejar que el equipo publique y volver a lanzarlo.
+#
+# Solo biblioteca estándar (cliente MQTT 3.1.1 mínimo).
+
+import argparse
+import csv
+import os
+import socket
+import struct
+import sys
+import time
+
+CAMPOS = ["timestamp", "measurement", "sensor", "valor", "mac", "source", "seq"]
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 8, 9, 12, 13, 14
+
+
+# ====== Cliente MQTT 3.1.1 mínimo ======
+def _cadena(s):
+    b = s.encode()
+    return struct.pack("!H", len(b)) + b
+
+
+def _paquete(tipo, flags, cuerpo):
+    n = len(cuerpo)
+    rem = bytearray()
+    while True:
+        d = n % 128
+        n //= 128
+        rem.append(d | (0x80 if n else 0))
+        if not n:
+            break
+    return bytes([(tipo << 4) | flags]) + bytes(rem) + cuerpo
+
+
+class Cliente:
+    def __init__(self, host, puerto, client_id, limpia, keepalive=30, usuario=None, clave=None):
+        self.sock = socket.create_connection((host, puerto), timeout=5)
+        self.sig_id = 1
+        self.pendientes = []   # PUBLISH llegados mientras se esperaba otra respuesta
+        flags = 0x02 if limpia else 0x00
+        carga = _cadena(client_id)
+        if usuario:
+            flags |= 0x80
+            carga += _cadena(usuario)
+            if clave:
+                flags |= 0x40
+                carga += _cadena(clave)
+        cuerpo = _cadena("MQTT") + bytes([4, flags]) + struct.pack("!H", keepalive) + carga
+        self.sock.sendall(_paquete(CONNECT, 0, cuerpo))
+        tipo, _, resto = self.leer()
+        if tipo != CONNACK or resto[1] != 0:
+            raise RuntimeError("CONNACK rechazado: %r" % (resto,))
+        self.sesion_presente = bool(resto[0] & 0x01)
+
+    def _exacto(self, n):
+        datos = b""
+        while len(datos) < n:
+            trozo = self.sock.recv(n - len(datos))
+            if not trozo:
+                raise ConnectionError("el broker cerró la conexión")
+            datos += trozo
+        return datos
+
+    def leer(self):
+        cab = self._exacto(1)[0]
+        mult, n = 1, 0
+        while True:
+            d = self._exacto(1)[0]
+            n += (d & 0x7F) * mult
+            mult *= 128
+            if not d & 0x80:
+                break
+        return cab >> 4, cab & 0x0F, self._exacto(n) if n else b""
+
+    def _id(self):
+        i = self.sig_id
+        self.sig_id = i % 65535 + 1
+        return i
+
+    def suscribir(self, filtro, qos=1):
+        pid = self._id()
+        self.sock.sendall(_paquete(SUBSCRIBE, 0x02, struct.pack("!H", pid) + _cadena(filtro) + bytes([qos])))
+        while True:
+            tipo, flags, resto = self.leer()
+            if tipo == PUBLISH:
+                self.pendientes.append((flags, resto))   # la sesión recuperada entrega en cuanto conecta
+            elif tipo == SUBACK and struct.unpack("!H", resto[:2])[0] == pid:
+                if resto[2] & 0x80:
+                    raise RuntimeError("SUBACK con error")
+                return resto[2]
+
+    # QoS1: vuelve al recibir el PUBACK (como publish() del firmware)
+    def publicar(self, topic, payload, qos=1):
+        pid = self._id() if qos else 0
+        cuerpo = _cadena(topic) + (struct.pack("!H", pid) if qos else b"") + payload
+        self.sock.sendall(_paquete(PUBLISH, qos << 1, cuerpo))
+        while qos:
+            tipo, flags, resto = self.leer()
+            if tipo == PUBLISH:
+                self.pendientes.append((flags, resto))
+            elif tipo == PUBACK and struct.unpack("!H", resto[:2])[0] == pid:
+                return
+
+    # (topic, payload, qos, dup) o None si no llega nada en 'espera' s.
+    # Confirma con PUBACK lo recibido con QoS1.
+    def recibir(self, espera):
+        if self.pendientes:
+            return self._entregado(*self.pendientes.pop(0))
+        self.sock.settimeout(espera)
+        try:
+            while True:
+                tipo, flags, resto = self.leer()
+                if tipo == PUBLISH:
+                    return self._entregado(flags, resto)
+        except socket.timeout:
+            return None
+        finally:
+            self.sock.settimeout(5)
+
+    def _entregado(self, flags, resto):
+        qos = (flags >> 1) & 0x03
+        tlen = struct.unpack("!H", resto[:2])[0]
+        topic = resto[2:2 + tlen].decode()
+        pos = 2 + tlen
+        if qos:
+            self.sock.sendall(_paquete(PUBACK, 0, resto[pos:pos + 2]))
+            pos += 2
+        return topic, resto[pos:], qos, bool(flags & 0x08)
+
+    def ping(self):
+        self.sock.sendall(_paquete(PINGREQ, 0, b""))
+
+    def cerrar(self):
+        try:
+            self.sock.sendall(_paquete(DISCONNECT, 0, b""))
+        finally:
+            self.sock.close()
+
+
+# ====== Line protocol (mismo formato que api.cpp appendLineaLP) ======
+#   <measurement>,sensor=<s>,mac=<m>,source=<o> valor=<v>[,seq=<n>i] <ts_us>
+def parsear_lp(texto):
+    filas = []
+    for linea in texto.splitlines():
+        linea = linea.strip()
+        if not linea:
+            continue
+        try:
+            cabeza, campos, ts = linea.split(" ")
+            partes = cabeza.split(",")
+            tags = dict(p.split("=", 1) for p in partes[1:])
+            valores = dict(c.split("=", 1) for c in campos.split(","))
+        except ValueError:
+            print("línea no válida: %r" % linea, file=sys.stderr)
+            continue
+        filas.append({
+            "timestamp": ts,
+            "measurement": partes[0],
+            "sensor": tags.get("sensor", ""),
+            "valor": valores.get("valor", ""),
+            "mac": tags.get("mac", ""),
+            "source": tags.get("source", ""),
+            "seq": valores.get("seq", "0").rstrip("i"),
+        })
+    return filas
+
+
+# ====== Modos ======
+def autoprueba(a):
+    base = "%s/autoprueba" % a.base
+    topic = base + "/lp"
+    sub_id, pub_id = "oxigeno-check-sub", "oxigeno-check-pub"
+    fallos = 0
+
+    def comprobar(ok, que):
+        nonlocal fallos
+        print(("OK    " if ok else "FALLO ") + que)
+        fallos += 0 if ok else 1
+
+    # Partir de cero: una conexión limpia borra sesiones de ejecuciones previas
+    for cid in (sub_id, pub_id):
+        Cliente(a.host, a.puerto, cid, limpia=True, usuario=a.usuario, clave=a.clave).cerrar()
+
+    sub = Cliente(a.host, a.puerto, sub_id, limpia=False, usuario=a.usuario, clave=a.clave)
+    comprobar(not sub.sesion_presente, "sesión nueva sin estado previo")
+    comprobar(sub.suscribir(topic, 1) == 1, "suscripción concedida con QoS1")
+    sub.cerrar()
+
+    # El publicador hace lo mismo que MqttTransport::enviar(): QoS1, espera PUBACK
+    pub = Cliente(a.host, a.puerto, pub_id, limpia=False, usuario=a.usuario, clave=a.clave)
+    enviados = []
+    t0 = time.monotonic()
+    for i in range(a.n):
+        payload = ("voltaje,sensor=ZMPT101B,mac=AUTOPRUEBA,source=wifi valor=%d.00,seq=%di %d\n"
+                   % (220 + i % 20, i + 1, 1757400000000000 + i)).encode()
+        pub.publicar(topic, payload, 1)
+        enviados.append(payload)
+    dt = time.monotonic() - t0
+    comprobar(True, "%d publicaciones QoS1 confirmadas con PUBACK (%.1f ms/lote)" % (a.n, 1000 * dt / max(a.n, 1)))
+    pub.cerrar()
+
+    pub = Cliente(a.host, a.puerto, pub_id, limpia=False, usuario=a.usuario, clave=a.clave)
+    comprobar(pub.sesion_presente, "el broker conserva la sesión del publicador (clean session = false)")
+    pub.cerrar()
+
+    # Vuelve el suscriptor: sin suscribirse otra vez debe recibirlo todo
+    sub = Cliente(a.host, a.puerto, sub_id, limpia=False, usuario=a.usuario, clave=a.clave)
+    comprobar(sub.sesion_presente, "el broker conserva la sesión del suscriptor")
+    recibidos = []
+    while len(recibidos) < a.n:
+        m = sub.recibir(a.espera)
+        if m is None:
+            break
+        recibidos.append(m[1])
+    sub.cerrar()
+    comprobar(len(recibidos) == a.n, "reentrega tras reconectar: %d de %d" % (len(recibidos), a.n))
+    comprobar(recibidos == enviados, "mismo contenido y orden")
+
+    # Lo ya confirmado no se vuelve a entregar
+    sub = Cliente(a.host, a.puerto, sub_id, limpia=False, usuario=a.usuario, clave=a.clave)
+    extra = sub.recibir(min(a.espera, 1.0))
+    sub.cerrar()
+    comprobar(extra is None, "sin repeticiones de mensajes ya confirmados")
+
+    for cid in (sub_id, pub_id):
+        Cliente(a.host, a.puerto, cid, limpia=True, usuario=a.usuario, clave=a.clave).cerrar()
+
+    print("%d fallos" % fallos if fallos else "todo bien")
+    return 1 if fallos else 0
+
+
+def escuchar(a):
+    nuevo = not os.path.exists(a.salida)
+    vistos = set()
+    ultimo = {}
+    if not nuevo:
+        with open(a.salida, newline="") as f:
+            for fila in csv.DictReader(f):
+                if fila.get("seq", "0") not in ("", "0"):
+                    vistos.add((fila["mac"].upper(), int(fila["seq"])))
+    f = open(a.salida, "a", newline="")
+    w = csv.DictWriter(f, fieldnames=CAMPOS)
+    if nuevo:
+        w.writeheader()
+
+    cli = Cliente(a.host, a.puerto, a.client_id, limpia=False, usuario=a.usuario, clave=a.clave)
+    print("conectado a %s:%d como %s (sesión %s)" % (a.host, a.puerto, a.client_id,
+                                                  "recuperada" if cli.sesion_presente else "nueva"))
+    cli.suscribir("%s/+/lp" % a.base, 1)
+    aceptadas = duplicadas = huecos = 0
+    try:
+        while True:
+            m = cli.recibir(15)
+            if m is None:
+                cli.ping()
+                continue
+            topic, payload, _, dup = m
+            for fila in parsear_lp(payload.decode(errors="replace")):
+                mac, seq = fila["mac"].upper(), int(fila["seq"] or 0)
+                if seq and (mac, seq) in vistos:
+                    duplicadas += 1
+                    continue
+                if seq:
+                    vistos.add((mac, seq))
+                    if mac in ultimo and seq > ultimo[mac] + 1:
+                        huecos += seq - ultimo[mac] - 1
+                    ultimo[mac] = max(seq, ultimo.get(mac, 0))
+                w.writerow(fila)
+                aceptadas += 1
+            f.flush()
+            print("%s%s: aceptadas=%d duplicadas=%d huecos_seq=%d" % (topic, " (DUP)" if dup else "",
+                                                                     aceptadas, duplicadas, huecos), flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        cli.sock.close()   # sin DISCONNECT limpio: la sesión sigue en el broker
+        f.close()
+    return 0
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__)
+    p.add_argument("--host", default="localhost")
+    p.add_argument("--puerto", type=int, default=1883)
+    p.add_argument("--usuario")
+    p.add_argument("--clave")
+    p.add_argument("--base", default="oxigeno", help="config.uplink.mqtt.topicBase")
+    sub = p.add_subparsers(dest="modo", required=True)
+    pa = sub.add_parser("autoprueba")
+    pa.add_argument("--n", type=int, default=50, help="lotes a publicar")
+    pa.add_argument("--espera", type=float, default=3.0, help="s máx. por mensaje en la reentrega")
+    pe = sub.add_parser("escuchar")
+    pe.add_argument("--salida", default="mqtt.csv")
+    pe.add_argument("--client-id", default="oxigeno-check")
+    a = p.parse_args()
+    try:
+        return autoprueba(a) if a.modo == "autoprueba" else escuchar(a)
+    except (OSError, RuntimeError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,123 @@
+// pack_expand.cpp - expande los archivos mensuales de la retención
+// (/sent/arch/raw_YYYYMM.oxz, raw_pack.h) a un CSV por día.
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o pack_expand tools/pack_expand.cpp
+// Uso (con la SD copiada en ./sd):
+//   pack_expand expandido/ sd/sent/arch/raw_*.oxz
+//
+// Genera expandido/backup_YYYYMMDD.csv:
+//   timestamp,measurement,sensor,valor,source,status,ts_envio,seq
+// con status=ENVIADO (todo lo archivado se confirmó). ts_envio sale de las
+// confirmaciones del segmento (v2): la primera cuyo rango [inicio, fin)
+// contiene el offset original del registro, igual que ack_expand. En
+// segmentos v1 (sin confirmaciones) queda vacío.
+// Los segmentos con CRC inválido se saltan; si un backup aparece dos veces
+// vale el último segmento completo.
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "raw_pack.h"
+#include "sample.h"
+
+struct Seg {
+  PackSegmento s;
+  const uint8_t* payload;
+};
+
+static bool leerArchivo(const char* path, std::vector<uint8_t>& buf) {
+  FILE* f = fopen(path, "rb");
+  if (!f) { perror(path); return false; }
+  uint8_t tmp[4096];
+  size_t n;
+  while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) buf.insert(buf.end(), tmp, tmp + n);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "uso: %s <dir_salida> <raw_YYYYMM.oxz>...\n", argv[0]);
+    return 2;
+  }
+  const std::string dirSalida = argv[1];
+  std::deque<std::vector<uint8_t>> datos;            // los Seg apuntan aquí
+  std::map<std::pair<uint32_t, bool>, Seg> segs;      // (fecha, fmt) → último segmento válido
+  size_t malos = 0, repetidos = 0;
+
+  for (int a = 2; a < argc; a++) {
+    datos.emplace_back();
+    std::vector<uint8_t>& buf = datos.back();
+    if (!leerArchivo(argv[a], buf)) return 1;
+    if (buf.size() < PACK_HDR_LEN || !packCabeceraValida(buf.data())) {
+      fprintf(stderr, "%s: cabecera no válida\n", argv[a]);
+      return 1;
+    }
+    size_t pos = PACK_HDR_LEN;
+    PackSegmento s;
+    while (const uint8_t* payload = packSiguienteSegmento(buf.data(), buf.size(), pos, s, malos)) {
+      auto ins = segs.insert({ { s.fecha, s.binario }, Seg{ s, payload } });
+      if (!ins.second) { ins.first->second = Seg{ s, payload }; repetidos++; }
+    }
+  }
+
+  std::map<uint32_t, FILE*> salidas;   // fecha → CSV (CSV y BIN del día juntos)
+  size_t filas = 0, truncados = 0, sinEnvio = 0;
+  for (const auto& kv : segs) {
+    const Seg& g = kv.second;
+    FILE*& out = salidas[g.s.fecha];
+    if (!out) {
+      char base[40];
+      snprintf(base, sizeof(base), "backup_%08lu.csv", (unsigned long)g.s.fecha);
+      std::string ruta = dirSalida + "/" + base;
+      out = fopen(ruta.c_str(), "wb");
+      if (!out) { perror(ruta.c_str()); return 1; }
+      fprintf(out, "timestamp,measurement,sensor,valor,source,status,ts_envio,seq\r\n");
+    }
+    PackEstado e;
+    packReiniciar(e);
+    const uint8_t* p = g.payload;
+    const uint8_t* fin = g.payload + g.s.len;
+
+    // Confirmaciones sin solapes, como las deduplica ack_expand: un rango
+    // repetido (corte entre el diario y el manifiesto) vale la primera vez
+    std::vector<PackAck> acks;
+    uint32_t hecho = 0;
+    for (uint32_t i = 0; i < g.s.nAck; i++) {
+      PackAck a;
+      size_t k = packDecodificarAck(e, p, fin, a);
+      if (!k) { truncados++; break; }
+      p += k;
+      if (hecho >= a.fin) continue;
+      if (hecho > a.inicio) a.inicio = hecho;
+      acks.push_back(a);
+      hecho = a.fin;
+    }
+
+    size_t j = 0;   // registros y rangos van en orden de offset
+    for (uint32_t i = 0; i < g.s.n; i++) {
+      BackupRecord r;
+      uint32_t off;
+      size_t k = packDecodificar(e, g.s.version, p, fin, r, off);
+      if (!k) { truncados++; break; }
+      p += k;
+      const SensorDef* def = sensorDef(r.sensor);
+      if (!def) continue;
+      while (j < acks.size() && acks[j].fin <= off) j++;
+      char ts[24] = "";
+      if (j < acks.size() && acks[j].inicio <= off) snprintf(ts, sizeof(ts), "%llu", acks[j].tsEnvio);
+      else sinEnvio++;
+      fprintf(out, "%llu,%s,%s,%.2f,%s,ENVIADO,%s,%lu\r\n", r.timestamp, def->measurement, def->sensor, r.valor,
+              origenNombre((r.flags & BKP_FLAG_ORIGEN_BACKUP) ? ORIGEN_BACKUP : ORIGEN_WIFI), ts, (unsigned long)r.seq);
+      filas++;
+    }
+  }
+  for (auto& kv : salidas) fclose(kv.second);
+
+  fprintf(stderr, "segmentos=%zu filas=%zu sin_ts_envio=%zu repetidos=%zu malos=%zu truncados=%zu\n",
+          segs.size(), filas, sinEnvio, repetidos, malos, truncados);
+  return (malos || truncados) ? 3 : 0;
+}
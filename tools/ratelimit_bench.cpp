@@ -0,0 +1,129 @@
+// ratelimit_bench.cpp - coste por llamada y fidelidad del limitador de
+// logEventoM() (ratelimit.cpp) según el número de claves distintas.
+//
+// Compilar en el PC:
+//   g++ -std=c++17 -O2 -Isrc -o ratelimit_bench tools/ratelimit_bench.cpp
+// Uso:
+//   ratelimit_bench [llamadas por prueba, 2000000 por defecto]
+//
+// Para 8..1024 claves "MODnn|CODE_nnnn" lanza eventos al azar (1 ms de reloj
+// por llamada) y mide ns por rlPermitir(). Los compara con un token bucket de
+// referencia sin límite de claves (std::unordered_map): "exceso" son los
+// eventos que el limitador deja pasar de más (ráfagas regaladas a claves
+// desalojadas) y "defecto" los que retiene de menos. "err/clave" es
+// Σ |pasan_k − ref_k| / Σ ref_k sobre las claves y "máx" el peor
+// |pasan_k − ref_k| / ref_k: el total puede cuadrar aunque cada clave no.
+// Código de salida 1 si, hasta RL_SLOTS / 2 claves (la capacidad declarada en
+// ratelimit.h), el exceso o el error por clave superan el 1 % (o una clave el
+// 5 %), o si esa capacidad no cubre RL_CLAVES_FIRMWARE. Por encima de la capacidad la tabla
+// se satura: se informa del error, marcado "saturada", sin fallar.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ratelimit.cpp"   // sin dependencias de Arduino; deja ver su estado
+
+// Claves mod|code distintas que usa el firmware (LOGx en src/); actualizar si crecen
+#define RL_CLAVES_FIRMWARE 85
+
+static void reiniciar() {
+  memset(g_tabla, 0, sizeof(g_tabla));
+  memset(g_textos, 0, sizeof(g_textos));
+  g_ocupadas = 0;
+  g_desalojos = g_perdidos = 0;
+  g_cursor = 0;
+}
+
+// La misma regla que rlPermitir(), con memoria ilimitada
+struct Referencia {
+  struct Bucket { uint32_t recargaMs, credito; };
+  std::unordered_map<std::string, Bucket> m;
+  bool permitir(const std::string& k, uint32_t ahoraMs) {
+    auto it = m.find(k);
+    if (it == m.end()) it = m.emplace(k, Bucket{ ahoraMs, CREDITO_MAX }).first;
+    Bucket& b = it->second;
+    uint32_t dt = ahoraMs - b.recargaMs;
+    b.recargaMs = ahoraMs;
+    b.credito = (dt >= CREDITO_MAX - b.credito) ? CREDITO_MAX : b.credito + dt;
+    if (b.credito < RL_PERIODO_MS) return false;
+    b.credito -= RL_PERIODO_MS;
+    return true;
+  }
+};
+
+int main(int argc, char** argv) {
+  const size_t llamadas = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 2000000;
+  static const size_t CLAVES[] = { 8, 64, RL_CLAVES_FIRMWARE, 128, 256, 512, 1024 };
+  const size_t capacidad = RL_SLOTS / 2;
+  int fallos = 0;
+
+  printf("RL_SLOTS=%d (%zu B) RL_SONDAS=%d, capacidad %zu claves, firmware %d, %zu llamadas por prueba\n",
+         RL_SLOTS, sizeof(g_tabla), RL_SONDAS, capacidad, RL_CLAVES_FIRMWARE, llamadas);
+  if (capacidad < RL_CLAVES_FIRMWARE) {
+    fprintf(stderr, "FALLO: RL_SLOTS / 2 = %zu < %d claves del firmware\n", capacidad, RL_CLAVES_FIRMWARE);
+    fallos++;
+  }
+  printf("%7s %9s %10s %10s %9s %9s %10s %7s %11s %9s\n",
+         "claves", "ns/llam", "pasan", "ref", "exceso", "defecto", "err/clave", "máx", "desalojos", "perdidos");
+
+  for (size_t nClaves : CLAVES) {
+    std::vector<std::string> claves;
+    for (size_t i = 0; i < nClaves; i++) {
+      char k[RL_CLAVE_LEN];
+      snprintf(k, sizeof(k), "MOD%02zu|CODE_%04zu", i % 23, i);
+      claves.push_back(k);
+    }
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<size_t> elegir(0, nClaves - 1);
+    std::vector<uint32_t> orden(llamadas);
+    for (uint32_t& o : orden) o = (uint32_t)elegir(rng);
+
+    // Tiempo: solo rlPermitir()
+    reiniciar();
+    size_t pasan = 0;
+    std::vector<uint8_t> paso(llamadas);
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < llamadas; i++) {
+      uint16_t sup;
+      paso[i] = rlPermitir(claves[orden[i]].c_str(), (uint32_t)i, sup);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (uint8_t p : paso) pasan += p;
+    const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)llamadas;
+
+    // Fidelidad frente a la referencia, evento a evento
+    Referencia ref;
+    size_t pasanRef = 0, exceso = 0, defecto = 0;
+    std::vector<size_t> pasanK(nClaves, 0), refK(nClaves, 0);
+    for (size_t i = 0; i < llamadas; i++) {
+      const bool r = ref.permitir(claves[orden[i]], (uint32_t)i);
+      pasanRef += r;
+      pasanK[orden[i]] += paso[i];
+      refK[orden[i]] += r;
+      if (paso[i] && !r) exceso++;
+      if (!paso[i] && r) defecto++;
+    }
+    size_t difClaves = 0;
+    double peorClave = 0;
+    for (size_t k = 0; k < nClaves; k++) {
+      const size_t d = pasanK[k] > refK[k] ? pasanK[k] - refK[k] : refK[k] - pasanK[k];
+      difClaves += d;
+      if (refK[k] && (double)d / refK[k] > peorClave) peorClave = (double)d / refK[k];
+    }
+    const double errClave = pasanRef ? (double)difClaves / pasanRef : 0;
+    const RlStats st = rlStats();
+    printf("%7zu %9.1f %10zu %10zu %9zu %9zu %9.2f%% %6.1f%% %11lu %9lu%s\n", nClaves, ns, pasan, pasanRef, exceso,
+           defecto, errClave * 100, peorClave * 100, (unsigned long)st.desalojos, (unsigned long)st.perdidos,
+           nClaves > capacidad ? "  saturada" : "");
+    if (nClaves <= capacidad && (exceso * 100 > pasanRef || errClave > 0.01 || peorClave > 0.05)) {
+      fprintf(stderr, "FALLO: %zu claves, exceso %zu + defecto %zu de %zu, error por clave %.2f %%\n", nClaves,
+              exceso, defecto, pasanRef, errClave * 100);
+      fallos++;
+    }
+  }
+  return fallos ? 1 : 0;
+}